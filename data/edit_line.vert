@@ -6,7 +6,12 @@ in vec4 color;
 
 out vec4 color_;
 
-uniform mat3 inverse_view_matrix;
+layout(std140) uniform Frame
+{
+    mat3 inverse_view_matrix;
+    vec2 window_size;
+    float aspect;
+};
 
 void main()
 {
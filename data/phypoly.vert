@@ -2,7 +2,12 @@
 
 in vec2 position;
 
-uniform mat3 inverse_view_matrix;
+layout(std140) uniform Frame
+{
+    mat3 inverse_view_matrix;
+    vec2 window_size;
+    float aspect;
+};
 uniform mat3 wmat;
 uniform float radius;
 uniform vec2 offset;
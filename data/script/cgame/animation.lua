@@ -1,120 +1,86 @@
-cs.animation = { auto_saveload = true }
-
-cs.animation.tbl = cg.entity_table()
-
-function cs.animation.add(ent)
-    if cs.animation.tbl[ent] then return end
+-- animations are stored and stepped in C (see animation.h), this just adds
+-- Lua-friendly wrappers and importing of old Lua-side dumps
+
+-- anything not defined here falls through to the C function, like other
+-- systems, eg. cs.animation.start(...) is animation_start(...) -- nil if
+-- there's no such function, as ffi errors on undeclared symbols and event,
+-- save and clone walks look up fields such as 'enabled' on every system
+cs.animation = setmetatable({}, {
+    __index = function (_, k)
+        local ok, f = pcall(function () return cg['animation_' .. k] end)
+        return ok and f or nil
+    end,
+})
 
-    cs.animation.tbl[ent] = {
-        ent = ent,
-        anims = {},
-        curr_anim = nil,   -- name of animation
-        frame = 1,         -- index of frame
-        t = 1,             -- time left in this frame
-    }
-end
 function cs.animation.remove(ent, anim)
-    local entry = cs.animation.tbl[ent]
-    if entry then
-        if anim then
-            if entry.curr_anim == anim then
-                entry.curr_anim = nil
-            end
-            entry.anims[anim] = nil
-        else
-            cs.animation.tbl[ent] = nil
-        end
+    if anim then
+        cg.animation_remove_anim(ent, anim)
+    else
+        cg.animation_remove(ent)
     end
 end
-function cs.animation.has(ent)
-    return cs.animation.tbl[ent] ~= nil
-end
 
--- utility for contiguous strips of frames
+-- utility for contiguous strips of frames, tbl is of the form
+-- { name = { n = ..., t = ..., base = ..., after = ... }, ... }
 function cs.animation.set_strips(ent, tbl)
-    local entry = cs.animation.tbl[ent]
-    assert(entry, 'entity must be in animation system')
+    assert(cs.animation.has(ent), 'entity must be in animation system')
     for anim, strip in pairs(tbl) do
-        entry.anims[anim] = { n = strip.n, strip = strip }
+        cg.animation_set_strip(ent, anim, strip.n, strip.t, strip.base)
+        cg.animation_set_after(ent, anim, strip.after)
     end
 end
 
--- manual specification of every frame and its duration
+-- manual specification of every frame and its duration, tbl is of the form
+-- { name = { { t = ..., texcell = ..., texsize = ... }, ... }, ... }
 function cs.animation.set_frames(ent, tbl)
-    local entry = cs.animation.tbl[ent]
-    assert(entry, 'entity must be in animation system')
-    for anim, frames in pairs(anim) do
-        entry.anims[anim] = { n = #frames, frames = frames }
+    assert(cs.animation.has(ent), 'entity must be in animation system')
+    for anim, frames in pairs(tbl) do
+        if cg.animation_has_anim(ent, anim) then
+            cg.animation_remove_anim(ent, anim)
+        end
+        for _, frm in ipairs(frames) do
+            local texcell = frm.texcell and cg.Vec2(frm.texcell)
+            local texsize = frm.texsize and cg.Vec2(frm.texsize)
+            cg.animation_add_frame(ent, anim, frm.t, texcell, texsize)
+        end
     end
 end
 
-local function _enter_frame(entry, frame, anim)
-    anim = anim or entry.anims[entry.curr_anim]
-    entry.frame = frame
-    if anim.strip then
-        entry.t = anim.strip.t > 0 and anim.strip.t or 1
-        local v = cg.Vec2(anim.strip.base)
-        v.x = v.x + (frame - 1) * cs.sprite.get_texsize(entry.ent).x
-        cs.sprite.set_texcell(entry.ent, v)
-    elseif anim.frames then
-        local frm = anim.frames[frame]
-        entry.t = frm.t > 0 and frm.t or 1
-        if frm.texcell then cs.sprite.set_texcell(entry.ent, frm.texcell) end
-        if frm.texsize then cs.sprite.set_texsize(entry.ent, frm.texsize) end
+-- set of animation names, for iteration/completion
+function cs.animation.get_anims(ent)
+    local anims = {}
+    for i = 0, cg.animation_get_num_anims(ent) - 1 do
+        anims[cg.string(cg.animation_get_nth_anim(ent, i))] = true
     end
+    return anims
 end
 
-function cs.animation.get_curr_anim(ent, anim)
-    local entry = cs.animation.tbl[ent]
-    assert(entry, 'entity must be in animation system')
-    return entry.curr_anim
+function cs.animation.get_after(ent, anim)
+    local after = cg.animation_get_after(ent, anim)
+    return after ~= nil and cg.string(after) or nil
 end
 
-function cs.animation.switch(ent, anim)
-    local entry = cs.animation.tbl[ent]
-    assert(entry, 'entity must be in animation system')
-    assert(entry.anims[anim], "must have an animation with name '"
-               .. anim .. "'")
-    if entry.curr_anim ~= anim then
-        entry.curr_anim = anim
-        _enter_frame(entry, 1)
-    end
+function cs.animation.get_curr_anim(ent)
+    local anim = cg.animation_get_curr_anim(ent)
+    return anim ~= nil and cg.string(anim) or nil
 end
 
-function cs.animation.start(ent, anim)
-    local entry = cs.animation.tbl[ent]
-    assert(entry, 'entity must be in animation system')
-    assert(entry.anims[anim], "must have an animation with name '"
-               .. anim .. "'")
-    entry.curr_anim = anim
-    _enter_frame(entry, 1)
-end
-
-function cs.animation.update_all()
-    cg.entity_table_remove_destroyed(cs.animation.tbl, cs.animation.remove)
-
-    if cs.timing.get_paused() then return end
-
-    for ent, entry in pairs(cs.animation.tbl) do
-        if entry.curr_anim then
-            local dt = cs.timing.dt
-            local anim = entry.anims[entry.curr_anim]
-
-            -- next frame?
-            while entry.t <= dt do
-                if anim.after and entry.frame >= anim.n then
-                    assert(entry.anims[anim.after], "must have an animation "
-                               .. "with name '" .. anim.after .. "'")
-                    entry.curr_anim = anim.after
-                    entry.frame = 1
-                    anim = entry.anims[anim.after]
-                end
-                _enter_frame(entry, entry.frame >= anim.n
-                                 and 1 or entry.frame + 1, anim)
-                dt = dt - entry.t
+-- load old dumps from when animations were stored in Lua
+function cs.animation.load_all(dump)
+    if not dump.tbl then return end
+    for ent, entry in pairs(dump.tbl) do
+        cs.animation.add(ent)
+        for name, anim in pairs(entry.anims or {}) do
+            if anim.strip then
+                cg.animation_set_strip(ent, name, anim.n or anim.strip.n,
+                                       anim.strip.t, anim.strip.base)
+            elseif anim.frames then
+                cs.animation.set_frames(ent, { [name] = anim.frames })
             end
-
-            entry.t = entry.t - dt
+            cg.animation_set_after(ent, name, anim.after)
+        end
+        if entry.curr_anim and cg.animation_has_anim(ent, entry.curr_anim) then
+            cs.animation.start(ent, entry.curr_anim)
         end
     end
 end
@@ -156,12 +122,11 @@ cs.edit_inspector.custom['animation'] = {
 
     post_update = function (inspector)
         local ent = inspector.ent
-        local entry = cs.animation.tbl[ent]
-        local anims = entry.anims
+        local anims = cs.animation.get_anims(ent)
 
         -- current animation
         cg.edit_field_post_update(
-            inspector.curr_anim, entry.curr_anim or '(none)',
+            inspector.curr_anim, cs.animation.get_curr_anim(ent) or '(none)',
             function (v) cs.animation.switch(ent, v) end,
             anims)
 
@@ -175,7 +140,7 @@ cs.edit_inspector.custom['animation'] = {
         end
 
         -- add missing views
-        for name, anim in pairs(anims) do
+        for name in pairs(anims) do
             if not inspector.anim_views[name] then
                 local view = {}
                 inspector.anim_views[name] = view
@@ -239,16 +204,23 @@ cs.edit_inspector.custom['animation'] = {
             if cs.entity.destroyed(view.window) then
                 cs.animation.remove(ent, name)
             else
-                local anim = anims[name]
+                local n = cs.animation.get_n(ent, name)
+                local t = cs.animation.get_t(ent, name)
+                local base = cs.animation.get_base(ent, name)
+                local after = cs.animation.get_after(ent, name)
+
+                -- editing n, t or base turns manual frames into a strip
+                local function set_strip(n, t, base)
+                    cg.animation_set_strip(ent, name, n, t, base)
+                end
 
                 -- duplicate?
                 if cs.gui.event_mouse_down(view.dup_text) == cg.MC_LEFT then
                     local function new_strip(s)
                         local strips = {
                             [s] = {
-                                n = anim.n, t = anim.strip.t,
-                                base = cg.Vec2(anim.strip.base),
-                                after = anim.after
+                                n = n, t = t, base = cg.Vec2(base),
+                                after = after
                             }
                         }
                         cs.animation.set_strips(ent, strips)
@@ -258,20 +230,18 @@ cs.edit_inspector.custom['animation'] = {
 
                 -- update fields
                 cg.edit_field_post_update(
-                    view.n, anim.n,
-                    function (v) anim.n = v end)
+                    view.n, n,
+                    function (v) set_strip(v, t, base) end)
                 cg.edit_field_post_update(
-                    view.t, anim.strip.t,
-                    function (v)
-                        anim.strip.t = v
-                        entry.t = v > 0 and v or 1
-                    end)
+                    view.t, t,
+                    function (v) set_strip(n, v, base) end)
                 cg.edit_field_post_update(
-                    view.base, anim.strip.base,
-                    function (v) anim.strip.base = v end)
+                    view.base, base,
+                    function (v) set_strip(n, t, v) end)
                 cg.edit_field_post_update(
-                    view.after, anim.after or '(none)',
-                    function (s) anim.after = s end, anims)
+                    view.after, after or '(none)',
+                    function (s) cg.animation_set_after(ent, name, s) end,
+                    anims)
             end
         end
     end,
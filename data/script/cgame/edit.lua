@@ -104,12 +104,14 @@ cs.edit.stopped = true
 -- load this when stopped
 local stop_savepoint = nil
 local stop_save_next_frame = false -- whether to save a stop soon
+local stop_save_undo = false -- whether last undo point should be the stop
 local function stop_save()
     cs.group.set_save_filter('default edit_inspector', true)
     local s = cg.store_open()
     cs.system.save_all(s)
     stop_savepoint = ffi.string(cg.store_write_str(s))
     cg.store_close(s)
+    stop_save_undo = false
 
     if cs.timing.get_paused() then cs.edit.stopped = true end
 end
@@ -118,12 +120,14 @@ function cs.edit.stop_save()
 end
 
 function cs.edit.stop()
+    if stop_save_undo then stop_save() end
     if not stop_savepoint then return end
 
     cs.group.destroy('default edit_inspector')
     local s = cg.store_open_str(stop_savepoint)
     cs.system.load_all(s)
     cg.store_close(s)
+    cs.edit.undo_clear()
 
     cs.timing.set_paused(true)
     cs.edit.stopped = true
@@ -140,34 +144,42 @@ end
 
 --- undo -----------------------------------------------------------------------
 
-cs.edit.history = {}
+-- points only keep rows of entities tracked, see undo.h -- selected and
+-- inspected ones are tracked at each point, so are known before the next
+-- edit, anything else an edit touches must be tracked by it beforehand
 
-function cs.edit.undo_save()
-    cs.group.set_save_filter('default edit_inspector', true)
-    local s = cg.store_open()
-    cs.system.save_all(s)
+local function undo_track()
+    for ent in pairs(cs.edit.select) do cg.undo_track(ent) end
+    for ent in pairs(cs.edit_inspector.get_entities()) do
+        cg.undo_track(ent)
+    end
+end
 
-    local str = ffi.string(cg.store_write_str(s))
-    table.insert(cs.edit.history, str)
-    if cs.edit.stopped then stop_savepoint = str end -- update stop if stopped
+function cs.edit.undo_save()
+    undo_track()
+    cg.undo_save()
 
-    cg.store_close(s)
+    -- update stop if stopped, saved only once we play
+    if cs.edit.stopped then stop_save_undo = true end
 end
 
 function cs.edit.undo()
-    if #cs.edit.history <= 1 then
+    if not cg.undo_can_undo() then
         print('nothing to undo')
         return
     end
 
-    -- TODO: make 'edit' entity group and destroy all except that?
-    cs.group.destroy('default edit_inspector')
+    cg.undo_undo()
+    undo_track()
 
-    table.remove(cs.edit.history)
-    local str = cs.edit.history[#cs.edit.history]
-    local s = cg.store_open_str(str)
-    cs.system.load_all(s)
-    cg.store_close(s)
+    -- update stop if stopped, saved only once we play
+    if cs.edit.stopped then stop_save_undo = true end
+end
+
+-- after loading over what points know about, they can't be undone
+function cs.edit.undo_clear()
+    cg.undo_clear()
+    undo_track()
 end
 
 
@@ -300,7 +312,10 @@ function cs.edit.update_all()
         if cs.edit.stopped then cs.edit.play()
         else cs.edit.stop() end
     end
-    if not cs.timing.get_paused() then cs.edit.stopped = false end
+    if not cs.timing.get_paused() then
+        if cs.edit.stopped and stop_save_undo then stop_save() end
+        cs.edit.stopped = false
+    end
 
     -- if not enabled skip -- also handle gui visibility
     if not cs.edit.get_enabled() then
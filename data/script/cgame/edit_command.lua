@@ -180,6 +180,7 @@ function cs.edit.command_inspect()
     local function system(s)
         if add then
             local e = cg.entity_create()
+            cg.undo_track_created(e)
             cs.edit_inspector.add(e, s)
             cs.edit.select[e] = true
         elseif not cg.entity_table_empty(cs.edit.select) then
@@ -205,6 +206,7 @@ function cs.edit.command_save()
                               .. f .. "' ... ")
         cs.group.set_save_filter('default', true)
         local s = cg.store_open()
+        cg.store_set_binary(s, true)
         cs.system.save_all(s)
         cg.store_write_file(s, f)
         cg.store_close(s)
@@ -228,6 +230,7 @@ function cs.edit.command_load()
         local s = cg.store_open_file(f)
         cs.system.load_all(s)
         cg.store_close(s)
+        cs.edit.undo_clear()
         print("done")
 
         cs.edit.stop_save()
@@ -273,6 +276,7 @@ function cs.edit.command_load_prefab()
     local function load(f)
         cs.edit.select_clear()
         local ent = cs.prefab.load(f)
+        cg.undo_track_created(ent)
         cs.edit.select[ent] = true
         if cs.transform.has(ent) then
             -- move to center of view
@@ -38,6 +38,7 @@ function cs.edit.duplicate()
     local d = cg.store_open_str(str)
     cs.system.load_all(d)
     cg.store_close(d)
+    for ent in pairs(cs.edit.select) do cg.undo_track_created(ent) end
 
     cs.edit.undo_save()
 end
@@ -477,6 +477,13 @@ function cs.edit_inspector.remove(ent, sys)
     inspectors[ent][sys] = nil
 end
 
+-- return set of entities being inspected
+function cs.edit_inspector.get_entities()
+    local ents = cg.entity_table()
+    for ent in pairs(inspectors) do ents[ent] = true end
+    return ents
+end
+
 -- return set of all valid inspector systems
 function cs.edit_inspector.get_systems()
     local sys = {}
@@ -656,12 +663,20 @@ cs.meta.props['camera'] = {
 }
 
 cs.meta.props['sprite'] = {
+    { name = 'texture' },
     { name = 'size' },
     { name = 'texcell' },
     { name = 'texsize' },
     { name = 'depth' },
 }
 
+cs.meta.props['tilemap'] = {
+    { name = 'texture' },
+    { name = 'tile_size' },
+    { name = 'texsize' },
+    { name = 'depth' },
+}
+
 cs.meta.props['physics'] = {
     { name = 'type' },
     { name = 'mass' },
@@ -49,11 +49,11 @@ local entity_table_mt = {
     __serialize_f = function (t)
         local map = rawget(t, 'map') or {}
 
-        -- don't save filtered-out entities
+        -- don't save filtered-out entities, key by saved id
         local filtered = {}
-        for k, slot in pairs(map) do
+        for _, slot in pairs(map) do
             if cg.entity_get_save_filter(slot.k) then
-                filtered[k] = slot
+                filtered[cg._entity_saved_id(slot.k)] = slot
             end
         end
         return 'cg.__entity_table_load', filtered
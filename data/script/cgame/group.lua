@@ -117,3 +117,7 @@ function cs.group.load_all(d)
         cs.group.set_groups(ent, groups)
     end
 end
+
+function cs.group.clone(from, to)
+    if entity_groups[from] then cs.group.add(to, entity_groups[from]) end
+end
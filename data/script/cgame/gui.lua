@@ -9,13 +9,13 @@ cg.wrap_string('gui_text', 'str')
 cs.gui_event = {}
 
 local event_handlers = cg.entity_table()
-local event_defaults = {}
+local event_names = {}
 
 function cs.gui_event.add()
 end
 
-local function add_event(event, default)
-    event_defaults[event] = default
+local function add_event(event, type)
+    event_names[type] = event
 
     cs.gui_event['set_' .. event] = function (ent, f)
         if not event_handlers[ent] then
@@ -25,24 +25,34 @@ local function add_event(event, default)
     end
 end
 
-add_event('focus_enter', false)
-add_event('focus_exit', false)
-add_event('mouse_down', cg.MC_NONE)
-add_event('mouse_up', cg.MC_NONE)
-add_event('key_down', cg.KC_NONE)
-add_event('key_up', cg.KC_NONE)
+add_event('focus_enter', cg.GE_FOCUS_ENTER)
+add_event('focus_exit', cg.GE_FOCUS_EXIT)
+add_event('changed', cg.GE_CHANGED)
+add_event('mouse_down', cg.GE_MOUSE_DOWN)
+add_event('mouse_up', cg.GE_MOUSE_UP)
+add_event('key_down', cg.GE_KEY_DOWN)
+add_event('key_up', cg.GE_KEY_UP)
+
+-- focus/changed events carry true, others carry the mouse/key code
+local bool_events = {
+    [cg.GE_FOCUS_ENTER] = true,
+    [cg.GE_FOCUS_EXIT] = true,
+    [cg.GE_CHANGED] = true,
+}
 
 function cs.gui_event.update_all()
     for ent in pairs(event_handlers) do
         if cs.entity.destroyed(ent) then event_handlers[ent] = nil end
     end
 
-    for ent, handlers in pairs(event_handlers) do
-        for event, f in pairs(handlers) do
-            local r = cs.gui['event_' .. event](ent)
-            if r ~= event_defaults[event] then
-                f(ent, r)
-            end
+    -- only look at events that were fired
+    for i = 0, cg.gui_event_get_num() - 1 do
+        local e = cg.gui_event_get_nth(i)
+        local handlers = event_handlers[e.ent]
+        local f = handlers and handlers[event_names[tonumber(e.type)]]
+        if f then
+            if bool_events[tonumber(e.type)] then f(e.ent, true)
+            else f(e.ent, e.value) end
         end
     end
 end
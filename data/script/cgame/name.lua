@@ -49,19 +49,26 @@ function cs.name.save_all()
     return entity_name
 end
 
+-- make up new name if clashes
 local counter = 0
+local function unique(rname)
+    local name = rname
+    while name_entity[name] ~= nil do
+        name, r = string.gsub(rname, '-%d+$', '-' .. counter)
+        if r == 0 then name = string.format('%s-%d', rname, counter) end
+        counter = counter + 1
+    end
+    return name
+end
+
 function cs.name.load_all(d)
     cg.entity_table_remove_destroyed(entity_name, cs.name.remove)
     for ent, rname in pairs(d) do
-        local name = rname
-
-        -- make up new name if clashes
-        while name_entity[name] ~= nil do
-            name, r = string.gsub(rname, '-%d+$', '-' .. counter)
-            if r == 0 then name = string.format('%s-%d', rname, counter) end
-            counter = counter + 1
-        end
-
-        cs.name.set_name(ent, name)
+        cs.name.set_name(ent, unique(rname))
     end
 end
+
+function cs.name.clone(from, to)
+    local name = entity_name[from]
+    if name then cs.name.set_name(to, unique(name)) end
+end
@@ -73,7 +73,7 @@ cg.Entity = ffi.metatype('Entity',
     __index =
     {
         __serialize = function (e)
-            return string.format('_cge(%u)', e.id)
+            return string.format('_cge(%u)', cg._entity_saved_id(e))
         end
     },
 })
@@ -1,3 +1,4 @@
+local ffi = require 'ffi'
 local serpent = require 'serpent'
 
 -- cg.systems (shortcut cs) is a special table such that cs.sys.func evaluates
@@ -59,7 +60,9 @@ function cg.__save_all()
         end
     end
 
-    return serpent.dump(data, { indent = '  ', nocode = true })
+    -- sorted so equal state gives equal strings
+    return serpent.dump(data, { indent = '  ', nocode = true,
+                                sortkeys = true })
 end
 
 function cg.__load_all(str)
@@ -90,6 +93,98 @@ function cg.__load_all(str)
     end
 end
 
+-- called from C to save what Lua systems keep for just ent, which must be the
+-- only entity with its save filter set, nil if nothing -- entries in
+-- auto_saveload systems, and for others whose save_all() gives an entity
+-- table, their entry in it -- loads with cg.__load_all(...)
+function cg.__save_ent(ent)
+    local data = {}
+
+    for name, system in pairs(cs) do
+        if type(system) == 'table' and rawget(system, 'auto_saveload') then
+            local rows = {}
+            for k, tbl in pairs(system) do
+                if cg.is_entity_table(tbl) and tbl[ent] ~= nil then
+                    rows[k] = tbl -- filtered to ent when dumped
+                end
+            end
+            if next(rows) ~= nil then data[name] = rows end
+        elseif type(system) == 'table' and rawget(system, 'save_all') then
+            local dump = system.save_all()
+            if cg.is_entity_table(dump) and dump[ent] ~= nil then
+                data[name] = dump
+            end
+        end
+    end
+
+    if next(data) == nil then return nil end
+    return serpent.dump(data, { indent = '  ', nocode = true,
+                                sortkeys = true })
+end
+
+-- called from C to take out what cg.__save_ent(ent) saves, so it can be
+-- loaded back in -- auto_saveload entries are dropped without calling any
+-- remove() or destroy(), as they are about to be replaced
+function cg.__remove_ent(ent)
+    for name, system in pairs(cs) do
+        if type(system) == 'table' and rawget(system, 'auto_saveload') then
+            for _, tbl in pairs(system) do
+                if cg.is_entity_table(tbl) then tbl[ent] = nil end
+            end
+        elseif type(system) == 'table' and rawget(system, 'save_all')
+        and rawget(system, 'remove') then
+            local dump = system.save_all()
+            if cg.is_entity_table(dump) and dump[ent] ~= nil then
+                system.remove(ent)
+            end
+        end
+    end
+end
+
+-- copy of a per-entity value for a clone, Entity references among those
+-- being cloned are pointed to their clones
+local function clone_value(v, seen)
+    if type(v) == 'cdata' then
+        if ffi.istype('Entity', v) then return cg._entity_resolve_clone(v) end
+        return ffi.new(ffi.typeof(v), v)
+    elseif type(v) ~= 'table' then
+        return v
+    end
+
+    if seen[v] then return seen[v] end
+    local r
+    if cg.is_entity_table(v) then
+        r = cg.entity_table()
+        seen[v] = r
+        for k, w in pairs(v) do
+            r[cg._entity_resolve_clone(k)] = clone_value(w, seen)
+        end
+    else
+        r = setmetatable({}, getmetatable(v))
+        seen[v] = r
+        for k, w in pairs(v) do r[k] = clone_value(w, seen) end
+    end
+    return r
+end
+
+-- called from C for each entity cloned, after C systems -- copies entries
+-- in auto_saveload systems, others can handle it with a clone(from, to)
+-- event
+function cg.__clone(from, to)
+    -- raw lookups only, so a system's __index can't get in the way
+    for name, system in pairs(cs) do
+        if type(system) == 'table' and rawget(system, 'auto_saveload') then
+            for _, tbl in pairs(system) do
+                if cg.is_entity_table(tbl) and tbl[from] ~= nil then
+                    tbl[to] = clone_value(tbl[from], {})
+                end
+            end
+        elseif type(system) == 'table' and rawget(system, 'clone') then
+            rawget(system, 'clone')(from, to)
+        end
+    end
+end
+
 
 -- generic add/remove, get/set for any system, property -- needs corresponding
 -- C functions of the form sys_add()/sys_remove(),
@@ -109,6 +204,7 @@ function cg.remove(sys, ...) cg.remover(sys)(unpack({...})) end
 --   ent = cg.add {
 --       ent = some_entity,           -- entity to modify, skip to create new
 --       prefab = 'path/to/prefab',   -- initial prefab, skip for none
+--       clone = other_entity,        -- or copy of entity, see prefab_clone()
 --       sys1 = {
 --           prop1 = val1,
 --           prop2 = val2,
@@ -126,9 +222,11 @@ function cg.add(sys, ent, props)
     if type(sys) == 'table' then
         ent = ent or sys.ent
             or (sys.prefab and cs.prefab.load(sys.prefab))
+            or (sys.clone and cs.prefab.clone(sys.clone))
             or cg.entity_create()
         sys.ent = nil
         sys.prefab = nil
+        sys.clone = nil
         for k, v in pairs(sys) do cg.add(k, ent, v) end
         return ent
     end
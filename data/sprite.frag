@@ -1,8 +1,8 @@
 #version 150
 
-in vec2 texcoord;
+in vec3 texcoord;
 
-uniform sampler2D tex0;
+uniform sampler2DArray tex0;
 
 out vec4 outColor;
 
@@ -6,11 +6,13 @@ in vec3 wmat3;
 in vec2 size;
 in vec2 texcell;
 in vec2 texsize;
+in float layer;
 
 out mat3 wmat;
 out vec2 size_;
 out vec2 texcell_;
 out vec2 texsize_;
+out float layer_;
 
 void main()
 {
@@ -18,5 +20,6 @@ void main()
     size_ = size;
     texcell_ = texcell;
     texsize_ = texsize;
+    layer_ = layer;
 }
 
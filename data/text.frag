@@ -2,9 +2,9 @@
 
 in vec2 texcoord;
 in float is_cursor;
+in vec4 base_color;
 
 uniform sampler2D tex0;
-uniform vec4 base_color;
 uniform float cursor_blink;
 
 out vec4 outColor;
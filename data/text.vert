@@ -1,15 +1,23 @@
 #version 150
 
+in vec3 wmat1; // columns 1, 2, 3 of transform matrix
+in vec3 wmat2;
+in vec3 wmat3;
+in vec4 color;
 in vec2 pos;
 in vec2 cell;
 in float is_cursor;
 
+out mat3 wmat;
+out vec4 color_;
 out vec2 pos_;
 out vec2 cell_;
 out float is_cursor_;
 
 void main()
 {
+    wmat = mat3(wmat1, wmat2, wmat3);
+    color_ = color;
     pos_ = pos;
     cell_ = cell;
     is_cursor_ = is_cursor;
@@ -0,0 +1,13 @@
+#version 150
+
+in vec2 position; // tile center in entity space
+in vec2 texcell;
+
+out vec2 position_;
+out vec2 texcell_;
+
+void main()
+{
+    position_ = position;
+    texcell_ = texcell;
+}
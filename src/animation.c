@@ -0,0 +1,564 @@
+#include "animation.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "entitypool.h"
+#include "array.h"
+#include "timing.h"
+#include "sprite.h"
+
+typedef struct Frame Frame;
+struct Frame
+{
+    Scalar t;
+    Vec2 texcell;
+    Vec2 texsize;
+    bool set_texcell;
+    bool set_texsize;
+};
+
+typedef struct Anim Anim;
+struct Anim
+{
+    char *name;
+    char *after; /* NULL to loop */
+
+    /* strip */
+    bool strip;
+    unsigned int n;
+    Scalar t;
+    Vec2 base;
+
+    /* manual frames */
+    Array *frames;
+};
+
+typedef struct Animation Animation;
+struct Animation
+{
+    EntityPoolElem pool_elem;
+
+    Array *anims;
+
+    int curr;       /* index of current Anim, -1 if none */
+    int frame;      /* current frame in current Anim, -1 to force update */
+    Scalar elapsed; /* time since current Anim started */
+};
+
+static EntityPool *pool;
+
+/* --- anims --------------------------------------------------------------- */
+
+static char *_strdup(const char *s)
+{
+    char *r;
+
+    if (!s)
+        return NULL;
+    r = malloc(strlen(s) + 1);
+    strcpy(r, s);
+    return r;
+}
+
+static void _anim_free(Anim *anim)
+{
+    free(anim->name);
+    free(anim->after);
+    array_free(anim->frames);
+}
+
+/* index of named Anim, -1 if not found */
+static int _find(Animation *animation, const char *name)
+{
+    Anim *anim;
+
+    if (!name)
+        return -1;
+    array_foreach(anim, animation->anims)
+        if (!strcmp(anim->name, name))
+            return anim - (Anim *) array_begin(animation->anims);
+    return -1;
+}
+
+static Anim *_get(Animation *animation, const char *name)
+{
+    int i = _find(animation, name);
+    error_assert(i >= 0, "must have an animation with name '%s'", name);
+    return array_get(animation->anims, i);
+}
+
+/* find named Anim, add empty if not found */
+static Anim *_get_or_add(Animation *animation, const char *name)
+{
+    Anim *anim;
+    int i;
+
+    i = _find(animation, name);
+    if (i >= 0)
+        return array_get(animation->anims, i);
+
+    anim = array_add(animation->anims);
+    anim->name = _strdup(name);
+    anim->after = NULL;
+    anim->strip = false;
+    anim->n = 0;
+    anim->t = 1;
+    anim->base = vec2_zero;
+    anim->frames = array_new(Frame);
+    return anim;
+}
+
+static Scalar _frame_time(Scalar t)
+{
+    return t > 0 ? t : 1;
+}
+
+static unsigned int _num_frames(Anim *anim)
+{
+    return anim->strip ? anim->n : array_length(anim->frames);
+}
+
+static Scalar _duration(Anim *anim)
+{
+    Frame *frame;
+    Scalar d = 0;
+
+    if (anim->strip)
+        return anim->n * _frame_time(anim->t);
+    array_foreach(frame, anim->frames)
+        d += _frame_time(frame->t);
+    return d;
+}
+
+/* frame index at time t since start, t must be less than duration */
+static int _frame_at(Anim *anim, Scalar t)
+{
+    Frame *frame;
+    int i;
+
+    if (anim->strip)
+    {
+        i = t / _frame_time(anim->t);
+        return i < (int) anim->n ? i : (int) anim->n - 1;
+    }
+
+    i = 0;
+    array_foreach(frame, anim->frames)
+    {
+        t -= _frame_time(frame->t);
+        if (t < 0)
+            return i;
+        ++i;
+    }
+    return i - 1;
+}
+
+/* write frame to sprite */
+static void _enter_frame(Animation *animation, Anim *anim, int i)
+{
+    Entity ent;
+    Vec2 texcell;
+    Frame *frame;
+
+    animation->frame = i;
+
+    ent = animation->pool_elem.ent;
+    if (!sprite_has(ent))
+        return;
+
+    if (anim->strip)
+    {
+        texcell = anim->base;
+        texcell.x += i * sprite_get_texsize(ent).x;
+        sprite_set_texcell(ent, texcell);
+    }
+    else
+    {
+        frame = array_get(anim->frames, i);
+        if (frame->set_texcell)
+            sprite_set_texcell(ent, frame->texcell);
+        if (frame->set_texsize)
+            sprite_set_texsize(ent, frame->texsize);
+    }
+}
+
+/* maximum number of 'after' transitions to follow in one update */
+#define MAX_TRANSITIONS 16
+
+static void _update(Animation *animation)
+{
+    Anim *anim;
+    Scalar d;
+    int next, i, transitions = 0;
+
+    if (animation->curr < 0)
+        return;
+    anim = array_get(animation->anims, animation->curr);
+    if (_num_frames(anim) == 0)
+        return;
+
+    animation->elapsed += timing_dt;
+
+    /* past the end? move to 'after' or loop */
+    while (animation->elapsed >= (d = _duration(anim)))
+    {
+        next = _find(animation, anim->after);
+        if (next < 0 || ++transitions > MAX_TRANSITIONS)
+        {
+            animation->elapsed -= d * scalar_floor(animation->elapsed / d);
+            break;
+        }
+
+        animation->elapsed -= d;
+        animation->curr = next;
+        animation->frame = -1;
+        anim = array_get(animation->anims, next);
+        if (_num_frames(anim) == 0)
+            return;
+    }
+
+    i = _frame_at(anim, animation->elapsed);
+    if (i != animation->frame)
+        _enter_frame(animation, anim, i);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void animation_add(Entity ent)
+{
+    Animation *animation;
+
+    if (entitypool_get(pool, ent))
+        return;
+
+    animation = entitypool_add(pool, ent);
+    animation->anims = array_new(Anim);
+    animation->curr = -1;
+    animation->frame = -1;
+    animation->elapsed = 0;
+}
+void animation_remove(Entity ent)
+{
+    Animation *animation;
+    Anim *anim;
+
+    animation = entitypool_get(pool, ent);
+    if (animation)
+    {
+        array_foreach(anim, animation->anims)
+            _anim_free(anim);
+        array_free(animation->anims);
+    }
+    entitypool_remove(pool, ent);
+}
+bool animation_has(Entity ent)
+{
+    return entitypool_get(pool, ent) != NULL;
+}
+
+void animation_set_strip(Entity ent, const char *name,
+                         unsigned int n, Scalar t, Vec2 base)
+{
+    Animation *animation;
+    Anim *anim;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    anim = _get_or_add(animation, name);
+    anim->strip = true;
+    anim->n = n;
+    anim->t = t;
+    anim->base = base;
+    array_clear(anim->frames);
+
+    animation->frame = -1; /* refresh sprite in case current changed */
+}
+
+void animation_add_frame(Entity ent, const char *name,
+                         Scalar t, const Vec2 *texcell, const Vec2 *texsize)
+{
+    Animation *animation;
+    Anim *anim;
+    Frame *frame;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    anim = _get_or_add(animation, name);
+    anim->strip = false;
+
+    frame = array_add(anim->frames);
+    frame->t = t;
+    frame->set_texcell = texcell != NULL;
+    frame->texcell = texcell ? *texcell : vec2_zero;
+    frame->set_texsize = texsize != NULL;
+    frame->texsize = texsize ? *texsize : vec2_zero;
+
+    animation->frame = -1;
+}
+
+void animation_set_after(Entity ent, const char *name, const char *after)
+{
+    Animation *animation;
+    Anim *anim;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    anim = _get(animation, name);
+    free(anim->after);
+    anim->after = _strdup(after);
+}
+const char *animation_get_after(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _get(animation, name)->after;
+}
+
+void animation_remove_anim(Entity ent, const char *name)
+{
+    Animation *animation;
+    int i;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    i = _find(animation, name);
+    if (i < 0)
+        return;
+
+    if (animation->curr == i)
+        animation->curr = -1;
+    _anim_free(array_get(animation->anims, i));
+
+    /* may swap last into i, keep curr pointing at right Anim */
+    if (array_quick_remove(animation->anims, i)
+        && animation->curr == (int) array_length(animation->anims))
+        animation->curr = i;
+}
+bool animation_has_anim(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _find(animation, name) >= 0;
+}
+
+unsigned int animation_get_num_anims(Entity ent)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return array_length(animation->anims);
+}
+const char *animation_get_nth_anim(Entity ent, unsigned int n)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    error_assert(n < array_length(animation->anims));
+    return array_get_val(Anim, animation->anims, n).name;
+}
+
+bool animation_get_is_strip(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _get(animation, name)->strip;
+}
+unsigned int animation_get_n(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _num_frames(_get(animation, name));
+}
+Scalar animation_get_t(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _get(animation, name)->t;
+}
+Vec2 animation_get_base(Entity ent, const char *name)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return _get(animation, name)->base;
+}
+
+void animation_start(Entity ent, const char *name)
+{
+    Animation *animation;
+    Anim *anim;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    anim = _get(animation, name);
+    animation->curr = anim - (Anim *) array_begin(animation->anims);
+    animation->elapsed = 0;
+    if (_num_frames(anim) > 0)
+        _enter_frame(animation, anim, 0);
+}
+void animation_switch(Entity ent, const char *name)
+{
+    Animation *animation;
+
+    animation = entitypool_get(pool, ent);
+    error_assert(animation);
+
+    if (animation->curr != _find(animation, name))
+        animation_start(ent, name);
+}
+const char *animation_get_curr_anim(Entity ent)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    if (animation->curr < 0)
+        return NULL;
+    return array_get_val(Anim, animation->anims, animation->curr).name;
+}
+unsigned int animation_get_frame(Entity ent)
+{
+    Animation *animation = entitypool_get(pool, ent);
+    error_assert(animation);
+    return animation->frame < 0 ? 0 : animation->frame;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void animation_init()
+{
+    pool = entitypool_new(Animation);
+}
+void animation_deinit()
+{
+    Animation *animation;
+    Anim *anim;
+
+    entitypool_foreach(animation, pool)
+    {
+        array_foreach(anim, animation->anims)
+            _anim_free(anim);
+        array_free(animation->anims);
+    }
+    entitypool_free(pool);
+}
+
+void animation_update_all()
+{
+    Animation *animation;
+
+    entitypool_remove_destroyed(pool, animation_remove);
+
+    entitypool_foreach(animation, pool)
+        _update(animation);
+}
+
+void animation_save_all(Store *s)
+{
+    Store *t, *animation_s, *anims_s, *anim_s, *frames_s, *frame_s;
+    Animation *animation;
+    Anim *anim;
+    Frame *frame;
+
+    if (store_child_save(&t, "animation", s))
+        entitypool_save_foreach(animation, animation_s, pool, "pool", t)
+        {
+            if (store_child_save(&anims_s, "anims", animation_s))
+                array_foreach(anim, animation->anims)
+                    if (store_child_save(&anim_s, NULL, anims_s))
+                    {
+                        string_save((const char **) &anim->name, "name",
+                                    anim_s);
+                        if (anim->after)
+                            string_save((const char **) &anim->after, "after",
+                                        anim_s);
+                        bool_save(&anim->strip, "strip", anim_s);
+                        uint_save(&anim->n, "n", anim_s);
+                        scalar_save(&anim->t, "t", anim_s);
+                        vec2_save(&anim->base, "base", anim_s);
+
+                        if (store_child_save(&frames_s, "frames", anim_s))
+                            array_foreach(frame, anim->frames)
+                                if (store_child_save(&frame_s, NULL, frames_s))
+                                {
+                                    scalar_save(&frame->t, "t", frame_s);
+                                    bool_save(&frame->set_texcell,
+                                              "set_texcell", frame_s);
+                                    vec2_save(&frame->texcell, "texcell",
+                                              frame_s);
+                                    bool_save(&frame->set_texsize,
+                                              "set_texsize", frame_s);
+                                    vec2_save(&frame->texsize, "texsize",
+                                              frame_s);
+                                }
+                    }
+
+            int_save(&animation->curr, "curr", animation_s);
+            int_save(&animation->frame, "frame", animation_s);
+            scalar_save(&animation->elapsed, "elapsed", animation_s);
+        }
+}
+void animation_load_all(Store *s)
+{
+    Store *t, *animation_s, *anims_s, *anim_s, *frames_s, *frame_s;
+    Animation *animation;
+    Anim *anim;
+    Frame *frame;
+
+    if (store_child_load(&t, "animation", s))
+        entitypool_load_foreach(animation, animation_s, pool, "pool", t)
+        {
+            animation->anims = array_new(Anim);
+            if (store_child_load(&anims_s, "anims", animation_s))
+                while (store_child_load(&anim_s, NULL, anims_s))
+                {
+                    anim = array_add(animation->anims);
+                    string_load(&anim->name, "name", "", anim_s);
+                    string_load(&anim->after, "after", NULL, anim_s);
+                    bool_load(&anim->strip, "strip", true, anim_s);
+                    uint_load(&anim->n, "n", 0, anim_s);
+                    scalar_load(&anim->t, "t", 1, anim_s);
+                    vec2_load(&anim->base, "base", vec2_zero, anim_s);
+
+                    anim->frames = array_new(Frame);
+                    if (store_child_load(&frames_s, "frames", anim_s))
+                        while (store_child_load(&frame_s, NULL, frames_s))
+                        {
+                            frame = array_add(anim->frames);
+                            scalar_load(&frame->t, "t", 1, frame_s);
+                            bool_load(&frame->set_texcell, "set_texcell",
+                                      false, frame_s);
+                            vec2_load(&frame->texcell, "texcell", vec2_zero,
+                                      frame_s);
+                            bool_load(&frame->set_texsize, "set_texsize",
+                                      false, frame_s);
+                            vec2_load(&frame->texsize, "texsize", vec2_zero,
+                                      frame_s);
+                        }
+                }
+
+            int_load(&animation->curr, "curr", -1, animation_s);
+            int_load(&animation->frame, "frame", -1, animation_s);
+            scalar_load(&animation->elapsed, "elapsed", 0, animation_s);
+        }
+}
+
+void animation_clone(Entity from, Entity to)
+{
+    Animation *animation;
+    Anim *anim;
+
+    animation = entitypool_clone(pool, from, to);
+    if (!animation)
+        return;
+
+    animation->anims = array_copy(animation->anims);
+    array_foreach(anim, animation->anims)
+    {
+        anim->name = _strdup(anim->name);
+        anim->after = _strdup(anim->after);
+        anim->frames = array_copy(anim->frames);
+    }
+}
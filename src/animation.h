@@ -0,0 +1,75 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "saveload.h"
+#include "entity.h"
+#include "vec2.h"
+#include "script_export.h"
+
+/*
+ * sprite animations -- each entity has a set of named animations, each
+ * either a strip of equally-timed frames laid out left to right in the
+ * atlas, or a list of manually specified frames
+ *
+ * the current frame is computed from time elapsed since the animation
+ * started, and the sprite's texcell (and texsize for manual frames) is only
+ * written when the frame changes
+ */
+
+SCRIPT(animation,
+
+       EXPORT void animation_add(Entity ent);
+       EXPORT void animation_remove(Entity ent);
+       EXPORT bool animation_has(Entity ent);
+
+       /*
+        * add or replace strip animation 'anim' -- n frames starting at
+        * texcell 'base', moving right by sprite texsize each frame, each
+        * frame lasting t seconds
+        */
+       EXPORT void animation_set_strip(Entity ent, const char *anim,
+                                       unsigned int n, Scalar t, Vec2 base);
+
+       /*
+        * add a manual frame to the end of 'anim', creating it if needed --
+        * texcell, texsize may be NULL to leave sprite's value unchanged
+        */
+       EXPORT void animation_add_frame(Entity ent, const char *anim,
+                                       Scalar t, const Vec2 *texcell,
+                                       const Vec2 *texsize);
+
+       /* animation to switch to after 'anim' ends, NULL to loop */
+       EXPORT void animation_set_after(Entity ent, const char *anim,
+                                       const char *after);
+       EXPORT const char *animation_get_after(Entity ent, const char *anim);
+
+       EXPORT void animation_remove_anim(Entity ent, const char *anim);
+       EXPORT bool animation_has_anim(Entity ent, const char *anim);
+
+       /* for iterating over animations */
+       EXPORT unsigned int animation_get_num_anims(Entity ent);
+       EXPORT const char *animation_get_nth_anim(Entity ent, unsigned int n);
+
+       EXPORT bool animation_get_is_strip(Entity ent, const char *anim);
+       EXPORT unsigned int animation_get_n(Entity ent, const char *anim);
+       EXPORT Scalar animation_get_t(Entity ent, const char *anim);
+       EXPORT Vec2 animation_get_base(Entity ent, const char *anim);
+
+       /* start 'anim' from its first frame */
+       EXPORT void animation_start(Entity ent, const char *anim);
+       /* start 'anim' only if not already current */
+       EXPORT void animation_switch(Entity ent, const char *anim);
+       EXPORT const char *animation_get_curr_anim(Entity ent); /* NULL if
+                                                                  none */
+       EXPORT unsigned int animation_get_frame(Entity ent); /* 0-indexed */
+
+    )
+
+void animation_init();
+void animation_deinit();
+void animation_update_all();
+void animation_save_all(Store *s);
+void animation_load_all(Store *s);
+void animation_clone(Entity from, Entity to);
+
+#endif
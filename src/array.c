@@ -31,6 +31,17 @@ void array_free(Array *arr)
     free(arr);
 }
 
+Array *array_copy(Array *arr)
+{
+    Array *copy;
+
+    copy = array_new_(arr->object_size);
+    array_reset(copy, arr->length);
+    memcpy(copy->buf, arr->buf, arr->object_size * arr->length);
+
+    return copy;
+}
+
 void *array_get(Array *arr, unsigned int i)
 {
     return arr->buf + arr->object_size * i;
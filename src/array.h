@@ -15,6 +15,7 @@ typedef struct Array Array;
 Array *array_new_(size_t object_size); /* object_size is size per element */
 #define array_new(type) array_new_(sizeof(type))
 void array_free(Array *arr);
+Array *array_copy(Array *arr); /* new Array with same objects, shallow */
 
 void *array_get(Array *arr, unsigned int i);
 #define array_get_val(type, arr, i) (*((type *) array_get(arr, i)))
@@ -200,3 +200,8 @@ void camera_load_all(Store *s)
     }
 }
 
+
+void camera_clone(Entity from, Entity to)
+{
+    entitypool_clone(pool, from, to); /* clone is never current */
+}
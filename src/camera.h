@@ -48,6 +48,7 @@ void camera_deinit();
 void camera_update_all();
 void camera_save_all(Store *s);
 void camera_load_all(Store *s);
+void camera_clone(Entity from, Entity to);
 
 #endif
 
@@ -16,14 +16,20 @@
 #include "color.h"
 #include "fs.h"
 #include "system.h"
+#include "watch.h"
+#include "gfx.h"
+#include "texture.h"
 #include "input.h"
 #include "entity.h"
 #include "prefab.h"
+#include "undo.h"
 #include "timing.h"
 #include "transform.h"
 #include "camera.h"
 #include "gui.h"
 #include "sprite.h"
+#include "animation.h"
+#include "tilemap.h"
 #include "console.h"
 #include "sound.h"
 #include "physics.h"
@@ -50,13 +56,19 @@ static const char **cgame_ffi[] =
     &cgame_ffi_fs,
     &cgame_ffi_game,
     &cgame_ffi_system,
+    &cgame_ffi_watch,
+    &cgame_ffi_gfx,
+    &cgame_ffi_texture,
     &cgame_ffi_input,
     &cgame_ffi_entity,
     &cgame_ffi_prefab,
+    &cgame_ffi_undo,
     &cgame_ffi_timing,
     &cgame_ffi_transform,
     &cgame_ffi_camera,
     &cgame_ffi_sprite,
+    &cgame_ffi_animation,
+    &cgame_ffi_tilemap,
     &cgame_ffi_gui,
     &cgame_ffi_console,
     &cgame_ffi_sound,
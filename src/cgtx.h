@@ -0,0 +1,42 @@
+#ifndef CGTX_H
+#define CGTX_H
+
+#include <stdint.h>
+
+/*
+ * .cgtx -- raw texture cache written by the cgame_atlas tool, loaded by
+ * texture_load(...) without decoding
+ *
+ * a CgtxHeader, then 'nlevels' mipmap levels of RGBA8 pixels, largest
+ * first, each bottom row first as GL expects and with no padding -- level
+ * i is max(1, width >> i) by max(1, height >> i)
+ *
+ * all fields are little-endian
+ */
+
+#define CGTX_MAGIC "CGTX"
+#define CGTX_VERSION 1
+
+/* larger files are rejected as corrupt */
+#define CGTX_MAX_DIM 16384
+#define CGTX_MAX_LEVELS 32
+
+typedef struct CgtxHeader CgtxHeader;
+struct CgtxHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t nlevels;
+};
+
+/* width or height of level i given that of level 0 */
+#define cgtx_level_dim(d, i) ((d) >> (i) ? (d) >> (i) : 1)
+
+/* bytes in level i */
+#define cgtx_level_size(w, h, i)                                        \
+    (4 * (size_t) cgtx_level_dim(w, i) * (size_t) cgtx_level_dim(h, i))
+
+#endif
+
@@ -18,10 +18,19 @@
 /* circular buffer of lines, 'top' is current top line */
 static char lines[NUM_LINES][LINE_LEN] = { { 0 } };
 static int top = 0;
+static unsigned int curs = 0; /* cursor position in top line */
 
 /* text that displays console contents */
 static Entity text;
 
+/*
+ * text is kept in sync incrementally -- characters written are appended,
+ * and when a line is reused its old contents are removed from the front
+ */
+static char pending[LINE_LEN]; /* written but not yet appended */
+static unsigned int npending = 0;
+
+/* rebuild text entirely from lines */
 static void _update_text()
 {
     unsigned int i;
@@ -44,6 +53,39 @@ static void _update_text()
     free(buf);
 }
 
+/* append pending characters to text */
+static void _flush()
+{
+    if (npending == 0)
+        return;
+    pending[npending] = '\0';
+    npending = 0;
+    if (!entity_eq(text, entity_nil))
+        gui_text_append(text, pending);
+}
+
+/* write a character at cursor */
+static void _put(char c)
+{
+    lines[top][curs++] = c;
+    pending[npending++] = c;
+}
+
+/* move to next line, dropping the oldest line */
+static void _next_line()
+{
+    lines[top][curs] = '\0';
+    _flush();
+
+    top = (top + 1) % NUM_LINES;
+    curs = 0;
+
+    /* oldest line is at the front of text */
+    if (!entity_eq(text, entity_nil) && lines[top][0])
+        gui_text_replace(text, 0, strlen(lines[top]), "");
+    lines[top][0] = '\0';
+}
+
 void console_set_entity(Entity ent)
 {
     text = ent;
@@ -70,7 +112,6 @@ bool console_get_visible()
 /* write a string to console with wrapping */
 static void _write(const char *s)
 {
-    static unsigned int curs = 0; /* cursor position */
     static const char wrap_prefix[] = { 26, ' ', '\0' };
     unsigned int width, tabstop;
     char c;
@@ -93,27 +134,23 @@ static void _write(const char *s)
             if (tabstop >= width)
             {
                 /* wrap at tab? */
-                curs = width;
+                while (curs < width)
+                    _put(c);
                 ++s;
             }
             else
-                for (; curs < tabstop - 1 && curs < width; ++curs)
-                    lines[top][curs] = c;
+                while (curs < tabstop - 1 && curs < width)
+                    _put(c);
         }
 
         /* write char */
         wrap = curs >= width && c != '\n';
         c = wrap ? '\n' : c;
-        lines[top][curs++] = c;
+        _put(c);
 
         /* if newline, close this line and go to next */
         if (c == '\n')
-        {
-            lines[top][curs] = '\0';
-
-            top = (top + 1) % NUM_LINES;
-            curs = 0;
-        }
+            _next_line();
 
         /* add a prefix to wrapped lines */
         if (wrap)
@@ -124,8 +161,7 @@ static void _write(const char *s)
 
     /* close this line */
     lines[top][curs] = '\0';
-
-    _update_text();
+    _flush();
 }
 
 /* write a string to both stdout and the console */
@@ -11,7 +11,6 @@
 #include "camera.h"
 #include "dirs.h"
 #include "input.h"
-#include "game.h"
 #include "array.h"
 
 static bool enabled;
@@ -113,6 +112,7 @@ void edit_bboxes_set_selected(Entity ent, bool selected)
 static GLuint bboxes_program;
 static GLuint bboxes_vao;
 static GLuint bboxes_vbo;
+static GLint bboxes_is_grid_loc;
 
 static void _bboxes_init()
 {
@@ -123,6 +123,7 @@ static void _bboxes_init()
                                         data_path("bbox.geom"),
                                         data_path("bbox.frag"));
     glUseProgram(bboxes_program);
+    bboxes_is_grid_loc = glGetUniformLocation(bboxes_program, "is_grid");
 
     /* make vao, vbo, bind attributes */
     glGenVertexArrays(1, &bboxes_vao);
@@ -177,30 +178,6 @@ static void _bboxes_update_all()
     }
 }
 
-/* needs bbox shader program to be bound */
-static void _bboxes_draw_all()
-{
-    Vec2 win;
-    unsigned int nbboxes;
-
-    glUseProgram(bboxes_program);
-    glUniformMatrix3fv(glGetUniformLocation(bboxes_program,
-                                            "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
-    win = game_get_window_size();
-    glUniform1f(glGetUniformLocation(bboxes_program, "aspect"),
-                win.x / win.y);
-    glUniform1f(glGetUniformLocation(bboxes_program, "is_grid"), 0);
-
-    glBindVertexArray(bboxes_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, bboxes_vbo);
-    nbboxes = entitypool_size(bbox_pool);
-    glBufferData(GL_ARRAY_BUFFER, nbboxes * sizeof(BBoxPoolElem),
-                 entitypool_begin(bbox_pool), GL_STREAM_DRAW);
-    glDrawArrays(GL_POINTS, 0, nbboxes);
-}
-
 /* --- grid ---------------------------------------------------------------- */
 
 static Vec2 grid_size = { 1.0, 1.0 };
@@ -282,31 +259,33 @@ static void _grid_deinit()
     array_free(grid_cells);
 }
 
-static void _grid_draw()
+/* grid cells go after bboxes in buffer -- call _grid_create_cells() first */
+static void _bboxes_draw_all()
 {
-    Vec2 win;
-    unsigned int ncells;
+    unsigned int nbboxes, ncells;
+    GfxDraw *draw;
 
-    glUseProgram(bboxes_program);
-    glUniformMatrix3fv(glGetUniformLocation(bboxes_program,
-                                            "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
-    win = game_get_window_size();
-    glUniform1f(glGetUniformLocation(bboxes_program, "aspect"),
-                win.x / win.y);
-    glUniform1f(glGetUniformLocation(bboxes_program, "is_grid"), 1);
-
-    _grid_create_cells();
-    glBindVertexArray(bboxes_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, bboxes_vbo);
+    /* upload */
+    nbboxes = entitypool_size(bbox_pool);
     ncells = array_length(grid_cells);
-    glBufferData(GL_ARRAY_BUFFER, ncells * sizeof(BBoxPoolElem),
-                 array_begin(grid_cells), GL_STREAM_DRAW);
-    glDrawArrays(GL_POINTS, 0, ncells);
+    gfx_buffer_data(bboxes_vbo, (nbboxes + ncells) * sizeof(BBoxPoolElem),
+                    NULL, GL_STREAM_DRAW);
+    gfx_buffer_sub_data(bboxes_vbo, 0, nbboxes * sizeof(BBoxPoolElem),
+                        entitypool_begin(bbox_pool));
+    gfx_buffer_sub_data(bboxes_vbo, nbboxes * sizeof(BBoxPoolElem),
+                        ncells * sizeof(BBoxPoolElem), array_begin(grid_cells));
     array_clear(grid_cells);
+
+    /* bboxes, then grid */
+    draw = gfx_draw(GFX_LAYER_EDIT, 0, bboxes_program, bboxes_vao,
+                    GL_POINTS, 0, nbboxes);
+    gfx_draw_uniform_float(draw, bboxes_is_grid_loc, 0);
+    draw = gfx_draw(GFX_LAYER_EDIT, 1, bboxes_program, bboxes_vao,
+                    GL_POINTS, nbboxes, ncells);
+    gfx_draw_uniform_float(draw, bboxes_is_grid_loc, 1);
 }
 
+
 /* --- line ---------------------------------------------------------------- */
 
 static GLuint line_program;
@@ -372,21 +351,14 @@ static void _line_draw_all()
 {
     unsigned int npoints;
 
-    /* bind program, update uniforms */
-    glUseProgram(line_program);
-    glUniformMatrix3fv(glGetUniformLocation(line_program,
-                                            "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
+    /* upload */
+    npoints = array_length(line_points);
+    gfx_buffer_data(line_vbo, npoints * sizeof(LinePoint),
+                    array_begin(line_points), GL_STREAM_DRAW);
 
     /* draw! */
-    glBindVertexArray(line_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, line_vao);
-    npoints = array_length(line_points);
-    glBufferData(GL_ARRAY_BUFFER, npoints * sizeof(LinePoint),
-                 array_begin(line_points), GL_STREAM_DRAW);
-    glDrawArrays(GL_LINES, 0, npoints);
-    glDrawArrays(GL_POINTS, 0, npoints);
+    gfx_draw(GFX_LAYER_EDIT, 2, line_program, line_vao, GL_LINES, 0, npoints);
+    gfx_draw(GFX_LAYER_EDIT, 2, line_program, line_vao, GL_POINTS, 0, npoints);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -431,8 +403,8 @@ void edit_draw_all()
     if (!enabled)
         return;
 
+    _grid_create_cells();
     _bboxes_draw_all();
-    _grid_draw();
     _line_draw_all();
 }
 
@@ -460,3 +432,8 @@ void edit_load_all(Store *s)
                                 "uneditable_pool", t);
     }
 }
+
+void edit_clone(Entity from, Entity to)
+{
+    entitypool_clone(uneditable_pool, from, to);
+}
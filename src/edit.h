@@ -45,5 +45,6 @@ void edit_update_all();
 void edit_draw_all();
 void edit_save_all(Store *s);
 void edit_load_all(Store *s);
+void edit_clone(Entity from, Entity to);
 
 #endif
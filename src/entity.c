@@ -33,6 +33,12 @@ static EntityMap *unused_map; /* whether has entry in unused array */
 static Array *unused; /* id put here after _remove(), can reuse */
 
 static EntityMap *load_map; /* map of saved ids --> real ids */
+static EntityMap *clone_map; /* map of cloned ids --> clone ids */
+
+static EntityMap *stable_map; /* map of real ids --> stable ids, 0 if none */
+static EntityMap *stable_ents; /* map of stable ids --> real ids */
+static unsigned int stable_counter = 1;
+static bool stable_ids = false; /* whether saving/loading stable ids */
 
 typedef enum SaveFilter SaveFilter;
 enum SaveFilter
@@ -98,6 +104,18 @@ Entity entity_create()
     return ent;
 }
 
+/* give ent stable id, 0 to take it away */
+static void _stable_set(Entity ent, unsigned int id)
+{
+    Entity old = { entitymap_get(stable_map, ent) }; /* keyed by stable id */
+
+    if (old.id != 0)
+        entitymap_set(stable_ents, old, entity_nil.id);
+    entitymap_set(stable_map, ent, id);
+    if (id != 0)
+        entitymap_set(stable_ents, (Entity) { id }, ent.id);
+}
+
 /* actually remove an entity entirely */
 static void _remove(Entity ent)
 {
@@ -118,6 +136,9 @@ void entity_destroy(Entity ent)
 
     entitypool_remove(exists_pool, ent);
 
+    /* a reload may give its stable id to another entity */
+    _stable_set(ent, 0);
+
     /* mark it as destroyed but don't 'remove' it yet */
     entitymap_set(destroyed_map, ent, true);
     array_add_val(DestroyEntry, destroyed) = (DestroyEntry) { { ent.id }, 0 };
@@ -168,9 +189,13 @@ void entity_init()
     unused_map = entitymap_new(false);
     unused = array_new(Entity);
     save_filter_map = entitymap_new(SF_UNSET);
+    stable_map = entitymap_new(0);
+    stable_ents = entitymap_new(entity_nil.id);
 }
 void entity_deinit()
 {
+    entitymap_free(stable_ents);
+    entitymap_free(stable_map);
     entitymap_free(save_filter_map);
     array_free(unused);
     entitymap_free(unused_map);
@@ -204,12 +229,20 @@ void entity_update_all()
 void entity_save(Entity *ent, const char *n, Store *s)
 {
     Store *t;
+    unsigned int id;
 
     if (!entity_eq(*ent, entity_nil) && !entity_get_save_filter(*ent))
         error("filtered-out entity referenced in save!");
 
+    id = _entity_saved_id(*ent);
     if (store_child_save(&t, n, s))
-        uint_save(&ent->id, "id", t);
+        uint_save(&id, "id", t);
+}
+unsigned int _entity_saved_id(Entity ent)
+{
+    if (!stable_ids || entity_eq(ent, entity_nil))
+        return ent.id;
+    return entity_get_stable_id(ent);
 }
 Entity _entity_resolve_saved_id(unsigned int id)
 {
@@ -221,7 +254,21 @@ Entity _entity_resolve_saved_id(unsigned int id)
     ent.id = entitymap_get(load_map, sav);
     if (entity_eq(ent, entity_nil))
     {
-        ent = _generate_id();
+        /* existing entity with that stable id is loaded into */
+        if (stable_ids)
+            ent = entity_find_stable_id(id);
+        if (entity_eq(ent, entity_nil))
+        {
+            ent = _generate_id();
+
+            /* new entity keeps the stable id it was saved with */
+            if (stable_ids)
+            {
+                _stable_set(ent, id);
+                if (id >= stable_counter)
+                    stable_counter = id + 1;
+            }
+        }
         entitymap_set(load_map, sav, ent.id);
     }
     return ent;
@@ -252,6 +299,71 @@ void entity_load_all_end()
     entity_clear_save_filters();
 }
 
+EntityMap *entity_load_all_suspend()
+{
+    EntityMap *map = load_map;
+    load_map = NULL;
+    return map;
+}
+void entity_load_all_resume(EntityMap *map)
+{
+    load_map = map;
+}
+
+void entity_clone_begin()
+{
+    clone_map = entitymap_new(entity_nil.id);
+}
+Entity entity_clone_add(Entity ent)
+{
+    Entity clone;
+
+    clone = _generate_id();
+    entitymap_set(clone_map, ent, clone.id);
+    return clone;
+}
+Entity _entity_resolve_clone(Entity ent)
+{
+    Entity clone;
+
+    clone.id = entitymap_get(clone_map, ent);
+    if (entity_eq(clone, entity_nil))
+        return ent; /* not being cloned, refer to same entity */
+    return clone;
+}
+void entity_clone_end()
+{
+    entitymap_free(clone_map);
+    clone_map = NULL;
+}
+
+void entity_stable_ids_begin()
+{
+    stable_ids = true;
+}
+void entity_stable_ids_end()
+{
+    stable_ids = false;
+}
+unsigned int entity_get_stable_id(Entity ent)
+{
+    unsigned int id;
+
+    /* give it one on first use */
+    id = entitymap_get(stable_map, ent);
+    if (id == 0)
+    {
+        id = stable_counter++;
+        _stable_set(ent, id);
+    }
+    return id;
+}
+Entity entity_find_stable_id(unsigned int id)
+{
+    Entity ent = { entitymap_get(stable_ents, (Entity) { id }) };
+    return ent;
+}
+
 #undef entity_eq
 bool entity_eq(Entity e, Entity f)
 {
@@ -37,6 +37,15 @@ SCRIPT(entity,
        /* get resolved id for merging -- meant for internal use */
        EXPORT Entity _entity_resolve_saved_id(unsigned int id);
 
+       /* id to save ent under -- meant for internal use */
+       EXPORT unsigned int _entity_saved_id(Entity ent);
+
+       /*
+        * clone of ent during a clone, ent itself if it isn't being cloned
+        * -- meant for internal use
+        */
+       EXPORT Entity _entity_resolve_clone(Entity ent);
+
     )
 
 void entity_init();
@@ -48,6 +57,33 @@ void entity_load_all(Store *s);
 void entity_load_all_begin();
 void entity_load_all_end();
 
+/*
+ * for loads spread over frames -- suspend takes the saved id map so other
+ * loads can happen in between, resume puts it back
+ */
+struct EntityMap *entity_load_all_suspend();
+void entity_load_all_resume(struct EntityMap *map);
+
+/*
+ * for cloning entities (see prefab_clone(...)) -- between begin and end,
+ * entity_clone_add(...) claims an id for the clone of an entity, which
+ * _entity_resolve_clone(...) then maps it to
+ */
+void entity_clone_begin();
+Entity entity_clone_add(Entity ent);
+void entity_clone_end();
+
+/*
+ * for saves compared with each other across reloads (see undo.c) -- between
+ * begin and end, entities are saved under ids that stay the same for as long
+ * as they exist, saved ids of existing entities load into those entities,
+ * and entities created by a load get the ids they were saved under
+ */
+void entity_stable_ids_begin();
+void entity_stable_ids_end();
+unsigned int entity_get_stable_id(Entity ent); /* gives one if none yet */
+Entity entity_find_stable_id(unsigned int id); /* entity_nil if none */
+
 /* C inline stuff */
 
 #define entity_eq(e, f) ((e).id == (f).id)
@@ -1,6 +1,7 @@
 #include "entitypool.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "entitymap.h"
 #include "array.h"
@@ -11,6 +12,7 @@ struct EntityPool
     /* just a map of indices into an array, -1 if doesn't exist */
     EntityMap *emap;
     Array *array;
+    size_t object_size;
 };
 
 EntityPool *entitypool_new_(size_t object_size)
@@ -19,6 +21,7 @@ EntityPool *entitypool_new_(size_t object_size)
 
     pool->emap = entitymap_new(-1);
     pool->array = array_new_(object_size);
+    pool->object_size = object_size;
 
     return pool;
 }
@@ -61,6 +64,21 @@ void entitypool_remove(EntityPool *pool, Entity ent)
         entitymap_set(pool->emap, ent, -1);
     }
 }
+void *entitypool_clone(EntityPool *pool, Entity from, Entity to)
+{
+    int i;
+    EntityPoolElem *elem;
+
+    error_assert(!entity_eq(from, to));
+    if ((i = entitymap_get(pool->emap, from)) < 0)
+        return NULL;
+
+    /* add may move 'from', so only get it after */
+    elem = entitypool_add(pool, to);
+    memcpy(elem, array_get(pool->array, i), pool->object_size);
+    elem->ent = to;
+    return elem;
+}
 void *entitypool_get(EntityPool *pool, Entity ent)
 {
     int i;
@@ -41,6 +41,13 @@ void *entitypool_add(EntityPool *pool, Entity ent);
 void entitypool_remove(EntityPool *pool, Entity ent);
 void *entitypool_get(EntityPool *pool, Entity ent); /* NULL if not mapped */
 
+/*
+ * add element for 'to' as a bytewise copy of the one for 'from', NULL if
+ * 'from' has none -- pointers in the copy still point to 'from''s data, so
+ * the caller must fix those up
+ */
+void *entitypool_clone(EntityPool *pool, Entity from, Entity to);
+
 /* since elements are contiguoous, can iterate with pointers:
  *
  *     for (ptr = entitypool_begin(pool), end = entitypool_end(pool);
@@ -9,6 +9,7 @@
 #include "glew_glfw.h"
 #include "system.h"
 #include "console.h"
+#include "gfx.h"
 
 #ifdef CGAME_DEBUG_WINDOW
 #include "debugwin.h"
@@ -58,7 +59,6 @@ static void _game_init()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDisable(GL_DEPTH_TEST);
-    glClearColor(0.95f, 0.95f, 0.95f, 1.f);
 
     /* random seed */
     srand(time(NULL));
@@ -73,6 +73,9 @@ static void _game_init()
 
 static void _game_deinit()
 {
+    /* stop render thread, systems' deinit needs GL context here */
+    gfx_set_max_frames_in_flight(0);
+
     /* deinit systems */
     system_deinit();
 
@@ -104,9 +107,7 @@ static void _game_draw()
         return;
     }
 
-    glClear(GL_COLOR_BUFFER_BIT);
-    system_draw_all();
-    glfwSwapBuffers(game_window);
+    system_draw_all(); /* clears and presents through gfx_flush() */
 }
 
 /* ------------------------------------------------------------------------- */
@@ -130,7 +131,7 @@ void game_run(int argc, char **argv)
 
 void game_set_bg_color(Color c)
 {
-    glClearColor(c.r, c.g, c.b, 1.0);
+    gfx_set_clear_color(color(c.r, c.g, c.b, 1.0));
 }
 
 void game_set_window_size(Vec2 s)
@@ -2,17 +2,63 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 
+#include "glew_glfw.h"
 #include "console.h"
+#include "camera.h"
+#include "game.h"
+#include "array.h"
+#include "thread.h"
+#include "watch.h"
+#include "dirs.h"
+#include "error.h"
 
-static GLint _compile_shader(GLuint shader, const char *filename)
+/* std140 layout of Frame block -- mat3 columns are padded to vec4 */
+typedef struct FrameUniforms FrameUniforms;
+struct FrameUniforms
 {
-    char *file_contents, log[512];
+    GLfloat inverse_view_matrix[3][4];
+    GLfloat window_size[2];
+    GLfloat aspect;
+    GLfloat pad_;
+};
+
+#define FRAME_BINDING 0
+
+static GLuint frame_ubo;
+static FrameUniforms frame_uniforms; /* last uploaded */
+
+/* --- programs ------------------------------------------------------------ */
+
+/* source paths of each program made, to rebuild it when they change */
+typedef struct ProgramSource ProgramSource;
+struct ProgramSource
+{
+    GLuint program;
+    char *paths[3]; /* vertex, geometry, fragment, NULL if none */
+};
+
+static Array *programs; /* ProgramSource */
+
+static const GLenum shader_types[3] =
+{
+    GL_VERTEX_SHADER,
+    GL_GEOMETRY_SHADER,
+    GL_FRAGMENT_SHADER,
+};
+
+/* read whole file into new string, NULL if couldn't */
+static char *_read_file(const char *filename)
+{
+    char *file_contents;
     long input_file_size;
     FILE *input_file;
-    GLint status;
 
     input_file = fopen(filename, "rb");
+    if (!input_file)
+        return NULL;
     fseek(input_file, 0, SEEK_END);
     input_file_size = ftell(input_file);
     rewind(input_file);
@@ -20,14 +66,20 @@ static GLint _compile_shader(GLuint shader, const char *filename)
     fread(file_contents, sizeof(char), input_file_size, input_file);
     fclose(input_file);
     file_contents[input_file_size] = '\0';
+    return file_contents;
+}
+
+static GLint _compile_shader(GLuint shader, const char *filename,
+                             const char *source)
+{
+    char log[512];
+    GLint status;
 
     console_printf("gfx: compiling shader '%s' ...", filename);
 
-    glShaderSource(shader, 1, (const GLchar **) &file_contents, NULL);
+    glShaderSource(shader, 1, (const GLchar **) &source, NULL);
     glCompileShader(shader);
 
-    free(file_contents);
-
     /* log */
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     console_printf(status ? " successful\n" : " unsuccessful\n");
@@ -37,36 +89,884 @@ static GLint _compile_shader(GLuint shader, const char *filename)
     return status;
 }
 
+/*
+ * binary cache -- linked programs are saved with glGetProgramBinary(...)
+ * under usr/, named by a hash of their sources and of the GL driver's
+ * vendor, renderer and version strings, so editing a shader or changing
+ * driver just misses the cache and compiles from source again
+ */
+
+#define PROGRAM_CACHE_MAGIC "CGPB"
+
+typedef struct ProgramCacheHeader ProgramCacheHeader;
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint64_t key;
+    GLenum format;
+    GLint length;
+};
+
+static uint64_t _hash_str(uint64_t h, const char *s)
+{
+    for (; *s; ++s)
+        h = (h ^ (unsigned char) *s) * 1099511628211ull; /* FNV-1a */
+    return (h ^ 0xff) * 1099511628211ull; /* separator */
+}
+
+static uint64_t _program_key(char *const *sources)
+{
+    uint64_t h = 14695981039346656037ull;
+    unsigned int i;
+
+    h = _hash_str(h, (const char *) glGetString(GL_VENDOR));
+    h = _hash_str(h, (const char *) glGetString(GL_RENDERER));
+    h = _hash_str(h, (const char *) glGetString(GL_VERSION));
+    for (i = 0; i < 3; ++i)
+        h = _hash_str(h, sources[i] ? sources[i] : "");
+    return h;
+}
+
+static void _program_cache_path(char *path, uint64_t key)
+{
+    sprintf(path, usr_path("program-%08lx%08lx.bin"),
+            (unsigned long) (key >> 32), (unsigned long) (key & 0xffffffff));
+}
+
+static bool _program_cache_available()
+{
+    GLint nformats = 0;
+
+    if (!GLEW_ARB_get_program_binary)
+        return false;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+    return nformats > 0;
+}
+
+/* link program from cached binary if there is one for key */
+static bool _program_cache_load(GLuint program, uint64_t key)
+{
+    char path[256];
+    ProgramCacheHeader header;
+    void *binary;
+    FILE *file;
+    GLint status;
+
+    _program_cache_path(path, key);
+    if (!(file = fopen(path, "rb")))
+        return false;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4)
+        || header.key != key || header.length <= 0)
+    {
+        fclose(file);
+        return false;
+    }
+    binary = malloc(header.length);
+    status = fread(binary, header.length, 1, file) == 1;
+    fclose(file);
+
+    /* driver may still reject it, then we compile from source */
+    if (status)
+    {
+        glProgramBinary(program, header.format, binary, header.length);
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+    }
+    free(binary);
+    return status;
+}
+
+static void _program_cache_save(GLuint program, uint64_t key)
+{
+    char path[256];
+    ProgramCacheHeader header;
+    void *binary;
+    FILE *file;
+
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+    header.key = key;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    if (header.length <= 0)
+        return;
+    binary = malloc(header.length);
+    glGetProgramBinary(program, header.length, NULL, &header.format, binary);
+
+    _program_cache_path(path, key);
+    if ((file = fopen(path, "wb")))
+    {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(binary, header.length, 1, file);
+        fclose(file);
+    }
+    free(binary);
+}
+
+/* compile sources and relink program with them, false if failed */
+static bool _link_sources(GLuint program, char *const *paths,
+                          char *const *sources, bool retrievable)
+{
+    GLuint shaders[3] = { 0, 0, 0 }, old[3];
+    GLsizei nold;
+    GLint status = true;
+    char log[512];
+    unsigned int i;
+
+    for (i = 0; status && i < 3; ++i)
+        if (paths[i])
+        {
+            shaders[i] = glCreateShader(shader_types[i]);
+            status = _compile_shader(shaders[i], paths[i], sources[i]);
+        }
+
+    if (status)
+    {
+        /* replace shaders from last link, if any */
+        glGetAttachedShaders(program, 3, &nold, old);
+        for (i = 0; i < (unsigned int) nold; ++i)
+            glDetachShader(program, old[i]);
+        for (i = 0; i < 3; ++i)
+            if (shaders[i])
+                glAttachShader(program, shaders[i]);
+
+        if (retrievable)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE);
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status)
+        {
+            glGetProgramInfoLog(program, 512, NULL, log);
+            console_printf("gfx: linking program unsuccessful\n%s", log);
+        }
+    }
+
+    /* GL will automatically detach and free shaders when program is deleted */
+    for (i = 0; i < 3; ++i)
+        if (shaders[i])
+            glDeleteShader(shaders[i]);
+
+    return status;
+}
+
+/*
+ * (re)link program with shaders at paths, from binary cache if possible --
+ * if some shader can't be read or doesn't compile program is left as it
+ * was
+ */
+static bool _link_program(GLuint program, char *const *paths)
+{
+    char *sources[3] = { NULL, NULL, NULL };
+    GLuint block;
+    bool status = true, cache;
+    uint64_t key = 0;
+    unsigned int i;
+
+    for (i = 0; status && i < 3; ++i)
+        if (paths[i] && !(sources[i] = _read_file(paths[i])))
+        {
+            console_printf("gfx: couldn't open shader '%s'\n", paths[i]);
+            status = false;
+        }
+
+    if (status)
+    {
+        cache = _program_cache_available();
+        if (cache)
+            key = _program_key(sources);
+
+        if (!cache || !_program_cache_load(program, key))
+        {
+            status = _link_sources(program, paths, sources, cache);
+            if (status && cache)
+                _program_cache_save(program, key);
+        }
+
+        /* bind Frame uniform block if used -- binding isn't in binary */
+        block = glGetUniformBlockIndex(program, "Frame");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, FRAME_BINDING);
+    }
+
+    for (i = 0; i < 3; ++i)
+        free(sources[i]);
+    return status;
+}
+
+static void _program_changed(const char *filename, void *data)
+{
+    ProgramSource *src = array_get(programs, (uintptr_t) data);
+
+    console_printf("gfx: '%s' changed, relinking\n", filename);
+    gfx_context_acquire();
+    _link_program(src->program, src->paths);
+    gfx_context_release();
+}
+
 GLuint gfx_create_program(const char *vert_path,
                           const char *geom_path,
                           const char *frag_path)
 {
-    GLuint vert, geom, frag, program;
+    ProgramSource *src;
+    const char *paths[3] = { vert_path, geom_path, frag_path };
+    GLuint program;
+    unsigned int i;
+
+    program = glCreateProgram();
+
+    src = array_add(programs);
+    src->program = program;
+    for (i = 0; i < 3; ++i)
+        if (paths[i])
+        {
+            src->paths[i] = malloc(strlen(paths[i]) + 1);
+            strcpy(src->paths[i], paths[i]);
+            watch_add(paths[i], _program_changed,
+                      (void *) (uintptr_t) (array_length(programs) - 1));
+        }
+        else
+            src->paths[i] = NULL;
+
+    _link_program(program, src->paths); /* kept even if failed, can be
+                                           fixed by editing sources */
+    return program;
+}
+
+/* --- frames -------------------------------------------------------------- */
+
+/*
+ * everything recorded for a frame lives in a GfxFrame -- upload data is
+ * copied into the frame so it can't change under a render thread still
+ * working on it while the next frame is built
+ */
+
+typedef struct Uniform Uniform;
+struct Uniform
+{
+    GLint loc;
+    unsigned int n; /* 1 for float, 2 for vec2, 9 for mat3 */
+    GLfloat v[9];
+};
+
+struct GfxDraw
+{
+    uint64_t key;
+    unsigned int seq; /* submission order, for ties */
+
+    GLuint program;
+    GLuint vao;
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+
+    GLenum tex_target;
+    GLuint texture;
+
+    unsigned int nuniforms;
+    Uniform uniforms[GFX_MAX_DRAW_UNIFORMS];
+};
+
+typedef struct Upload Upload;
+struct Upload
+{
+    GLuint buffer;
+    bool realloc;       /* glBufferData(...) if true else glBufferSubData(...) */
+    GLenum usage;
+    GLintptr offset;
+    GLsizeiptr size;
+    size_t data;        /* offset into frame bytes, NO_DATA if none */
+};
+
+#define NO_DATA ((size_t) -1)
+
+typedef enum DeleteType DeleteType;
+enum DeleteType
+{
+    DT_BUFFER,
+    DT_VERTEX_ARRAY,
+    DT_TEXTURE,
+};
+
+typedef struct Delete Delete;
+struct Delete
+{
+    DeleteType type;
+    GLuint name;
+};
 
-#define compile(shader, type)                           \
-    if (shader##_path)                                  \
-    {                                                   \
-        shader = glCreateShader(type);                  \
-        if (!_compile_shader(shader, shader##_path))    \
-            return 0;                                   \
+typedef struct GfxFrame GfxFrame;
+struct GfxFrame
+{
+    GLfloat clear_color[4];
+    Array *uploads;     /* Upload, run in order before draws */
+    Array *draws;       /* GfxDraw */
+    Array *deletes;     /* Delete, run after draws */
+
+    char *bytes;        /* upload data */
+    size_t nbytes, bytes_capacity;
+};
+
+/* one more frame than may be in flight, for the one being built */
+#define NUM_FRAMES (GFX_MAX_FRAMES_IN_FLIGHT + 1)
+
+static GfxFrame frames[NUM_FRAMES];
+static unsigned int build = 0; /* index of frame being built */
+static Color clear_color;
+
+static void _frame_init(GfxFrame *frame)
+{
+    frame->uploads = array_new(Upload);
+    frame->draws = array_new(GfxDraw);
+    frame->deletes = array_new(Delete);
+    frame->bytes = NULL;
+    frame->nbytes = frame->bytes_capacity = 0;
+}
+static void _frame_deinit(GfxFrame *frame)
+{
+    free(frame->bytes);
+    array_free(frame->deletes);
+    array_free(frame->draws);
+    array_free(frame->uploads);
+}
+
+static void _frame_clear(GfxFrame *frame)
+{
+    array_clear(frame->uploads);
+    array_clear(frame->draws);
+    array_clear(frame->deletes);
+    frame->nbytes = 0;
+}
+
+/* copy size bytes of data into frame, return offset */
+static size_t _frame_copy(GfxFrame *frame, const void *data, size_t size)
+{
+    size_t offset;
+
+    if (!data)
+        return NO_DATA;
+
+    if (frame->nbytes + size > frame->bytes_capacity)
+    {
+        frame->bytes_capacity = 2 * frame->bytes_capacity;
+        if (frame->bytes_capacity < frame->nbytes + size)
+            frame->bytes_capacity = frame->nbytes + size;
+        frame->bytes = realloc(frame->bytes, frame->bytes_capacity);
     }
 
-    compile(vert, GL_VERTEX_SHADER);
-    compile(geom, GL_GEOMETRY_SHADER);
-    compile(frag, GL_FRAGMENT_SHADER);
+    offset = frame->nbytes;
+    memcpy(frame->bytes + offset, data, size);
+    frame->nbytes += size;
+    return offset;
+}
 
-    program = glCreateProgram();
+/* --- recording ----------------------------------------------------------- */
 
-    if (vert_path) glAttachShader(program, vert);
-    if (geom_path) glAttachShader(program, geom);
-    if (frag_path) glAttachShader(program, frag);
+void gfx_buffer_data(GLuint buffer, GLsizeiptr size, const void *data,
+                     GLenum usage)
+{
+    GfxFrame *frame = &frames[build];
+    Upload *upload;
+    size_t offset;
 
-    glLinkProgram(program);
+    offset = _frame_copy(frame, data, size);
+    upload = array_add(frame->uploads);
+    upload->buffer = buffer;
+    upload->realloc = true;
+    upload->usage = usage;
+    upload->offset = 0;
+    upload->size = size;
+    upload->data = offset;
+}
+void gfx_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                         const void *data)
+{
+    GfxFrame *frame = &frames[build];
+    Upload *upload;
+    size_t data_offset;
 
-    /* GL will automatically detach and free shaders when program is deleted */
-    if (vert_path) glDeleteShader(vert);
-    if (geom_path) glDeleteShader(geom);
-    if (frag_path) glDeleteShader(frag);
+    if (size == 0)
+        return;
 
-    return program;
+    data_offset = _frame_copy(frame, data, size);
+    upload = array_add(frame->uploads);
+    upload->buffer = buffer;
+    upload->realloc = false;
+    upload->usage = 0;
+    upload->offset = offset;
+    upload->size = size;
+    upload->data = data_offset;
+}
+
+static void _delete(DeleteType type, GLuint name)
+{
+    Delete *del;
+
+    if (name == 0)
+        return;
+    del = array_add(frames[build].deletes);
+    del->type = type;
+    del->name = name;
+}
+void gfx_delete_buffer(GLuint buffer)
+{
+    _delete(DT_BUFFER, buffer);
+}
+void gfx_delete_vertex_array(GLuint vao)
+{
+    _delete(DT_VERTEX_ARRAY, vao);
+}
+void gfx_delete_texture(GLuint texture)
+{
+    _delete(DT_TEXTURE, texture);
+}
+
+GfxDraw *gfx_draw(GfxLayer layer, unsigned int depth, GLuint program,
+                  GLuint vao, GLenum mode, GLint first, GLsizei count)
+{
+    Array *draws = frames[build].draws;
+    GfxDraw *draw;
+
+    draw = array_add(draws);
+    draw->seq = array_length(draws) - 1;
+    draw->key = ((uint64_t) layer << 56)
+        | ((uint64_t) (depth & 0xffffff) << 32)
+        | ((uint64_t) (program & 0xffff) << 16);
+    draw->program = program;
+    draw->vao = vao;
+    draw->mode = mode;
+    draw->first = first;
+    draw->count = count;
+    draw->tex_target = GL_TEXTURE_2D;
+    draw->texture = 0;
+    draw->nuniforms = 0;
+    return draw;
+}
+
+void gfx_draw_texture(GfxDraw *draw, GLenum target, GLuint texture)
+{
+    draw->tex_target = target;
+    draw->texture = texture;
+    draw->key = (draw->key & ~(uint64_t) 0xffff) | (texture & 0xffff);
+}
+
+static Uniform *_draw_uniform(GfxDraw *draw, GLint loc, unsigned int n)
+{
+    Uniform *u;
+
+    error_assert(draw->nuniforms < GFX_MAX_DRAW_UNIFORMS,
+                 "too many uniforms for draw");
+    u = &draw->uniforms[draw->nuniforms++];
+    u->loc = loc;
+    u->n = n;
+    return u;
+}
+void gfx_draw_uniform_float(GfxDraw *draw, GLint loc, GLfloat f)
+{
+    _draw_uniform(draw, loc, 1)->v[0] = f;
+}
+void gfx_draw_uniform_vec2(GfxDraw *draw, GLint loc, Vec2 v)
+{
+    Uniform *u = _draw_uniform(draw, loc, 2);
+    u->v[0] = v.x;
+    u->v[1] = v.y;
+}
+void gfx_draw_uniform_mat3(GfxDraw *draw, GLint loc, Mat3 m)
+{
+    memcpy(_draw_uniform(draw, loc, 9)->v, m.m, sizeof(m.m));
+}
+
+void gfx_set_clear_color(Color c)
+{
+    clear_color = c;
+}
+
+/* --- running ------------------------------------------------------------- */
+
+/* only touched by whichever thread is running frames */
+
+/* uniform value last set with a program */
+typedef struct UniformState UniformState;
+struct UniformState
+{
+    GLuint program;
+    Uniform uniform;
+};
+
+static Array *uniform_states;   /* UniformState, reset each frame */
+static GfxStats curr_stats;
+
+static int _draw_compare(const void *a, const void *b)
+{
+    const GfxDraw *da = a, *db = b;
+    if (da->key != db->key)
+        return da->key < db->key ? -1 : 1;
+    return ((int) da->seq) - ((int) db->seq);
+}
+
+/* set uniform unless program already has that value from earlier draw */
+static void _set_uniform(GLuint program, const Uniform *u)
+{
+    UniformState *state;
+
+    array_foreach(state, uniform_states)
+        if (state->program == program && state->uniform.loc == u->loc)
+        {
+            if (state->uniform.n == u->n
+                && !memcmp(state->uniform.v, u->v, u->n * sizeof(GLfloat)))
+                return;
+            break;
+        }
+    if (state == array_end(uniform_states))
+    {
+        state = array_add(uniform_states);
+        state->program = program;
+    }
+    state->uniform = *u;
+
+    switch (u->n)
+    {
+        case 1: glUniform1fv(u->loc, 1, u->v); break;
+        case 2: glUniform2fv(u->loc, 1, u->v); break;
+        case 9: glUniformMatrix3fv(u->loc, 1, GL_FALSE, u->v); break;
+    }
+    ++curr_stats.uniform_sets;
+}
+
+static void _run_uploads(GfxFrame *frame)
+{
+    Upload *upload;
+    const void *data;
+
+    array_foreach(upload, frame->uploads)
+    {
+        data = upload->data == NO_DATA ? NULL : frame->bytes + upload->data;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, upload->buffer);
+        if (upload->realloc)
+            glBufferData(GL_COPY_WRITE_BUFFER, upload->size, data,
+                         upload->usage);
+        else
+            glBufferSubData(GL_COPY_WRITE_BUFFER, upload->offset,
+                            upload->size, data);
+    }
+}
+
+static void _run_draws(GfxFrame *frame)
+{
+    Array *draws = frame->draws;
+    GfxDraw *draw;
+    GLuint program = 0, vao = 0, texture = 0;
+    GLenum tex_target = 0;
+    unsigned int i;
+
+    array_clear(uniform_states);
+
+    qsort(array_begin(draws), array_length(draws), sizeof(GfxDraw),
+          _draw_compare);
+
+    /* GL state may have been changed since last frame, so bind all first */
+    glActiveTexture(GL_TEXTURE0);
+    array_foreach(draw, draws)
+    {
+        if (draw->count == 0)
+            continue;
+
+        if (draw == array_begin(draws) || draw->program != program)
+        {
+            glUseProgram(program = draw->program);
+            ++curr_stats.program_binds;
+        }
+        if (draw == array_begin(draws) || draw->vao != vao)
+        {
+            glBindVertexArray(vao = draw->vao);
+            ++curr_stats.vertex_array_binds;
+        }
+        if (draw->texture && (draw->texture != texture
+                              || draw->tex_target != tex_target))
+        {
+            glBindTexture(tex_target = draw->tex_target,
+                          texture = draw->texture);
+            ++curr_stats.texture_binds;
+        }
+
+        for (i = 0; i < draw->nuniforms; ++i)
+            _set_uniform(program, &draw->uniforms[i]);
+
+        glDrawArrays(draw->mode, draw->first, draw->count);
+        ++curr_stats.draws;
+    }
+}
+
+static void _run_deletes(GfxFrame *frame)
+{
+    Delete *del;
+
+    array_foreach(del, frame->deletes)
+        switch (del->type)
+        {
+            case DT_BUFFER: glDeleteBuffers(1, &del->name); break;
+            case DT_VERTEX_ARRAY: glDeleteVertexArrays(1, &del->name); break;
+            case DT_TEXTURE: glDeleteTextures(1, &del->name); break;
+        }
+}
+
+/* run whole frame and present it */
+static void _frame_run(GfxFrame *frame)
+{
+    memset(&curr_stats, 0, sizeof(curr_stats));
+
+    glClearColor(frame->clear_color[0], frame->clear_color[1],
+                 frame->clear_color[2], frame->clear_color[3]);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    _run_uploads(frame);
+    _run_draws(frame);
+    _run_deletes(frame);
+
+    glfwSwapBuffers(game_window);
+}
+
+/* --- render thread ------------------------------------------------------- */
+
+/*
+ * with frames in flight the render thread owns the GL context -- frames
+ * [head, head + nqueued) are waiting for it, oldest first, and the main
+ * thread builds frames[build] meanwhile
+ *
+ * the main thread borrows the context through gfx_context_acquire(), the
+ * render thread gives it up only after finishing all queued frames
+ */
+
+static unsigned int max_frames_in_flight = 0;
+static Thread *render_thread = NULL;
+static Mutex *mutex;
+static Cond *cond;              /* signalled on any change to below */
+static unsigned int head = 0, nqueued = 0;
+static bool stop_requested = false;
+static bool context_requested = false, context_released = false;
+static unsigned int context_depth = 0; /* main thread only */
+static GfxStats stats;
+
+static void _render_thread(void *data)
+{
+    GfxFrame *frame;
+
+    glfwMakeContextCurrent(game_window);
+
+    mutex_lock(mutex);
+    for (;;)
+    {
+        if (nqueued > 0)
+        {
+            frame = &frames[head];
+            mutex_unlock(mutex);
+            _frame_run(frame);
+            mutex_lock(mutex);
+
+            stats = curr_stats;
+            head = (head + 1) % NUM_FRAMES;
+            --nqueued;
+            cond_broadcast(cond);
+        }
+        else if (stop_requested)
+            break;
+        else if (context_requested)
+        {
+            glfwMakeContextCurrent(NULL);
+            context_released = true;
+            cond_broadcast(cond);
+            while (context_requested)
+                cond_wait(cond, mutex);
+            context_released = false;
+            glfwMakeContextCurrent(game_window);
+        }
+        else
+            cond_wait(cond, mutex);
+    }
+    mutex_unlock(mutex);
+
+    glfwMakeContextCurrent(NULL);
+}
+
+static void _thread_start()
+{
+    head = build;
+    nqueued = 0;
+    glfwMakeContextCurrent(NULL);
+    render_thread = thread_new(_render_thread, NULL);
+}
+static void _thread_stop()
+{
+    mutex_lock(mutex);
+    stop_requested = true;
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+
+    thread_join(render_thread); /* finishes queued frames first */
+    render_thread = NULL;
+    stop_requested = false;
+    glfwMakeContextCurrent(game_window);
+}
+
+void gfx_set_max_frames_in_flight(unsigned int n)
+{
+    error_assert(n <= GFX_MAX_FRAMES_IN_FLIGHT,
+                 "at most %d frames may be in flight",
+                 GFX_MAX_FRAMES_IN_FLIGHT);
+    error_assert(context_depth == 0,
+                 "can't change frames in flight while context is acquired");
+
+    if (n == max_frames_in_flight)
+        return;
+
+    if (render_thread && n == 0)
+        _thread_stop();
+
+    mutex_lock(mutex);
+    max_frames_in_flight = n;
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+
+    if (!render_thread && n > 0)
+        _thread_start();
+}
+unsigned int gfx_get_max_frames_in_flight()
+{
+    return max_frames_in_flight;
+}
+
+void gfx_context_acquire()
+{
+    if (!render_thread || context_depth++ > 0)
+        return;
+
+    mutex_lock(mutex);
+    context_requested = true;
+    cond_broadcast(cond);
+    while (!context_released)
+        cond_wait(cond, mutex);
+    mutex_unlock(mutex);
+
+    glfwMakeContextCurrent(game_window);
+}
+void gfx_context_release()
+{
+    if (!render_thread || --context_depth > 0)
+        return;
+
+    glfwMakeContextCurrent(NULL);
+
+    mutex_lock(mutex);
+    context_requested = false;
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+}
+
+void gfx_flush()
+{
+    GfxFrame *frame = &frames[build];
+
+    frame->clear_color[0] = clear_color.r;
+    frame->clear_color[1] = clear_color.g;
+    frame->clear_color[2] = clear_color.b;
+    frame->clear_color[3] = clear_color.a;
+
+    /* no render thread? just run it here */
+    if (!render_thread)
+    {
+        _frame_run(frame);
+        stats = curr_stats;
+        _frame_clear(frame);
+        return;
+    }
+
+    /* queue it, wait till few enough frames are in flight */
+    mutex_lock(mutex);
+    ++nqueued;
+    cond_broadcast(cond);
+    while (nqueued > max_frames_in_flight)
+        cond_wait(cond, mutex);
+    mutex_unlock(mutex);
+
+    /* the frame after the last queued one is now free */
+    build = (build + 1) % NUM_FRAMES;
+    _frame_clear(&frames[build]);
+}
+
+GfxStats gfx_get_stats()
+{
+    GfxStats s;
+
+    mutex_lock(mutex);
+    s = stats;
+    mutex_unlock(mutex);
+    return s;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void gfx_init()
+{
+    unsigned int i;
+
+    programs = array_new(ProgramSource);
+    for (i = 0; i < NUM_FRAMES; ++i)
+        _frame_init(&frames[i]);
+    uniform_states = array_new(UniformState);
+    mutex = mutex_new();
+    cond = cond_new();
+    memset(&stats, 0, sizeof(stats));
+    clear_color = color(0.95f, 0.95f, 0.95f, 1.f);
+
+    glGenBuffers(1, &frame_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    memset(&frame_uniforms, 0, sizeof(frame_uniforms));
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &frame_uniforms,
+                 GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, frame_ubo);
+}
+void gfx_deinit()
+{
+    ProgramSource *src;
+    unsigned int i;
+
+    if (render_thread)
+        _thread_stop();
+
+    /* systems deinit'd before us may have left deletes */
+    _run_deletes(&frames[build]);
+
+    glDeleteBuffers(1, &frame_ubo);
+
+    cond_free(cond);
+    mutex_free(mutex);
+    array_free(uniform_states);
+    for (i = 0; i < NUM_FRAMES; ++i)
+        _frame_deinit(&frames[i]);
+    array_foreach(src, programs)
+        for (i = 0; i < 3; ++i)
+            free(src->paths[i]);
+    array_free(programs);
+}
+
+void gfx_update_frame_uniforms()
+{
+    FrameUniforms f;
+    const Mat3 *ivm;
+    Vec2 win;
+    unsigned int i, j;
+
+    memset(&f, 0, sizeof(f));
+    ivm = camera_get_inverse_view_matrix_ptr();
+    for (i = 0; i < 3; ++i)
+        for (j = 0; j < 3; ++j)
+            f.inverse_view_matrix[i][j] = ivm->m[i][j];
+    win = game_get_window_size();
+    f.window_size[0] = win.x;
+    f.window_size[1] = win.y;
+    f.aspect = win.x / win.y;
+
+    /* upload only if changed */
+    if (!memcmp(&f, &frame_uniforms, sizeof(f)))
+        return;
+    frame_uniforms = f;
+    gfx_buffer_sub_data(frame_ubo, 0, sizeof(f), &f);
 }
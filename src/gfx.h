@@ -1,17 +1,153 @@
 #ifndef GFX_H
 #define GFX_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <GL/glew.h>
 
+#include "mat3.h"
+#include "vec2.h"
+#include "color.h"
+#include "script_export.h"
+
 /*
  * compile, link program given paths to shader files, possibly NULL,
  * doesn't glUseProgram(...)
+ *
+ * linked programs are cached as binaries under usr/ where the driver
+ * supports it, so later runs skip compiling unless sources or driver
+ * changed
+ *
+ * the program is relinked in place when a shader file changes, which
+ * resets uniform values set outside of draws -- set those per draw with
+ * gfx_draw_uniform_*(...) instead
  */
 GLuint gfx_create_program(const char *vert_path,
                           const char *geom_path,
                           const char *frag_path);
 void gfx_free_program(GLuint program);
 
+/*
+ * per-frame data shared by all programs through one uniform buffer, bound
+ * once -- a shader uses it by declaring
+ *
+ *     layout(std140) uniform Frame
+ *     {
+ *         mat3 inverse_view_matrix;
+ *         vec2 window_size;
+ *         float aspect;
+ *     };
+ *
+ * programs made by gfx_create_program(...) have it bound automatically
+ *
+ * uniform locations should be looked up once after gfx_create_program(...)
+ * and kept rather than looked up by name at each draw
+ */
+void gfx_init();
+void gfx_deinit();
+void gfx_update_frame_uniforms(); /* call before drawing each frame */
+
+/*
+ * render queue -- *_draw_all() functions record a frame instead of issuing
+ * GL calls, and gfx_flush() clears the screen, runs the frame's buffer
+ * uploads in order, then its draws sorted by layer, then depth, then
+ * program and texture (skipping binds of program, vertex array, texture
+ * and uniform values that are already current), then its deletes, and
+ * presents it
+ *
+ * upload data is copied into the frame when recorded, so the caller's
+ * memory may change right after -- a frame is an immutable snapshot once
+ * flushed
+ *
+ * with frames in flight (see gfx_set_max_frames_in_flight(...) below) a
+ * render thread owning the GL context runs flushed frames while the next
+ * one is updated and recorded, so GL calls made outside of system init and
+ * deinit that aren't through gfx_* must be between gfx_context_acquire()
+ * and gfx_context_release()
+ */
+
+typedef enum GfxLayer GfxLayer;
+enum GfxLayer
+{
+    GFX_LAYER_TILEMAP,
+    GFX_LAYER_SPRITE,
+    GFX_LAYER_EDIT,
+    GFX_LAYER_PHYSICS,
+    GFX_LAYER_GUI,
+};
+
+typedef struct GfxDraw GfxDraw;
+
+/* record glBufferData(...), glBufferSubData(...) on buffer -- data may be
+   NULL for glBufferData(...) */
+void gfx_buffer_data(GLuint buffer, GLsizeiptr size, const void *data,
+                     GLenum usage);
+void gfx_buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                         const void *data);
+
+/*
+ * add a draw of 'count' vertices from 'first' -- lower depth is drawn
+ * first within a layer, draws with same layer and depth may be reordered
+ * to share state, returned pointer is valid till next gfx_draw(...)
+ */
+GfxDraw *gfx_draw(GfxLayer layer, unsigned int depth, GLuint program,
+                  GLuint vao, GLenum mode, GLint first, GLsizei count);
+
+/* texture to bind to unit 0 for draw, none by default */
+void gfx_draw_texture(GfxDraw *draw, GLenum target, GLuint texture);
+
+/* uniform values to set for draw, up to GFX_MAX_DRAW_UNIFORMS */
+#define GFX_MAX_DRAW_UNIFORMS 4
+void gfx_draw_uniform_float(GfxDraw *draw, GLint loc, GLfloat f);
+void gfx_draw_uniform_vec2(GfxDraw *draw, GLint loc, Vec2 v);
+void gfx_draw_uniform_mat3(GfxDraw *draw, GLint loc, Mat3 m);
+
+/* record deletion after this frame's draws, objects that earlier frames
+   may still use must be deleted through these */
+void gfx_delete_buffer(GLuint buffer);
+void gfx_delete_vertex_array(GLuint vao);
+void gfx_delete_texture(GLuint texture);
+
+void gfx_set_clear_color(Color c);
+
+void gfx_flush(); /* end frame, run it or queue it for render thread */
+
+/*
+ * make GL context current on calling thread, waiting for render thread to
+ * finish all flushed frames -- may nest, does nothing without a render
+ * thread
+ */
+void gfx_context_acquire();
+void gfx_context_release();
+
+#define GFX_MAX_FRAMES_IN_FLIGHT 3
+
+SCRIPT(gfx,
+
+       /* GL work done in last gfx_flush(), for profiling */
+       typedef struct GfxStats GfxStats;
+       struct GfxStats
+       {
+           unsigned int draws;
+           unsigned int program_binds;
+           unsigned int vertex_array_binds;
+           unsigned int texture_binds;
+           unsigned int uniform_sets;
+       };
+
+       EXPORT GfxStats gfx_get_stats();
+
+       /*
+        * how many flushed frames may wait for or be in rendering while the
+        * next is built, up to GFX_MAX_FRAMES_IN_FLIGHT -- 0 (default) runs
+        * each frame on the main thread at gfx_flush(), more moves rendering
+        * to its own thread
+        */
+       EXPORT void gfx_set_max_frames_in_flight(unsigned int n);
+       EXPORT unsigned int gfx_get_max_frames_in_flight();
+
+    )
+
 /* get pointer offset of 'field' in struct 'type' */
 #define poffsetof(type, field)                  \
     ((void *) (&((type *) 0)->field))
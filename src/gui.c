@@ -16,7 +16,6 @@
 #include "game.h"
 #include "camera.h"
 #include "edit.h"
-#include "entitymap.h"
 #include "timing.h"
 
 static Entity gui_root; /* all gui should be descendants of this to move
@@ -39,7 +38,7 @@ struct Gui
 
     bool setvisible;      /* externally-set visibility */
     bool visible;         /* internal recursively computed visibility */
-    bool updated_visible; /* for recursive visibility computation */
+    bool visible_queued;  /* in visible_queue */
     bool focusable;       /* can be focused */
     bool captures_events;
 
@@ -49,23 +48,122 @@ struct Gui
     GuiAlign halign;
     GuiAlign valign;
     Vec2 padding;
+
+    /* last seen transform parent, dirty count -- a change needs relayout */
+    Entity parent;
+    unsigned int dirty_count;
+
+    bool layout_queued; /* in layout_tops */
+    bool in_layout;     /* in layout_ents this frame */
+
+    /* world space bbox, and that merged with visible descendants' for
+       pruning hit tests -- wbbox recomputed only if transform or bbox
+       changed since */
+    BBox wbbox;
+    BBox tree_bbox;
+    BBox wbbox_src;
+    unsigned int world_dirty_count;
+    bool wbbox_dirty;
+
+    bool hovered;
 };
 
 static EntityPool *gui_pool;
 
-static EntityMap *focus_enter_map;
-static EntityMap *focus_exit_map;
-static EntityMap *changed_map;
-static EntityMap *mouse_down_map;
-static EntityMap *mouse_up_map;
-static EntityMap *key_down_map;
-static EntityMap *key_up_map;
+/*
+ * layout is only redone for subtrees under 'tops' -- the highest gui
+ * ancestors below gui_root -- that had something change, queued in
+ * layout_tops, and each frame the entities under them are gathered into
+ * layout_ents for the layout passes
+ */
+static Array *layout_tops;
+static Array *layout_ents;
+static bool layout_all = true; /* relayout everything */
+
+/* guis whose visibility needs recomputing -- setvisible or parent changed */
+static Array *visible_queue;
+
+/* roots of gui trees for hit tests -- gui_root and guis with no gui parent */
+static Array *hit_tops;
+
+/* visible guis under mouse as of last update, topmost last */
+static Array *hovered_ents;
+static Array *mouse_event_ents; /* same for mouse event being handled */
+
+/*
+ * events this frame are kept in a compact list, with an open-addressing
+ * hash set from (entity, type) to list index for lookup -- an event fired
+ * again in a frame overwrites the earlier value
+ *
+ * slots are valid only if their 'gen' matches event_gen, so clearing all
+ * events is just bumping event_gen
+ */
+typedef struct EventSlot EventSlot;
+struct EventSlot
+{
+    unsigned int gen;
+    unsigned int index;
+};
+
+static Array *events; /* GuiEvent */
+static EventSlot *event_slots;
+static unsigned int event_slots_cap; /* power of 2 */
+static unsigned int event_gen = 1;
 
 Entity gui_get_root()
 {
     return gui_root;
 }
 
+static void _rect_update_gui_props(Entity ent);
+
+static void _common_visible_dirty(Entity ent)
+{
+    Gui *gui = entitypool_get(gui_pool, ent);
+    if (gui && !gui->visible_queued)
+    {
+        gui->visible_queued = true;
+        array_add_val(Entity, visible_queue) = ent;
+    }
+}
+
+/* highest gui ancestor of ent below gui_root, or gui_root itself */
+static Entity _common_layout_top(Entity ent)
+{
+    Entity parent;
+
+    while (transform_has(ent))
+    {
+        parent = transform_get_parent(ent);
+        if (entity_eq(parent, entity_nil) || entity_eq(parent, gui_root)
+            || !entitypool_get(gui_pool, parent))
+            break;
+        ent = parent;
+    }
+    return ent;
+}
+
+/* queue relayout of subtree containing ent */
+static void _common_layout_dirty(Entity ent)
+{
+    Gui *gui;
+
+    /* root changed? everything needs relayout */
+    ent = _common_layout_top(ent);
+    if (entity_eq(ent, gui_root))
+    {
+        layout_all = true;
+        return;
+    }
+
+    gui = entitypool_get(gui_pool, ent);
+    if (gui && !gui->layout_queued)
+    {
+        gui->layout_queued = true;
+        array_add_val(Entity, layout_tops) = ent;
+    }
+}
+
 void gui_add(Entity ent)
 {
     Gui *gui;
@@ -85,10 +183,23 @@ void gui_add(Entity ent)
     gui->halign = GA_NONE;
     gui->valign = GA_NONE;
     gui->padding = vec2(5, 5);
+    gui->parent = entity_nil;
+    gui->dirty_count = transform_get_dirty_count(ent);
+    gui->layout_queued = false;
+    gui->in_layout = false;
+    gui->wbbox_dirty = true;
+    gui->hovered = false;
+    gui->visible_queued = false;
+
+    _common_visible_dirty(ent);
+    _common_layout_dirty(ent);
 }
 
 void gui_remove(Entity ent)
 {
+    Gui *gui = entitypool_get(gui_pool, ent);
+    if (gui && entitypool_get(gui_pool, gui->parent))
+        _common_layout_dirty(gui->parent); /* parent may need to refit */
     entitypool_remove(gui_pool, ent);
 }
 
@@ -102,6 +213,7 @@ void gui_set_color(Entity ent, Color color)
     Gui *gui = entitypool_get(gui_pool, ent);
     error_assert(gui);
     gui->color = color;
+    _rect_update_gui_props(ent);
 }
 Color gui_get_color(Entity ent)
 {
@@ -114,6 +226,11 @@ void gui_set_visible(Entity ent, bool visible)
 {
     Gui *gui = entitypool_get(gui_pool, ent);
     error_assert(gui);
+    if (gui->setvisible != visible)
+    {
+        _common_visible_dirty(ent);
+        _common_layout_dirty(ent);
+    }
     gui->setvisible = visible;
 }
 bool gui_get_visible(Entity ent)
@@ -153,6 +270,8 @@ void gui_set_halign(Entity ent, GuiAlign align)
 {
     Gui *gui = entitypool_get(gui_pool, ent);
     error_assert(gui);
+    if (gui->halign != align)
+        _common_layout_dirty(ent);
     gui->halign = align;
 }
 GuiAlign gui_get_halign(Entity ent)
@@ -165,6 +284,8 @@ void gui_set_valign(Entity ent, GuiAlign align)
 {
     Gui *gui = entitypool_get(gui_pool, ent);
     error_assert(gui);
+    if (gui->valign != align)
+        _common_layout_dirty(ent);
     gui->valign = align;
 }
 GuiAlign gui_get_valign(Entity ent)
@@ -177,6 +298,8 @@ void gui_set_padding(Entity ent, Vec2 padding)
 {
     Gui *gui = entitypool_get(gui_pool, ent);
     error_assert(gui);
+    if (!vec2_eq(gui->padding, padding))
+        _common_layout_dirty(ent);
     gui->padding = padding;
 }
 Vec2 gui_get_padding(Entity ent)
@@ -186,16 +309,116 @@ Vec2 gui_get_padding(Entity ent)
     return gui->padding;
 }
 
+static unsigned int _event_hash(Entity ent, GuiEventType type)
+{
+    return (ent.id * GE_NUM + type) * 2654435761u;
+}
+
+/* slot for (ent, type), or the empty slot where it would go */
+static EventSlot *_event_find(Entity ent, GuiEventType type)
+{
+    unsigned int i, mask = event_slots_cap - 1;
+    EventSlot *slot;
+    GuiEvent *event;
+
+    for (i = _event_hash(ent, type) & mask; ; i = (i + 1) & mask)
+    {
+        slot = &event_slots[i];
+        if (slot->gen != event_gen)
+            return slot;
+        event = array_get(events, slot->index);
+        if (entity_eq(event->ent, ent) && event->type == type)
+            return slot;
+    }
+}
+
+/* keep load at most 1/2 */
+static void _event_grow()
+{
+    GuiEvent *event;
+    EventSlot *slot;
+
+    if (2 * (array_length(events) + 1) <= event_slots_cap)
+        return;
+
+    event_slots_cap *= 2;
+    free(event_slots);
+    event_slots = calloc(event_slots_cap, sizeof(EventSlot));
+    event_gen = 1;
+
+    array_foreach(event, events)
+    {
+        slot = _event_find(event->ent, event->type);
+        slot->gen = event_gen;
+        slot->index = event - (GuiEvent *) array_begin(events);
+    }
+}
+
+static void _event_fire(Entity ent, GuiEventType type, int value)
+{
+    EventSlot *slot;
+    GuiEvent *event;
+
+    _event_grow();
+    slot = _event_find(ent, type);
+    if (slot->gen == event_gen)
+    {
+        event = array_get(events, slot->index);
+        event->value = value;
+        return;
+    }
+
+    slot->gen = event_gen;
+    slot->index = array_length(events);
+    event = array_add(events);
+    event->ent = ent;
+    event->type = type;
+    event->value = value;
+}
+
+/* value of event, or 'def' if not fired this frame */
+static int _event_get(Entity ent, GuiEventType type, int def)
+{
+    EventSlot *slot;
+
+    if (array_length(events) == 0)
+        return def;
+    slot = _event_find(ent, type);
+    if (slot->gen != event_gen)
+        return def;
+    return array_get_val(GuiEvent, events, slot->index).value;
+}
+
+static void _event_clear()
+{
+    array_clear(events);
+    if (++event_gen == 0) /* wrapped, old slots may look valid */
+    {
+        memset(event_slots, 0, event_slots_cap * sizeof(EventSlot));
+        event_gen = 1;
+    }
+}
+
+unsigned int gui_event_get_num()
+{
+    return array_length(events);
+}
+GuiEvent gui_event_get_nth(unsigned int n)
+{
+    error_assert(n < array_length(events));
+    return array_get_val(GuiEvent, events, n);
+}
+
 void gui_set_focused_entity(Entity ent)
 {
     if (entity_eq(focused, ent))
         return;
 
     if (entity_eq(ent, entity_nil))
-        entitymap_set(focus_exit_map, focused, true);
+        _event_fire(focused, GE_FOCUS_EXIT, true);
     focused = ent;
     if (!entity_eq(focused, entity_nil))
-        entitymap_set(focus_enter_map, focused, true);
+        _event_fire(focused, GE_FOCUS_ENTER, true);
 }
 Entity gui_get_focused_entity()
 {
@@ -219,36 +442,36 @@ bool gui_has_focus()
 
 void gui_fire_event_changed(Entity ent)
 {
-    entitymap_set(changed_map, ent, true);
+    _event_fire(ent, GE_CHANGED, true);
 }
 
 bool gui_event_focus_enter(Entity ent)
 {
-    return entitymap_get(focus_enter_map, ent);
+    return _event_get(ent, GE_FOCUS_ENTER, false);
 }
 bool gui_event_focus_exit(Entity ent)
 {
-    return entitymap_get(focus_exit_map, ent);
+    return _event_get(ent, GE_FOCUS_EXIT, false);
 }
 bool gui_event_changed(Entity ent)
 {
-    return entitymap_get(changed_map, ent);
+    return _event_get(ent, GE_CHANGED, false);
 }
 MouseCode gui_event_mouse_down(Entity ent)
 {
-    return entitymap_get(mouse_down_map, ent);
+    return _event_get(ent, GE_MOUSE_DOWN, MC_NONE);
 }
 MouseCode gui_event_mouse_up(Entity ent)
 {
-    return entitymap_get(mouse_up_map, ent);
+    return _event_get(ent, GE_MOUSE_UP, MC_NONE);
 }
 KeyCode gui_event_key_down(Entity ent)
 {
-    return entitymap_get(key_down_map, ent);
+    return _event_get(ent, GE_KEY_DOWN, KC_NONE);
 }
 KeyCode gui_event_key_up(Entity ent)
 {
-    return entitymap_get(key_up_map, ent);
+    return _event_get(ent, GE_KEY_UP, KC_NONE);
 }
 
 bool gui_captured_event()
@@ -256,26 +479,31 @@ bool gui_captured_event()
     return captured_event;
 }
 
+
 static void _common_init()
 {
     gui_pool = entitypool_new(Gui);
-    focus_enter_map = entitymap_new(false);
-    focus_exit_map = entitymap_new(false);
-    changed_map = entitymap_new(false);
-    mouse_down_map = entitymap_new(MC_NONE);
-    mouse_up_map = entitymap_new(MC_NONE);
-    key_down_map = entitymap_new(KC_NONE);
-    key_up_map = entitymap_new(KC_NONE);
+    layout_tops = array_new(Entity);
+    layout_ents = array_new(Entity);
+    visible_queue = array_new(Entity);
+    hit_tops = array_new(Entity);
+    hovered_ents = array_new(Entity);
+    mouse_event_ents = array_new(Entity);
+    events = array_new(GuiEvent);
+    event_slots_cap = 64;
+    event_slots = calloc(event_slots_cap, sizeof(EventSlot));
+    event_gen = 1;
 }
 static void _common_deinit()
 {
-    entitymap_free(key_up_map);
-    entitymap_free(key_down_map);
-    entitymap_free(mouse_up_map);
-    entitymap_free(mouse_down_map);
-    entitymap_free(changed_map);
-    entitymap_free(focus_enter_map);
-    entitymap_free(focus_exit_map);
+    free(event_slots);
+    array_free(events);
+    array_free(mouse_event_ents);
+    array_free(hovered_ents);
+    array_free(hit_tops);
+    array_free(visible_queue);
+    array_free(layout_ents);
+    array_free(layout_tops);
     entitypool_free(gui_pool);
 }
 
@@ -286,43 +514,50 @@ static void _common_update_destroyed()
     entitypool_remove_destroyed(gui_pool, gui_remove);
 }
 
+/*
+ * recompute visibility from setvisible and parent's visibility -- on a
+ * change children follow, else their visibility can't have changed
+ */
 static void _common_update_visible_rec(Gui *gui)
 {
-    Gui *pgui;
+    Gui *pgui, *child;
+    Entity ent, *children;
+    unsigned int nchildren, i;
+    bool visible;
 
-    if (gui->updated_visible)
-        return;
+    gui->visible_queued = false;
+    ent = gui->pool_elem.ent;
 
-    /* false visibility takes priority */
-    if (!gui->setvisible)
+    /* false visibility takes priority, else inherit if has parent */
+    visible = gui->setvisible;
+    if (visible && (pgui = entitypool_get(gui_pool,
+                                          transform_get_parent(ent))))
     {
-        gui->visible = false;
-        gui->updated_visible = true;
-        return;
+        if (pgui->visible_queued)
+            _common_update_visible_rec(pgui);
+        visible = pgui->visible;
     }
 
-    /* if has parent, inherit */
-    pgui = entitypool_get(gui_pool, transform_get_parent(gui->pool_elem.ent));
-    if (pgui)
-    {
-        _common_update_visible_rec(pgui);
-        gui->visible = pgui->visible;
-        gui->updated_visible = true;
+    if (visible == gui->visible)
         return;
-    }
+    gui->visible = visible;
+    _rect_update_gui_props(ent);
 
-    /* else just set */
-    gui->visible = true;
-    gui->updated_visible = true;
+    children = transform_get_children(ent);
+    nchildren = transform_get_num_children(ent);
+    for (i = 0; i < nchildren; ++i)
+        if ((child = entitypool_get(gui_pool, children[i])))
+            _common_update_visible_rec(child);
 }
 static void _common_update_visible()
 {
+    Entity *ent;
     Gui *gui;
 
-    entitypool_foreach(gui, gui_pool)
-        gui->updated_visible = false;
-    entitypool_foreach(gui, gui_pool)
-        _common_update_visible_rec(gui);
+    array_foreach(ent, visible_queue)
+        if ((gui = entitypool_get(gui_pool, *ent)) && gui->visible_queued)
+            _common_update_visible_rec(gui);
+    array_clear(visible_queue);
 }
 
 static void _common_align(Gui *gui, GuiAlign halign, GuiAlign valign)
@@ -369,24 +604,35 @@ static void _common_align(Gui *gui, GuiAlign halign, GuiAlign valign)
 
     axis_align(halign, x);
     axis_align(valign, y);
-    transform_set_position(ent, pos);
+    if (!vec2_eq(pos, transform_get_position(ent)))
+        transform_set_position(ent, pos);
 }
 
 /* move everything to top-left -- for fit calculations */
 static void _common_reset_align()
 {
+    Entity *ent;
     Gui *gui;
-    entitypool_foreach(gui, gui_pool)
+
+    array_foreach(ent, layout_ents)
+    {
+        gui = entitypool_get(gui_pool, *ent);
         _common_align(gui,
                       gui->halign == GA_NONE ? GA_NONE : GA_MIN,
                       gui->valign == GA_NONE ? GA_NONE : GA_MAX);
+    }
 }
 
 static void _common_update_align()
 {
+    Entity *ent;
     Gui *gui;
-    entitypool_foreach(gui, gui_pool)
+
+    array_foreach(ent, layout_ents)
+    {
+        gui = entitypool_get(gui_pool, *ent);
         _common_align(gui, gui->halign, gui->valign);
+    }
 }
 
 /* attach root GUI entities to gui_root */
@@ -404,11 +650,258 @@ static void _common_attach_root()
     }
 }
 
+/* queue relayout where parent or transform changed since last seen */
+static void _common_update_changed()
+{
+    Gui *gui;
+    Entity ent, parent;
+    unsigned int dirty_count;
+
+    entitypool_foreach(gui, gui_pool)
+    {
+        ent = gui->pool_elem.ent;
+        if (entity_eq(ent, gui_root))
+            continue;
+
+        parent = transform_get_parent(ent);
+        if (!entity_eq(parent, gui->parent))
+        {
+            if (entitypool_get(gui_pool, gui->parent))
+                _common_layout_dirty(gui->parent);
+            _common_visible_dirty(ent);
+            _common_layout_dirty(ent);
+            gui->parent = parent;
+        }
+
+        dirty_count = transform_get_dirty_count(ent);
+        if (dirty_count != gui->dirty_count)
+        {
+            _common_layout_dirty(ent);
+            gui->dirty_count = dirty_count;
+        }
+    }
+}
+
+/* add gui subtree under ent to layout_ents */
+static void _common_layout_add(Entity ent)
+{
+    Gui *gui;
+    Entity *children;
+    unsigned int nchildren, i;
+
+    gui = entitypool_get(gui_pool, ent);
+    if (!gui || gui->in_layout || !transform_has(ent))
+        return;
+    gui->in_layout = true;
+    array_add_val(Entity, layout_ents) = ent;
+
+    children = transform_get_children(ent);
+    nchildren = transform_get_num_children(ent);
+    for (i = 0; i < nchildren; ++i)
+        _common_layout_add(children[i]);
+}
+
+/* gather layout_ents from queued tops, root first if any */
+static void _common_layout_begin()
+{
+    Gui *gui;
+    Entity *top;
+
+    array_clear(layout_ents);
+
+    if (layout_all)
+    {
+        array_clear(layout_tops);
+        entitypool_foreach(gui, gui_pool)
+            gui->layout_queued = false;
+        _common_layout_add(gui_root);
+        entitypool_foreach(gui, gui_pool)
+            _common_layout_add(gui->pool_elem.ent); /* unattached ones */
+        layout_all = false;
+        return;
+    }
+
+    if (array_length(layout_tops) == 0)
+        return;
+
+    /* root's table alignment may depend on any top */
+    gui = entitypool_get(gui_pool, gui_root);
+    gui->in_layout = true;
+    array_add_val(Entity, layout_ents) = gui_root;
+
+    /* tops may have moved under others since queued, so find them again */
+    array_foreach(top, layout_tops)
+    {
+        if ((gui = entitypool_get(gui_pool, *top)))
+            gui->layout_queued = false;
+        _common_layout_add(_common_layout_top(*top));
+    }
+    array_clear(layout_tops);
+}
+
+/* remember transform dirty counts so own moves don't requeue */
+static void _common_layout_end()
+{
+    Entity *ent, *children;
+    Gui *gui;
+    unsigned int nchildren, i;
+
+    array_foreach(ent, layout_ents)
+    {
+        gui = entitypool_get(gui_pool, *ent);
+        gui->dirty_count = transform_get_dirty_count(*ent);
+        gui->in_layout = false;
+    }
+
+    /* root's table alignment may have moved other tops */
+    if (array_length(layout_ents) > 0)
+    {
+        children = transform_get_children(gui_root);
+        nchildren = transform_get_num_children(gui_root);
+        for (i = 0; i < nchildren; ++i)
+            if ((gui = entitypool_get(gui_pool, children[i])))
+                gui->dirty_count = transform_get_dirty_count(children[i]);
+    }
+}
+
+/* merge tree_bbox of visible gui descendants into ent's, bottom-up */
+static void _common_update_tree_bbox(Entity ent)
+{
+    Gui *gui, *child;
+    Entity *children;
+    unsigned int nchildren, i;
+
+    gui = entitypool_get(gui_pool, ent);
+    gui->tree_bbox = gui->wbbox;
+
+    children = transform_get_children(ent);
+    nchildren = transform_get_num_children(ent);
+    for (i = 0; i < nchildren; ++i)
+        if ((child = entitypool_get(gui_pool, children[i])) && child->visible)
+        {
+            _common_update_tree_bbox(children[i]);
+            gui->tree_bbox = bbox_merge(gui->tree_bbox, child->tree_bbox);
+        }
+}
+
+static void _common_update_bounds()
+{
+    Gui *gui;
+    Entity ent, *top;
+    unsigned int world_dirty_count;
+
+    array_clear(hit_tops);
+    entitypool_foreach(gui, gui_pool)
+    {
+        ent = gui->pool_elem.ent;
+
+        /* world bbox */
+        world_dirty_count = transform_get_world_dirty_count(ent);
+        if (gui->wbbox_dirty || world_dirty_count != gui->world_dirty_count
+            || !vec2_eq(gui->bbox.min, gui->wbbox_src.min)
+            || !vec2_eq(gui->bbox.max, gui->wbbox_src.max))
+        {
+            gui->wbbox = bbox_transform(transform_get_world_matrix(ent),
+                                        gui->bbox);
+            gui->wbbox_src = gui->bbox;
+            gui->world_dirty_count = world_dirty_count;
+            gui->wbbox_dirty = false;
+        }
+
+        /* tree root? */
+        if (!entitypool_get(gui_pool, transform_get_parent(ent)))
+            array_add_val(Entity, hit_tops) = ent;
+    }
+
+    array_foreach(top, hit_tops)
+        if ((gui = entitypool_get(gui_pool, *top))->visible)
+            _common_update_tree_bbox(*top);
+}
+
+/* add visible guis under ent containing world point p to hits, pre-order */
+static void _common_hit_test_rec(Entity ent, Vec2 p, Array *hits)
+{
+    Gui *gui;
+    Entity *children;
+    unsigned int nchildren, i;
+
+    gui = entitypool_get(gui_pool, ent);
+    if (!(gui && gui->visible && bbox_contains(gui->tree_bbox, p)))
+        return;
+
+    /* world bbox is conservative, check exactly in entity space */
+    if (bbox_contains(gui->wbbox, p)
+        && !(edit_get_enabled() && edit_get_editable(ent))
+        && bbox_contains(gui->bbox,
+                         mat3_transform(mat3_inverse(
+                                            transform_get_world_matrix(ent)),
+                                        p)))
+        array_add_val(Entity, hits) = ent;
+
+    children = transform_get_children(ent);
+    nchildren = transform_get_num_children(ent);
+    for (i = 0; i < nchildren; ++i)
+        _common_hit_test_rec(children[i], p, hits);
+}
+static void _common_hit_test(Vec2 p, Array *hits)
+{
+    Entity *top;
+
+    array_clear(hits);
+    array_foreach(top, hit_tops)
+        _common_hit_test_rec(*top, p, hits);
+}
+
+static void _common_update_hovered()
+{
+    Entity *ent;
+    Gui *gui;
+
+    array_foreach(ent, hovered_ents)
+        if ((gui = entitypool_get(gui_pool, *ent)))
+            gui->hovered = false;
+
+    _common_hit_test(camera_unit_to_world(input_get_mouse_pos_unit()),
+                     hovered_ents);
+
+    array_foreach(ent, hovered_ents)
+    {
+        gui = entitypool_get(gui_pool, *ent);
+        gui->hovered = true;
+    }
+}
+
+Entity gui_get_hovered_entity()
+{
+    Entity *ent;
+
+    ent = array_end(hovered_ents);
+    while (ent != array_begin(hovered_ents))
+        if (entitypool_get(gui_pool, *--ent))
+            return *ent;
+    return entity_nil;
+}
+bool gui_get_hovered(Entity ent)
+{
+    Gui *gui = entitypool_get(gui_pool, ent);
+    error_assert(gui);
+    return gui->hovered;
+}
+Entity gui_get_entity_at(Vec2 p)
+{
+    _common_hit_test(p, mouse_event_ents);
+    if (array_length(mouse_event_ents) == 0)
+        return entity_nil;
+    return array_get_val(Entity, mouse_event_ents,
+                         array_length(mouse_event_ents) - 1);
+}
+
 static void _common_update_all()
 {
     Gui *gui;
 
-    _common_attach_root();
+    _common_update_bounds();
+    _common_update_hovered();
 
     /* update edit bboxes */
     if (edit_get_enabled())
@@ -417,38 +910,31 @@ static void _common_update_all()
 }
 
 /* 'focus_clear' is whether to clear focus if click outside */
-static void _common_mouse_event(EntityMap *emap, MouseCode mouse,
+static void _common_mouse_event(GuiEventType type, MouseCode mouse,
                                 bool focus_clear)
 {
     Gui *gui;
-    Vec2 m;
-    Mat3 t;
-    Entity ent;
+    Entity *ent;
     bool some_focused = false;
 
-    m = camera_unit_to_world(input_get_mouse_pos_unit());
-    entitypool_foreach(gui, gui_pool)
-        if (gui->visible
-            && !(edit_get_enabled() && edit_get_editable(gui->pool_elem.ent)))
-        {
-            ent = gui->pool_elem.ent;
-
-            t = mat3_inverse(transform_get_world_matrix(ent));
-            if (bbox_contains(gui->bbox, mat3_transform(t, m)))
-            {
-                entitymap_set(emap, ent, mouse);
+    /* bounds as of last update, which is what's on screen */
+    _common_hit_test(camera_unit_to_world(input_get_mouse_pos_unit()),
+                     mouse_event_ents);
+    array_foreach(ent, mouse_event_ents)
+    {
+        gui = entitypool_get(gui_pool, *ent);
+        _event_fire(*ent, type, mouse);
 
-                if (gui->captures_events)
-                    captured_event = true;
+        if (gui->captures_events)
+            captured_event = true;
 
-                /* focus? */
-                if (gui->focusable && mouse == MC_LEFT)
-                {
-                    some_focused = true;
-                    gui_set_focused_entity(ent);
-                }
-            }
+        /* focus? */
+        if (gui->focusable && mouse == MC_LEFT)
+        {
+            some_focused = true;
+            gui_set_focused_entity(*ent);
         }
+    }
 
     /* none focused? clear */
     if (focus_clear && !some_focused)
@@ -456,18 +942,18 @@ static void _common_mouse_event(EntityMap *emap, MouseCode mouse,
 }
 static void _common_mouse_down(MouseCode mouse)
 {
-    _common_mouse_event(mouse_down_map, mouse, true);
+    _common_mouse_event(GE_MOUSE_DOWN, mouse, true);
 }
 static void _common_mouse_up(MouseCode mouse)
 {
-    _common_mouse_event(mouse_up_map, mouse, false);
+    _common_mouse_event(GE_MOUSE_UP, mouse, false);
 }
 
 static void _common_key_down(KeyCode key)
 {
     if (!entity_eq(focused, entity_nil))
     {
-        entitymap_set(key_down_map, focused, key);
+        _event_fire(focused, GE_KEY_DOWN, key);
         captured_event = true;
     }
 }
@@ -475,7 +961,7 @@ static void _common_key_up(KeyCode key)
 {
     if (!entity_eq(focused, entity_nil))
     {
-        entitymap_set(key_up_map, focused, key);
+        _event_fire(focused, GE_KEY_UP, key);
         captured_event = true;
     }
 }
@@ -487,13 +973,7 @@ static void _common_char_down(unsigned int c)
 
 static void _common_event_clear()
 {
-    entitymap_clear(focus_enter_map);
-    entitymap_clear(focus_exit_map);
-    entitymap_clear(changed_map);
-    entitymap_clear(mouse_down_map);
-    entitymap_clear(mouse_up_map);
-    entitymap_clear(key_down_map);
-    entitymap_clear(key_up_map);
+    _event_clear();
     captured_event = false;
 }
 
@@ -531,9 +1011,37 @@ static void _common_load_all(Store *s)
             enum_load(&gui->halign, "halign", GA_NONE, gui_s);
             enum_load(&gui->valign, "valign", GA_NONE, gui_s);
             vec2_load(&gui->padding, "padding", vec2(5, 5), gui_s);
+            gui->parent = entity_nil;
+            gui->dirty_count = transform_get_dirty_count(gui->pool_elem.ent);
+            gui->layout_queued = false;
+            gui->in_layout = false;
+            gui->wbbox_dirty = true;
+            gui->hovered = false;
+            gui->visible_queued = false;
+            _common_visible_dirty(gui->pool_elem.ent);
         }
 
     _common_attach_root();
+    layout_all = true;
+}
+static void _common_clone(Entity from, Entity to)
+{
+    Gui *gui;
+
+    gui = entitypool_clone(gui_pool, from, to);
+    if (!gui)
+        return;
+
+    gui->parent = entity_nil;
+    gui->dirty_count = transform_get_dirty_count(to);
+    gui->layout_queued = false;
+    gui->in_layout = false;
+    gui->wbbox_dirty = true;
+    gui->hovered = false;
+    gui->visible_queued = false;
+
+    _common_visible_dirty(to);
+    _common_layout_dirty(to);
 }
 
 /* --- rect ---------------------------------------------------------------- */
@@ -575,9 +1083,16 @@ void gui_rect_add(Entity ent)
     rect->vfit = true;
     rect->hfill = false;
     rect->vfill = false;
+    rect->updated = false;
+    rect->depth = 0;
+    _rect_update_gui_props(ent);
+
+    _common_layout_dirty(ent);
 }
 void gui_rect_remove(Entity ent)
 {
+    if (entitypool_get(rect_pool, ent) && entitypool_get(gui_pool, ent))
+        _common_layout_dirty(ent);
     entitypool_remove(rect_pool, ent);
 }
 bool gui_rect_has(Entity ent)
@@ -589,6 +1104,8 @@ void gui_rect_set_size(Entity ent, Vec2 size)
 {
     Rect *rect = entitypool_get(rect_pool, ent);
     error_assert(rect);
+    if (!vec2_eq(rect->size, size))
+        _common_layout_dirty(ent);
     rect->size = size;
 }
 Vec2 gui_rect_get_size(Entity ent)
@@ -602,6 +1119,8 @@ void gui_rect_set_hfit(Entity ent, bool fit)
 {
     Rect *rect = entitypool_get(rect_pool, ent);
     error_assert(rect);
+    if (rect->hfit != fit)
+        _common_layout_dirty(ent);
     rect->hfit = fit;
 }
 bool gui_rect_get_hfit(Entity ent)
@@ -614,6 +1133,8 @@ void gui_rect_set_vfit(Entity ent, bool fit)
 {
     Rect *rect = entitypool_get(rect_pool, ent);
     error_assert(rect);
+    if (rect->vfit != fit)
+        _common_layout_dirty(ent);
     rect->vfit = fit;
 }
 bool gui_rect_get_vfit(Entity ent)
@@ -627,6 +1148,8 @@ void gui_rect_set_hfill(Entity ent, bool fill)
 {
     Rect *rect = entitypool_get(rect_pool, ent);
     error_assert(rect);
+    if (rect->hfill != fill)
+        _common_layout_dirty(ent);
     rect->hfill = fill;
 }
 bool gui_rect_get_hfill(Entity ent)
@@ -639,6 +1162,8 @@ void gui_rect_set_vfill(Entity ent, bool fill)
 {
     Rect *rect = entitypool_get(rect_pool, ent);
     error_assert(rect);
+    if (rect->vfill != fill)
+        _common_layout_dirty(ent);
     rect->vfill = fill;
 }
 bool gui_rect_get_vfill(Entity ent)
@@ -726,7 +1251,8 @@ static void _rect_update_table_align(Rect *rect)
             curr.y = b.min.y + delta;
         }
 
-        transform_set_position(children[i], pos);
+        if (!vec2_eq(pos, transform_get_position(children[i])))
+            transform_set_position(children[i], pos);
     }
 }
 
@@ -781,6 +1307,7 @@ static void _rect_update_child_first(Entity ent)
     _rect_update_fit(rect);
 
     gui->bbox = bbox_bound(vec2_zero, vec2(rect->size.x, -rect->size.y));
+    rect->updated = true;
 }
 
 static void _rect_update_parent_first(Entity ent);
@@ -846,37 +1373,61 @@ static void _rect_update_parent_first(Entity ent)
     _rect_update_depth(rect);
 
     gui->bbox = bbox_bound(vec2_zero, vec2(rect->size.x, -rect->size.y));
+    rect->updated = true;
+}
+
+static void _rect_update_destroyed()
+{
+    entitypool_remove_destroyed(rect_pool, gui_rect_remove);
+}
+
+/* rects outside layout_ents keep 'updated' set so they're used as is */
+static void _rect_reset_updated()
+{
+    Entity *ent;
+    Rect *rect;
+
+    array_foreach(ent, layout_ents)
+        if ((rect = entitypool_get(rect_pool, *ent)))
+            rect->updated = false;
 }
 
 static void _rect_update_all()
 {
+    Entity *ent;
     Rect *rect;
     Gui *gui;
 
-    entitypool_remove_destroyed(rect_pool, gui_rect_remove);
-
-    entitypool_foreach(rect, rect_pool)
-        rect->updated = false;
-    entitypool_foreach(rect, rect_pool)
-        _rect_update_child_first(rect->pool_elem.ent);
+    _rect_reset_updated();
+    array_foreach(ent, layout_ents)
+        _rect_update_child_first(*ent);
 
-    entitypool_foreach(rect, rect_pool)
-        rect->updated = false;
-    entitypool_foreach(rect, rect_pool)
-        _rect_update_parent_first(rect->pool_elem.ent);
+    _rect_reset_updated();
+    array_foreach(ent, layout_ents)
+        _rect_update_parent_first(*ent);
 
-    entitypool_foreach(rect, rect_pool)
-    {
-        gui = entitypool_get(gui_pool, rect->pool_elem.ent);
-        error_assert(gui);
+    /* write gui bbox */
+    array_foreach(ent, layout_ents)
+        if ((rect = entitypool_get(rect_pool, *ent)))
+        {
+            gui = entitypool_get(gui_pool, *ent);
+            gui->bbox = bbox_bound(vec2_zero,
+                                   vec2(rect->size.x, -rect->size.y));
+        }
+}
 
-        /* write gui bbox */
-        gui->bbox = bbox_bound(vec2_zero, vec2(rect->size.x, -rect->size.y));
+/* read gui properties, called when they change */
+static void _rect_update_gui_props(Entity ent)
+{
+    Rect *rect;
+    Gui *gui;
 
-        /* read gui properties */
-        rect->visible = gui->visible;
-        rect->color = gui->color;
-    }
+    if (!(rect = entitypool_get(rect_pool, ent)))
+        return;
+    gui = entitypool_get(gui_pool, ent);
+    error_assert(gui);
+    rect->visible = gui->visible;
+    rect->color = gui->color;
 }
 
 static void _rect_update_wmat()
@@ -894,27 +1445,15 @@ static int _rect_depth_compare(const void *a, const void *b)
     return ra->depth - rb->depth;
 }
 
-static void _rect_draw_all()
+/* depth sort, upload rects */
+static void _rect_draw_begin()
 {
-    unsigned int nrects;
-
     /* depth sort */
     entitypool_sort(rect_pool, _rect_depth_compare);
 
-    /* bind shader program */
-    glUseProgram(rect_program);
-    glUniformMatrix3fv(glGetUniformLocation(rect_program,
-                                            "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
-
-    /* draw! */
-    glBindVertexArray(rect_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, rect_vbo);
-    nrects = entitypool_size(rect_pool);
-    glBufferData(GL_ARRAY_BUFFER, nrects * sizeof(Rect),
-                 entitypool_begin(rect_pool), GL_STREAM_DRAW);
-    glDrawArrays(GL_POINTS, 0, nrects);
+    /* upload */
+    gfx_buffer_data(rect_vbo, entitypool_size(rect_pool) * sizeof(Rect),
+                    entitypool_begin(rect_pool), GL_STREAM_DRAW);
 }
 
 static void _rect_save_all(Store *s)
@@ -944,11 +1483,25 @@ static void _rect_load_all(Store *s)
             vec2_load(&rect->size, "size", vec2(64, 64), rect_s);
             color_load(&rect->color, "color", color_gray, rect_s);
             bool_load(&rect->hfit, "hfit", true, rect_s);
+            rect->updated = false;
             bool_load(&rect->vfit, "vfit", true, rect_s);
             bool_load(&rect->hfill, "hfill", false, rect_s);
             bool_load(&rect->vfill, "vfill", false, rect_s);
+            _rect_update_gui_props(rect->pool_elem.ent);
         }
 }
+static void _rect_clone(Entity from, Entity to)
+{
+    Rect *rect;
+
+    rect = entitypool_clone(rect_pool, from, to);
+    if (!rect)
+        return;
+
+    rect->updated = false;
+    _rect_update_gui_props(to);
+    _common_layout_dirty(to);
+}
 
 /* --- text ---------------------------------------------------------------- */
 
@@ -974,84 +1527,159 @@ struct Text
     EntityPoolElem pool_elem;
 
     char *str;
-    Array *chars;  /* per-character info buffered to shader */
-    Vec2 bounds;   /* max x, min y in size-less units */
+    TextChar *chars;  /* layout of each byte of str, newlines included */
+    unsigned int len; /* length of str, excluding null char */
+    unsigned int cap; /* space allocated in str and chars */
+
+    Vec2 end;    /* position of next character appended */
+    Vec2 bounds; /* max x, min y in size-less units, excluding cursor */
 
     int cursor;
+
+    int depth; /* for draw order -- above nearest ancestor rect */
+    unsigned int ninstances; /* in text_instances this frame */
 };
 
 static EntityPool *text_pool;
 
+/*
+ * per-character data for all visible text is gathered into one buffer each
+ * frame, sorted by depth, so text is drawn in one call per depth level
+ * rather than one per entity
+ */
+typedef struct TextInstance TextInstance;
+struct TextInstance
+{
+    Mat3 wmat;   /* world transform matrix of text entity */
+    Color color; /* color of text entity */
+    TextChar tc;
+};
+
+static Array *text_instances;
+
 static Scalar cursor_blink_time = 0;
 
-static void _text_add_cursor(Text *text, Vec2 pos)
+static Vec2 _text_cell(char c)
 {
-    TextChar *tc;
+    unsigned char u = c;
+    return vec2(u % TEXT_GRID_W, TEXT_GRID_H - 1 - (u / TEXT_GRID_W));
+}
 
-    /* compute position in font grid */
-    tc = array_add(text->chars);
-    tc->pos = pos;
-    tc->cell = vec2(' ' % TEXT_GRID_W, TEXT_GRID_H - 1 - (' ' / TEXT_GRID_W));
-    tc->is_cursor = 1;
+/* make space for len characters and a null char */
+static void _text_reserve(Text *text, unsigned int len)
+{
+    if (len < text->cap)
+        return;
+
+    text->cap = len + 1 < 2 * text->cap ? 2 * text->cap : len + 1;
+    text->str = realloc(text->str, text->cap);
+    text->chars = realloc(text->chars, text->cap * sizeof(TextChar));
 }
 
-/* just update with existing string if str is NULL */
-static void _text_set_str(Text *text, const char *str)
+/* position of character i, end if i is len */
+static Vec2 _text_pos(Text *text, unsigned int i)
 {
-    char c;
-    TextChar *tc;
-    Vec2 pos;
-    int i = 0;
+    return i < text->len ? text->chars[i].pos : text->end;
+}
 
-    /* copy to struct? */
-    if (str)
-    {
-        free(text->str);
-        text->str = malloc(strlen(str) + 1);
-        strcpy(text->str, str);
-    }
-    else
-        str = text->str;
+/* position of character after character i */
+static Vec2 _text_next_pos(Text *text, unsigned int i)
+{
+    Vec2 pos = text->chars[i].pos;
+    if (text->str[i] == '\n')
+        return vec2(0, pos.y - 1);
+    return vec2(pos.x + 1, pos.y);
+}
 
-    /* create TextChar array and update bounds */
-    pos = vec2(0, -1);
-    text->bounds = vec2(1, -1);
-    array_clear(text->chars);
-    while (*str)
-    {
-        if (i++ == text->cursor)
-            _text_add_cursor(text, pos);
+/* index of first newline at or after i, len if none */
+static unsigned int _text_line_end(Text *text, unsigned int i)
+{
+    for (; i < text->len && text->str[i] != '\n'; ++i);
+    return i;
+}
 
-        c = *str++;
-        switch (c)
-        {
-            case '\n':
-                /* next line */
-                pos.x = 0;
-                pos.y -= 1;
-                continue;
-        }
+/* max width of lines that end within [a, b] */
+static Scalar _text_max_width(Text *text, unsigned int a, unsigned int b)
+{
+    Scalar w = 0;
 
-        /* compute position in font grid */
-        tc = array_add(text->chars);
-        tc->pos = pos;
-        tc->cell = vec2(c % TEXT_GRID_W, TEXT_GRID_H - 1 - (c / TEXT_GRID_W));
-        tc->is_cursor = -1;
+    for (; a <= b && a < text->len; ++a)
+        if (text->str[a] == '\n')
+            w = scalar_max(w, text->chars[a].pos.x);
+    if (b >= text->len)
+        w = scalar_max(w, text->end.x);
+    return w;
+}
 
-        /* move ahead */
-        pos.x += 1;
-        text->bounds.x = scalar_max(text->bounds.x, pos.x);
+/*
+ * replace n characters at start with s -- only the lines touched are laid
+ * out again, following lines are just moved up or down and bounds are only
+ * recomputed fully if the widest line got narrower
+ */
+static void _text_replace(Text *text, unsigned int start, unsigned int n,
+                          const char *s)
+{
+    unsigned int slen, len, old_e, e, i;
+    Scalar old_w, w;
+    Vec2 old_epos, pos;
+
+    slen = strlen(s);
+
+    /* remember extent of lines touched */
+    old_e = _text_line_end(text, start + n);
+    old_epos = _text_pos(text, old_e);
+    old_w = _text_max_width(text, start, old_e);
+
+    /* splice str, chars */
+    len = text->len - n + slen;
+    _text_reserve(text, len);
+    memmove(&text->str[start + slen], &text->str[start + n],
+            text->len - start - n + 1);
+    memmove(&text->chars[start + slen], &text->chars[start + n],
+            (text->len - start - n) * sizeof(TextChar));
+    memcpy(&text->str[start], s, slen);
+    text->len = len;
+    e = old_e - n + slen;
+
+    /* lay out lines touched */
+    pos = start > 0 ? _text_next_pos(text, start - 1) : vec2(0, -1);
+    for (i = start; i <= e && i < len; ++i)
+    {
+        text->chars[i].pos = pos;
+        text->chars[i].cell = _text_cell(text->str[i]);
+        text->chars[i].is_cursor = -1;
+        pos = _text_next_pos(text, i);
     }
 
-    /* cursor at end? */
-    if (i == text->cursor)
+    /* move following lines */
+    if (e >= len)
+        text->end = pos;
+    else if (text->chars[e].pos.y != old_epos.y)
     {
-        _text_add_cursor(text, pos);
-        pos.x += 1;
-        text->bounds.x = scalar_max(text->bounds.x, pos.x);
+        for (i = e + 1; i < len; ++i)
+            text->chars[i].pos.y += text->chars[e].pos.y - old_epos.y;
+        text->end.y += text->chars[e].pos.y - old_epos.y;
     }
 
-    text->bounds.y = pos.y;
+    /* update bounds */
+    w = _text_max_width(text, start, e);
+    if (w >= text->bounds.x)
+        text->bounds.x = w;
+    else if (old_w >= text->bounds.x)
+        text->bounds.x = scalar_max(1, _text_max_width(text, 0, len));
+    text->bounds.y = text->end.y;
+}
+
+/* empty string, layout */
+static void _text_init_str(Text *text)
+{
+    text->str = NULL;
+    text->chars = NULL;
+    text->len = text->cap = 0;
+    _text_reserve(text, 0);
+    text->str[0] = '\0';
+    text->end = vec2(0, -1);
+    text->bounds = vec2(1, -1);
 }
 
 void gui_text_add(Entity ent)
@@ -1064,10 +1692,12 @@ void gui_text_add(Entity ent)
     gui_add(ent);
 
     text = entitypool_add(text_pool, ent);
-    text->chars = array_new(TextChar);
-    text->str = NULL; /* _text_set_str(...) calls free(text->str) */
+    _text_init_str(text);
     text->cursor = -1;
-    _text_set_str(text, "");
+    text->depth = 0;
+    text->ninstances = 0;
+
+    _common_layout_dirty(ent);
 }
 void gui_text_remove(Entity ent)
 {
@@ -1075,7 +1705,9 @@ void gui_text_remove(Entity ent)
     if (text)
     {
         free(text->str);
-        array_free(text->chars);
+        free(text->chars);
+        if (entitypool_get(gui_pool, ent))
+            _common_layout_dirty(ent);
     }
     entitypool_remove(text_pool, ent);
 }
@@ -1088,7 +1720,8 @@ void gui_text_set_str(Entity ent, const char *str)
 {
     Text *text = entitypool_get(text_pool, ent);
     error_assert(text);
-    _text_set_str(text, str);
+    if (str != text->str && strcmp(str, text->str))
+        _text_replace(text, 0, text->len, str);
 }
 const char *gui_text_get_str(Entity ent)
 {
@@ -1097,44 +1730,81 @@ const char *gui_text_get_str(Entity ent)
     return text->str;
 }
 
-static void _text_set_cursor(Entity ent, int cursor)
+void gui_text_append(Entity ent, const char *str)
+{
+    Text *text = entitypool_get(text_pool, ent);
+    error_assert(text);
+    _text_replace(text, text->len, 0, str);
+}
+void gui_text_replace(Entity ent, unsigned int start, unsigned int n,
+                      const char *str)
+{
+    Text *text = entitypool_get(text_pool, ent);
+    error_assert(text);
+    if (start > text->len)
+        start = text->len;
+    if (n > text->len - start)
+        n = text->len - start;
+    _text_replace(text, start, n, str);
+}
+unsigned int gui_text_get_len(Entity ent)
+{
+    Text *text = entitypool_get(text_pool, ent);
+    error_assert(text);
+    return text->len;
+}
+
+void gui_text_set_cursor(Entity ent, int cursor)
 {
     Text *text = entitypool_get(text_pool, ent);
     error_assert(text);
     text->cursor = cursor;
-    _text_set_str(text, NULL);
 }
 
 static GLuint text_program;
 static GLuint text_vao;
 static GLuint text_vbo;
+static GLint text_inv_grid_size_loc, text_size_loc, text_cursor_blink_loc;
+static TextureHandle font;
 
 static void _text_init()
 {
-    /* init pool */
+    /* init pool, instance buffer */
     text_pool = entitypool_new(Text);
+    text_instances = array_new(TextInstance);
 
     /* create shader program, load texture, bind parameters */
     text_program = gfx_create_program(data_path("text.vert"),
                                       data_path("text.geom"),
                                       data_path("text.frag"));
     glUseProgram(text_program);
-    texture_load(data_path("font1.png"));
+    font = texture_load(data_path("font1.png"));
     glUniform1i(glGetUniformLocation(text_program, "tex0"), 0);
-    glUniform2f(glGetUniformLocation(text_program, "inv_grid_size"),
-                1.0 / TEXT_GRID_W, 1.0 / TEXT_GRID_H);
-    glUniform2f(glGetUniformLocation(text_program, "size"),
-                TEXT_FONT_W, TEXT_FONT_H);
+    text_inv_grid_size_loc = glGetUniformLocation(text_program,
+                                                  "inv_grid_size");
+    text_size_loc = glGetUniformLocation(text_program, "size");
+    text_cursor_blink_loc = glGetUniformLocation(text_program,
+                                                 "cursor_blink");
 
     /* make vao, vbo, bind attributes */
     glGenVertexArrays(1, &text_vao);
     glBindVertexArray(text_vao);
     glGenBuffers(1, &text_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 2, "pos", TextChar, pos);
-    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 2, "cell", TextChar, cell);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 3, "wmat1",
+                           TextInstance, wmat.m[0]);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 3, "wmat2",
+                           TextInstance, wmat.m[1]);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 3, "wmat3",
+                           TextInstance, wmat.m[2]);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 4, "color",
+                           TextInstance, color);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 2, "pos",
+                           TextInstance, tc.pos);
+    gfx_bind_vertex_attrib(text_program, GL_FLOAT, 2, "cell",
+                           TextInstance, tc.cell);
     gfx_bind_vertex_attrib(text_program, GL_FLOAT, 1, "is_cursor",
-                           TextChar, is_cursor);
+                           TextInstance, tc.is_cursor);
 }
 static void _text_deinit()
 {
@@ -1149,15 +1819,18 @@ static void _text_deinit()
     entitypool_foreach(text, text_pool)
     {
         free(text->str);
-        array_free(text->chars);
+        free(text->chars);
     }
     entitypool_free(text_pool);
+    array_free(text_instances);
 }
 
 static void _text_update_all()
 {
     Text *text;
     Gui *gui;
+    Vec2 bounds;
+    BBox bbox;
     static Vec2 size = { TEXT_FONT_W, TEXT_FONT_H };
 
     cursor_blink_time += 2 * timing_true_dt;
@@ -1170,60 +1843,108 @@ static void _text_update_all()
         if (gui_event_focus_enter(text->pool_elem.ent))
             cursor_blink_time = 1;
 
-        /* gui bbox */
+        /* gui bbox, with space for cursor at end */
+        bounds = text->bounds;
+        if (text->cursor == (int) text->len)
+            bounds.x = scalar_max(bounds.x, text->end.x + 1);
         gui = entitypool_get(gui_pool, text->pool_elem.ent);
         error_assert(gui);
-        gui->bbox = bbox_bound(vec2_zero, vec2_mul(size, text->bounds));
+        bbox = bbox_bound(vec2_zero, vec2_mul(size, bounds));
+        if (!vec2_eq(bbox.min, gui->bbox.min)
+            || !vec2_eq(bbox.max, gui->bbox.max))
+        {
+            gui->bbox = bbox;
+            _common_layout_dirty(text->pool_elem.ent);
+        }
     }
 }
 
-static void _text_draw_all()
+/* depth is one more than that of nearest ancestor rect, 0 if none */
+static void _text_update_depth()
 {
-    Vec2 hwin;
     Text *text;
-    Gui *gui;
-    Mat3 wmat;
-    unsigned int nchars;
+    Rect *rect;
+    Entity *lent, ent;
 
-    hwin = vec2_scalar_mul(game_get_window_size(), 0.5);
+    array_foreach(lent, layout_ents)
+    {
+        if (!(text = entitypool_get(text_pool, *lent)))
+            continue;
+        text->depth = 0;
+        for (ent = transform_get_parent(text->pool_elem.ent);
+             !entity_eq(ent, entity_nil); ent = transform_get_parent(ent))
+            if ((rect = entitypool_get(rect_pool, ent)))
+            {
+                text->depth = rect->depth + 1;
+                break;
+            }
+    }
+}
 
-    /* bind shader program */
-    glUseProgram(text_program);
-    glUniform1f(glGetUniformLocation(text_program, "cursor_blink"),
-                ((int) cursor_blink_time) & 1);
-    glUniformMatrix3fv(glGetUniformLocation(text_program,
-                                            "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
+static int _text_depth_compare(const void *a, const void *b)
+{
+    const Text *ta = a, *tb = b;
+    if (ta->depth == tb->depth)
+        return ((int) ta->pool_elem.ent.id) - ((int) tb->pool_elem.ent.id);
+    return ta->depth - tb->depth;
+}
 
+/* depth sort, gather characters of visible text into text_instances */
+static void _text_gather()
+{
+    Text *text;
+    Gui *gui;
+    TextInstance *inst;
+    Mat3 wmat;
+    unsigned int i;
 
-    /* bind texture */
-    glActiveTexture(GL_TEXTURE0);
-    texture_bind(data_path("font1.png"));
+    entitypool_sort(text_pool, _text_depth_compare);
 
-    /* draw! */
+    array_clear(text_instances);
     entitypool_foreach(text, text_pool)
     {
+        text->ninstances = 0;
         gui = entitypool_get(gui_pool, text->pool_elem.ent);
         error_assert(gui);
         if (!gui->visible)
             continue;
-        glUniform4fv(glGetUniformLocation(text_program, "base_color"), 1,
-                     (const GLfloat *) &gui->color);
 
         wmat = transform_get_world_matrix(text->pool_elem.ent);
-        glUniformMatrix3fv(glGetUniformLocation(text_program, "wmat"),
-                           1, GL_FALSE, (const GLfloat *) &wmat);
-
-        glBindVertexArray(text_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, text_vbo);
-        nchars = array_length(text->chars);
-        glBufferData(GL_ARRAY_BUFFER, nchars * sizeof(TextChar),
-                     array_begin(text->chars), GL_STREAM_DRAW);
-        glDrawArrays(GL_POINTS, 0, nchars);
+
+        /* characters other than newlines */
+        for (i = 0; i < text->len; ++i)
+            if (text->str[i] != '\n')
+            {
+                inst = array_add(text_instances);
+                inst->wmat = wmat;
+                inst->color = gui->color;
+                inst->tc = text->chars[i];
+                ++text->ninstances;
+            }
+
+        /* cursor, drawn at position of character it's before */
+        if (text->cursor >= 0 && text->cursor <= (int) text->len)
+        {
+            inst = array_add(text_instances);
+            inst->wmat = wmat;
+            inst->color = gui->color;
+            inst->tc.pos = _text_pos(text, text->cursor);
+            inst->tc.cell = _text_cell(' ');
+            inst->tc.is_cursor = 1;
+            ++text->ninstances;
+        }
     }
 }
 
+/* upload text_instances -- call _text_gather() first */
+static void _text_draw_begin()
+{
+    /* upload */
+    gfx_buffer_data(text_vbo,
+                    array_length(text_instances) * sizeof(TextInstance),
+                    array_begin(text_instances), GL_STREAM_DRAW);
+}
+
 static void _text_save_all(Store *s)
 {
     Store *t, *text_s;
@@ -1240,17 +1961,37 @@ static void _text_load_all(Store *s)
 {
     Store *t, *text_s;
     Text *text;
+    char *tstr;
 
     if (store_child_load(&t, "gui_text", s))
         entitypool_load_foreach(text, text_s, text_pool, "pool", t)
         {
-            text->chars = array_new(TextChar);
-            string_load(&text->str, "str", "", text_s);
+            _text_init_str(text);
+            if (string_load(&tstr, "str", NULL, text_s))
+            {
+                _text_replace(text, 0, 0, tstr);
+                free(tstr);
+            }
             int_load(&text->cursor, "cursor", -1, text_s);
-            _text_set_str(text, NULL);
+            text->depth = 0;
+            text->ninstances = 0;
         }
 }
+static void _text_clone(Entity from, Entity to)
+{
+    Text *text, *src;
+
+    text = entitypool_clone(text_pool, from, to);
+    if (!text)
+        return;
+    src = entitypool_get(text_pool, from);
 
+    _text_init_str(text);
+    _text_replace(text, 0, 0, src->str);
+    text->depth = 0;
+    text->ninstances = 0;
+    _common_layout_dirty(to);
+}
 /* --- textedit ------------------------------------------------------------ */
 
 typedef struct TextEdit TextEdit;
@@ -1335,10 +2076,11 @@ static void _textedit_deinit()
     entitypool_free(textedit_pool);
 }
 
-static bool _textedit_set_str(TextEdit *textedit, const char *str)
+static bool _textedit_replace(TextEdit *textedit, unsigned int start,
+                              unsigned int n, const char *str)
 {
-    gui_text_set_str(textedit->pool_elem.ent, str);
-    entitymap_set(changed_map, textedit->pool_elem.ent, true);
+    gui_text_replace(textedit->pool_elem.ent, start, n, str);
+    _event_fire(textedit->pool_elem.ent, GE_CHANGED, true);
     return true;
 }
 
@@ -1348,7 +2090,7 @@ static void _textedit_key_event(KeyCode key, unsigned int c)
     Entity ent;
     TextEdit *textedit;
     const char *old;
-    char *new = NULL;
+    char new[2];
 
     textedit = entitypool_get(textedit_pool, focused);
     if (!textedit)
@@ -1386,24 +2128,17 @@ static void _textedit_key_event(KeyCode key, unsigned int c)
             if (textedit->cursor > 0)
                 --textedit->cursor;
 
-        new = malloc(strlen(old)); /* 1 less, but 1 more for null */
-        strncpy(new, old, textedit->cursor);
-        strcpy(&new[textedit->cursor], &old[textedit->cursor + 1]);
-        _textedit_set_str(textedit, new);
+        _textedit_replace(textedit, textedit->cursor, 1, "");
     }
 
     /* insert char */
     else if (isprint(c))
     {
-        new = malloc(strlen(old) + 2); /* 1 for new char, 1 for null */
-        strncpy(new, old, textedit->cursor);
-        new[textedit->cursor] = (char) c;
-        strcpy(&new[textedit->cursor + 1], &old[textedit->cursor]);
-        if (_textedit_set_str(textedit, new))
+        new[0] = (char) c;
+        new[1] = '\0';
+        if (_textedit_replace(textedit, textedit->cursor, 0, new))
             ++textedit->cursor;
     }
-
-    free(new);
 }
 
 static void _textedit_char_down(unsigned int c)
@@ -1430,9 +2165,9 @@ static void _textedit_update_all()
 
         /* focus stuff */
         if (gui_get_focus(ent))
-            _text_set_cursor(ent, textedit->cursor);
+            gui_text_set_cursor(ent, textedit->cursor);
         else
-            _text_set_cursor(ent, -1);
+            gui_text_set_cursor(ent, -1);
     }
 }
 
@@ -1460,6 +2195,10 @@ static void _textedit_load_all(Store *s)
             bool_load(&textedit->numerical, "numerical", false, textedit_s);
         }
 }
+static void _textedit_clone(Entity from, Entity to)
+{
+    entitypool_clone(textedit_pool, from, to);
+}
 
 /* ------------------------------------------------------------------------- */
 
@@ -1499,38 +2238,104 @@ void gui_deinit()
 
 static void _update_root()
 {
-    Vec2 win_size;
+    Vec2 win_size, scale;
+    Entity camera;
 
     win_size = game_get_window_size();
 
     edit_set_editable(gui_root, false);
 
     /* child of camera so GUI stays on screen */
-    transform_set_parent(gui_root, camera_get_current_camera());
+    camera = camera_get_current_camera();
+    if (!entity_eq(transform_get_parent(gui_root), camera))
+        transform_set_parent(gui_root, camera);
 
     /* use pixel coordinates */
-    transform_set_scale(gui_root, scalar_vec2_div(2, win_size));
-    gui_rect_set_size(gui_root, win_size);
+    scale = scalar_vec2_div(2, win_size);
+    if (!vec2_eq(scale, transform_get_scale(gui_root)))
+        transform_set_scale(gui_root, scale);
+    gui_rect_set_size(gui_root, win_size); /* relayout all if changed */
 }
 
 void gui_update_all()
 {
     _update_root();
     _common_update_destroyed();
+    _rect_update_destroyed();
+    _common_attach_root();
+    _common_update_changed();
     _common_update_visible();
-    _common_reset_align();
     _textedit_update_all();
     _text_update_all();
+
+    /* only redo layout of changed subtrees */
+    _common_layout_begin();
+    _common_reset_align();
     _rect_update_all();
     _common_update_align();
+    _text_update_depth();
+    _common_layout_end();
+
     _rect_update_wmat();
     _common_update_all();
 }
 
+/*
+ * rects and text are each drawn from a single buffer, but interleaved by
+ * depth level so that text in a window is drawn over the window and under
+ * windows in front of it -- at each level rects go below text
+ */
 void gui_draw_all()
 {
-    _rect_draw_all();
-    _text_draw_all();
+    Rect *rects;
+    Text *text, *text_end;
+    GfxDraw *draw;
+    GLuint font_gl_name;
+    unsigned int nrects, r, r0, t, t0;
+    int depth;
+
+    _text_gather();
+    _text_draw_begin();
+    _rect_draw_begin();
+
+    rects = entitypool_begin(rect_pool);
+    nrects = entitypool_size(rect_pool);
+    text = entitypool_begin(text_pool);
+    text_end = entitypool_end(text_pool);
+
+    font_gl_name = texture_get_gl_name(font);
+
+    r = t = 0;
+    while (r < nrects || text != text_end)
+    {
+        /* next depth level */
+        if (r < nrects && (text == text_end || rects[r].depth <= text->depth))
+            depth = rects[r].depth;
+        else
+            depth = text->depth;
+
+        /* rects at this level */
+        for (r0 = r; r < nrects && rects[r].depth == depth; ++r);
+        if (r > r0)
+            gfx_draw(GFX_LAYER_GUI, 2 * depth, rect_program, rect_vao,
+                     GL_POINTS, r0, r - r0);
+
+        /* text at this level */
+        for (t0 = t; text != text_end && text->depth == depth; ++text)
+            t += text->ninstances;
+        if (t > t0)
+        {
+            draw = gfx_draw(GFX_LAYER_GUI, 2 * depth + 1, text_program,
+                            text_vao, GL_POINTS, t0, t - t0);
+            gfx_draw_texture(draw, GL_TEXTURE_2D, font_gl_name);
+            gfx_draw_uniform_vec2(draw, text_inv_grid_size_loc,
+                                  vec2(1.0 / TEXT_GRID_W, 1.0 / TEXT_GRID_H));
+            gfx_draw_uniform_vec2(draw, text_size_loc,
+                                  vec2(TEXT_FONT_W, TEXT_FONT_H));
+            gfx_draw_uniform_float(draw, text_cursor_blink_loc,
+                                   ((int) cursor_blink_time) & 1);
+        }
+    }
 }
 
 void gui_key_down(KeyCode key)
@@ -1570,3 +2375,10 @@ void gui_load_all(Store *s)
     _text_load_all(s);
     _textedit_load_all(s);
 }
+void gui_clone(Entity from, Entity to)
+{
+    _common_clone(from, to);
+    _rect_clone(from, to);
+    _text_clone(from, to);
+    _textedit_clone(from, to);
+}
@@ -66,9 +66,42 @@ SCRIPT(gui,
        EXPORT KeyCode gui_event_key_down(Entity ent);
        EXPORT KeyCode gui_event_key_up(Entity ent);
 
+       /* for iterating over just the events fired this frame */
+       typedef enum GuiEventType GuiEventType;
+       enum GuiEventType
+       {
+           GE_FOCUS_ENTER = 0,
+           GE_FOCUS_EXIT  = 1,
+           GE_CHANGED     = 2,
+           GE_MOUSE_DOWN  = 3,
+           GE_MOUSE_UP    = 4,
+           GE_KEY_DOWN    = 5,
+           GE_KEY_UP      = 6,
+           GE_NUM         = 7,
+       };
+
+       typedef struct GuiEvent GuiEvent;
+       struct GuiEvent
+       {
+           Entity ent;
+           GuiEventType type;
+           int value; /* true, MouseCode or KeyCode as for queries above */
+       };
+
+       EXPORT unsigned int gui_event_get_num();
+       EXPORT GuiEvent gui_event_get_nth(unsigned int n);
+
        /* whether some gui element captured the current event */
        EXPORT bool gui_captured_event();
 
+       /*
+        * visible gui under mouse as of last update -- if several overlap,
+        * the topmost, entity_nil if none
+        */
+       EXPORT Entity gui_get_hovered_entity();
+       EXPORT bool gui_get_hovered(Entity ent); /* any overlapping counts */
+       EXPORT Entity gui_get_entity_at(Vec2 p); /* p in world space */
+
        /* gui_rect */
 
        EXPORT void gui_rect_add(Entity ent);
@@ -96,6 +129,18 @@ SCRIPT(gui,
 
        EXPORT void gui_text_set_str(Entity ent, const char *str);
        EXPORT const char *gui_text_get_str(Entity ent);
+       EXPORT unsigned int gui_text_get_len(Entity ent);
+
+       /*
+        * these only lay out again the lines they touch, so are much cheaper
+        * than gui_text_set_str(...) for small changes to long text --
+        * replace(...) replaces n characters at start, clamped to string
+        */
+       EXPORT void gui_text_append(Entity ent, const char *str);
+       EXPORT void gui_text_replace(Entity ent, unsigned int start,
+                                    unsigned int n, const char *str);
+
+       /* cursor drawn before character at this index, -1 for none */
        EXPORT void gui_text_set_cursor(Entity ent, int cursor);
 
        /* gui_textedit */
@@ -126,5 +171,6 @@ void gui_mouse_down(MouseCode mouse);
 void gui_mouse_up(MouseCode mouse);
 void gui_save_all(Store *s);
 void gui_load_all(Store *s);
+void gui_clone(Entity from, Entity to);
 
 #endif
@@ -0,0 +1,110 @@
+#ifdef CGAME_LINUX
+#define _GNU_SOURCE /* for MAP_POPULATE */
+#endif
+
+#include "mapfile.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifndef CGAME_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct MapFile
+{
+    void *data;
+    size_t size;
+};
+
+#ifndef CGAME_WINDOWS
+
+MapFile *mapfile_open(const char *filename)
+{
+    MapFile *map;
+    struct stat st;
+    int fd, flags = MAP_PRIVATE;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = malloc(sizeof(MapFile));
+    map->size = st.st_size;
+    map->data = NULL;
+    if (map->size > 0)
+    {
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE; /* read it all in now rather than on access */
+#endif
+        map->data = mmap(NULL, map->size, PROT_READ, flags, fd, 0);
+        if (map->data == MAP_FAILED)
+        {
+            close(fd);
+            free(map);
+            return NULL;
+        }
+    }
+    close(fd); /* mapping stays valid */
+    return map;
+}
+
+void mapfile_close(MapFile *map)
+{
+    if (map->data)
+        munmap(map->data, map->size);
+    free(map);
+}
+
+#else
+
+MapFile *mapfile_open(const char *filename)
+{
+    MapFile *map;
+    FILE *file;
+    long size;
+
+    if (!(file = fopen(filename, "rb")))
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    rewind(file);
+
+    map = malloc(sizeof(MapFile));
+    map->size = size;
+    map->data = malloc(size > 0 ? size : 1);
+    if (fread(map->data, 1, size, file) != (size_t) size)
+    {
+        fclose(file);
+        free(map->data);
+        free(map);
+        return NULL;
+    }
+    fclose(file);
+    return map;
+}
+
+void mapfile_close(MapFile *map)
+{
+    free(map->data);
+    free(map);
+}
+
+#endif
+
+const void *mapfile_data(MapFile *map)
+{
+    return map->data;
+}
+size_t mapfile_size(MapFile *map)
+{
+    return map->size;
+}
+
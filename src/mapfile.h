@@ -0,0 +1,20 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+/*
+ * read-only view of a whole file -- mmap(...)'d where available, else read
+ * into memory
+ */
+
+typedef struct MapFile MapFile;
+
+MapFile *mapfile_open(const char *filename); /* NULL on error */
+void mapfile_close(MapFile *map);
+
+const void *mapfile_data(MapFile *map);
+size_t mapfile_size(MapFile *map);
+
+#endif
+
@@ -11,7 +11,6 @@
 #include "transform.h"
 #include "gfx.h"
 #include "dirs.h"
-#include "camera.h"
 #include "edit.h"
 #include "entitymap.h"
 
@@ -609,6 +608,8 @@ NearestResult physics_nearest(Vec2 point, Scalar max_dist)
 static GLuint program;
 static GLuint vao;
 static GLuint vbo;
+static GLint wmat_loc, offset_loc, radius_loc;
+static Array *draw_verts; /* Vec2, all shapes drawn this frame */
 
 void physics_init()
 {
@@ -625,17 +626,22 @@ void physics_init()
                                  NULL,
                                  data_path("phypoly.frag"));
     glUseProgram(program);
+    wmat_loc = glGetUniformLocation(program, "wmat");
+    offset_loc = glGetUniformLocation(program, "offset");
+    radius_loc = glGetUniformLocation(program, "radius");
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "position", Vec2, x);
+    draw_verts = array_new(Vec2);
 }
 void physics_deinit()
 {
     PhysicsInfo *info;
 
     /* clean up draw stuff */
+    array_free(draw_verts);
     glDeleteProgram(program);
     glDeleteBuffers(1, &vbo);
     glDeleteVertexArrays(1, &vao);
@@ -759,6 +765,24 @@ void physics_post_update_all()
 
 /* --- draw ---------------------------------------------------------------- */
 
+/* outline and vertices of shape at draw_verts[first, first + nverts) */
+static void _shape_draw(unsigned int first, unsigned int nverts, Mat3 wmat,
+                        Vec2 offset, Scalar radius)
+{
+    GfxDraw *draw;
+    GLenum modes[] = { GL_LINE_LOOP, GL_POINTS };
+    unsigned int i;
+
+    for (i = 0; i < 2; ++i)
+    {
+        draw = gfx_draw(GFX_LAYER_PHYSICS, 0, program, vao, modes[i],
+                        first, nverts);
+        gfx_draw_uniform_mat3(draw, wmat_loc, wmat);
+        gfx_draw_uniform_vec2(draw, offset_loc, offset);
+        gfx_draw_uniform_float(draw, radius_loc, radius);
+    }
+}
+
 static void _circle_draw(PhysicsInfo *info, ShapeInfo *shapeInfo)
 {
     static Vec2 verts[] = {
@@ -768,6 +792,7 @@ static void _circle_draw(PhysicsInfo *info, ShapeInfo *shapeInfo)
         {  0.0, -1.0 }, {  0.7071, -0.7071 },
     }, offset;
     const unsigned int nverts = sizeof(verts) / sizeof(verts[0]);
+    unsigned int i, first;
     Scalar r;
     Mat3 wmat;
 
@@ -775,49 +800,26 @@ static void _circle_draw(PhysicsInfo *info, ShapeInfo *shapeInfo)
     offset = vec2_of_cpv(cpCircleShapeGetOffset(shapeInfo->shape));
     r = cpCircleShapeGetRadius(shapeInfo->shape);
 
-    glUniformMatrix3fv(glGetUniformLocation(program, "wmat"),
-                       1, GL_FALSE, (const GLfloat *) &wmat);
-    glUniform2fv(glGetUniformLocation(program, "offset"),
-                 1, (const GLfloat *) &offset);
-    glUniform1f(glGetUniformLocation(program, "radius"), r);
-
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(Vec2),
-                 verts, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINE_LOOP, 0, nverts);
-    glDrawArrays(GL_POINTS, 0, nverts);
+    first = array_length(draw_verts);
+    for (i = 0; i < nverts; ++i)
+        array_add_val(Vec2, draw_verts) = verts[i];
+    _shape_draw(first, nverts, wmat, offset, r);
 }
 
 static void _polygon_draw(PhysicsInfo *info, ShapeInfo *shapeInfo)
 {
-    unsigned int i, nverts;
-    Vec2 *verts;
+    unsigned int i, nverts, first;
     Mat3 wmat;
 
     wmat = transform_get_world_matrix(info->pool_elem.ent);
-    glUniformMatrix3fv(glGetUniformLocation(program, "wmat"),
-                       1, GL_FALSE, (const GLfloat *) &wmat);
-
-    glUniformMatrix3fv(glGetUniformLocation(program, "wmat"),
-                       1, GL_FALSE, (const GLfloat *) &wmat);
-    glUniform2f(glGetUniformLocation(program, "offset"), 0, 0);
-    glUniform1f(glGetUniformLocation(program, "radius"), 1);
 
     /* copy as Vec2 array */
     nverts = cpPolyShapeGetNumVerts(shapeInfo->shape);
-    verts = malloc(nverts * sizeof(Vec2));
+    first = array_length(draw_verts);
     for (i = 0; i < nverts; ++i)
-        verts[i] = vec2_of_cpv(cpPolyShapeGetVert(shapeInfo->shape, i));
-
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(Vec2),
-                 verts, GL_STREAM_DRAW);
-    glDrawArrays(GL_LINE_LOOP, 0, nverts);
-    glDrawArrays(GL_POINTS, 0, nverts);
-
-    free(verts);
+        array_add_val(Vec2, draw_verts)
+            = vec2_of_cpv(cpPolyShapeGetVert(shapeInfo->shape, i));
+    _shape_draw(first, nverts, wmat, vec2_zero, 1);
 }
 
 void physics_draw_all()
@@ -828,13 +830,8 @@ void physics_draw_all()
     if (!edit_get_enabled())
         return;
 
-    /* bind program, update uniforms */
-    glUseProgram(program);
-    glUniformMatrix3fv(glGetUniformLocation(program, "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
-
     /* draw! */
+    array_clear(draw_verts);
     entitypool_foreach(info, pool)
         if (entitymap_get(debug_draw_map, info->pool_elem.ent))
             array_foreach(shapeInfo, info->shapes)
@@ -848,6 +845,10 @@ void physics_draw_all()
                         _polygon_draw(info, shapeInfo);
                         break;
                 }
+
+    /* upload all shapes' vertices at once */
+    gfx_buffer_data(vbo, array_length(draw_verts) * sizeof(Vec2),
+                    array_begin(draw_verts), GL_STREAM_DRAW);
 }
 
 /* --- save/load ----------------------------------------------------------- */
@@ -1143,3 +1144,83 @@ void physics_load_all(Store *s)
         }
 }
 
+
+/* --- clone --------------------------------------------------------------- */
+
+/* copy of a shape on another body, not yet in space */
+static cpShape *_shape_clone(ShapeInfo *shapeInfo, cpBody *body)
+{
+    cpShape *src, *shape;
+
+    src = shapeInfo->shape;
+    if (shapeInfo->type == PS_CIRCLE)
+        shape = cpCircleShapeNew(body, cpCircleShapeGetRadius(src),
+                                 cpCircleShapeGetOffset(src));
+    else
+        shape = cpPolyShapeNew2(body, cpPolyShapeGetNumVerts(src),
+                                ((cpPolyShape *) src)->verts, cpvzero,
+                                cpPolyShapeGetRadius(src));
+
+#define shape_prop_clone(prop) \
+    cpShapeSet##prop(shape, cpShapeGet##prop(src))
+    shape_prop_clone(Sensor);
+    shape_prop_clone(Elasticity);
+    shape_prop_clone(Friction);
+    shape_prop_clone(SurfaceVelocity);
+    shape_prop_clone(CollisionType);
+    shape_prop_clone(Group);
+    shape_prop_clone(Layers);
+#undef shape_prop_clone
+
+    return shape;
+}
+
+void physics_clone(Entity from, Entity to)
+{
+    PhysicsInfo *info, *src;
+    ShapeInfo *shapeInfo, *srcShapeInfo;
+    PhysicsBody type;
+
+    info = entitypool_clone(pool, from, to);
+    if (!info)
+        return;
+    src = entitypool_get(pool, from);
+
+    /* body -- like _body_load(...), but properties from src's body */
+    info->body = cpSpaceAddBody(space, cpBodyNew(info->mass, 1.0));
+#define body_prop_clone(prop) \
+    cpBodySet##prop(info->body, cpBodyGet##prop(src->body))
+    body_prop_clone(Mass);
+    body_prop_clone(Moment);
+    body_prop_clone(Vel);
+    body_prop_clone(Force);
+    body_prop_clone(AngVel);
+    body_prop_clone(Torque);
+    body_prop_clone(VelLimit);
+    body_prop_clone(AngVelLimit);
+#undef body_prop_clone
+    cpBodySetUserData(info->body, to);
+
+    type = info->type;
+    info->type = PB_DYNAMIC;
+    _set_type(info, type);
+
+    cpBodySetPos(info->body, cpv_of_vec2(transform_get_position(to)));
+    cpBodySetAngle(info->body, transform_get_rotation(to));
+    info->last_dirty_count = transform_get_dirty_count(to);
+
+    /* shapes */
+    info->shapes = array_new(ShapeInfo);
+    array_foreach(srcShapeInfo, src->shapes)
+    {
+        shapeInfo = array_add(info->shapes);
+        shapeInfo->type = srcShapeInfo->type;
+        shapeInfo->shape = _shape_clone(srcShapeInfo, info->body);
+        cpSpaceAddShape(space, shapeInfo->shape);
+        cpShapeSetUserData(shapeInfo->shape, to);
+    }
+
+    info->collisions = NULL;
+    info->last_pos = cpBodyGetPos(info->body);
+    info->last_ang = cpBodyGetAngle(info->body);
+}
@@ -154,6 +154,7 @@ void physics_post_update_all();
 void physics_draw_all();
 void physics_save_all(Store *s);
 void physics_load_all(Store *s);
+void physics_clone(Entity from, Entity to);
 
 #endif
 
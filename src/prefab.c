@@ -1,34 +1,294 @@
 #include "prefab.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <glew_glfw.h>
+
 #include "system.h"
+#include "transform.h"
+#include "array.h"
+#include "thread.h"
+#include "error.h"
 
 static Entity saved_root;
 
+/* --- cache --------------------------------------------------------------- */
+
+typedef struct CacheEntry CacheEntry;
+struct CacheEntry
+{
+    char *filename;
+    time_t mtime; /* when parsed */
+    Store *s;
+};
+
+static Array *cache;
+
+static time_t _mtime(const char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return 0;
+    return st.st_mtime;
+}
+
+static CacheEntry *_cache_find(const char *filename)
+{
+    CacheEntry *entry;
+
+    array_foreach(entry, cache)
+        if (!strcmp(entry->filename, filename))
+            return entry;
+    return NULL;
+}
+
+static void _cache_remove(const char *filename)
+{
+    CacheEntry *entry;
+
+    entry = _cache_find(filename);
+    if (entry)
+    {
+        free(entry->filename);
+        store_close(entry->s);
+        array_quick_remove(cache, entry - (CacheEntry *) array_begin(cache));
+    }
+}
+
+/* parsed Store for file ready to be loaded from, reparsed if modified */
+static Store *_cache_get(const char *filename)
+{
+    CacheEntry *entry;
+    time_t mtime;
+    Store *s;
+
+    mtime = _mtime(filename);
+    entry = _cache_find(filename);
+    if (entry && entry->mtime != mtime)
+    {
+        _cache_remove(filename);
+        entry = NULL;
+    }
+
+    if (!entry)
+    {
+        /* read into memory, file may be saved over while cached */
+        s = store_open_file_copy(filename);
+        entry = array_add(cache);
+        entry->filename = malloc(strlen(filename) + 1);
+        strcpy(entry->filename, filename);
+        entry->mtime = mtime;
+        entry->s = s;
+    }
+
+    store_rewind(entry->s);
+    return entry->s;
+}
+
+void prefab_clear_cache()
+{
+    CacheEntry *entry;
+
+    array_foreach(entry, cache)
+    {
+        free(entry->filename);
+        store_close(entry->s);
+    }
+    array_clear(cache);
+}
+
+/* ------------------------------------------------------------------------- */
+
 void prefab_save(const char *filename, Entity root)
 {
     Store *s;
 
     saved_root = root;
     s = store_open();
+    store_set_binary(s, true);
     system_save_all(s);
+    _cache_remove(filename);
     store_write_file(s, filename);
     store_close(s);
     saved_root = entity_nil;
 }
 Entity prefab_load(const char *filename)
 {
-    Store *s;
     Entity root;
 
-    s = store_open_file(filename);
-    system_load_all(s);
-    store_close(s);
+    system_load_all(_cache_get(filename));
     root = saved_root;
     saved_root = entity_nil;
 
     return root;
 }
 
+/* --- clone --------------------------------------------------------------- */
+
+/* ent and its descendants, parents before children */
+static void _clone_gather(Entity ent, Array *ents)
+{
+    Entity *children;
+    unsigned int i, n;
+
+    array_add_val(Entity, ents) = ent;
+    if (transform_has(ent))
+    {
+        n = transform_get_num_children(ent);
+        children = transform_get_children(ent);
+        for (i = 0; i < n; ++i)
+            if (!entity_destroyed(children[i]))
+                _clone_gather(children[i], ents);
+    }
+}
+
+Entity prefab_clone(Entity root)
+{
+    Array *ents;
+    Entity *ent, clone;
+
+    error_assert(!entity_destroyed(root), "can't clone destroyed entity");
+
+    ents = array_new(Entity);
+    _clone_gather(root, ents);
+
+    entity_clone_begin();
+    array_foreach(ent, ents)
+        entity_clone_add(*ent);
+    system_clone_all(array_length(ents), array_begin(ents));
+    clone = _entity_resolve_clone(root);
+    entity_clone_end();
+
+    array_free(ents);
+    return clone;
+}
+
+/* --- async --------------------------------------------------------------- */
+
+struct PrefabLoad
+{
+    char *filename;
+    Thread *thread;
+
+    Mutex *mutex;
+    bool parsed;   /* worker done, protected by mutex */
+    Store *store;  /* NULL if couldn't open or parse */
+
+    SystemLoad *sysload; /* non-NULL once loading systems */
+    Entity root;
+};
+
+/* on worker */
+static void _parse(void *data)
+{
+    PrefabLoad *load = data;
+    Store *s;
+
+    s = store_try_open_file(load->filename);
+
+    mutex_lock(load->mutex);
+    load->store = s;
+    load->parsed = true;
+    mutex_unlock(load->mutex);
+}
+
+PrefabLoad *prefab_load_async(const char *filename)
+{
+    PrefabLoad *load = malloc(sizeof(PrefabLoad));
+
+    load->filename = malloc(strlen(filename) + 1);
+    strcpy(load->filename, filename);
+    load->mutex = mutex_new();
+    load->parsed = false;
+    load->store = NULL;
+    load->sysload = NULL;
+    load->root = entity_nil;
+    load->thread = thread_new(_parse, load);
+    return load;
+}
+
+bool prefab_load_async_parsed(PrefabLoad *load)
+{
+    bool parsed;
+
+    mutex_lock(load->mutex);
+    parsed = load->parsed;
+    mutex_unlock(load->mutex);
+    return parsed;
+}
+
+static void _free(PrefabLoad *load)
+{
+    if (load->thread)
+        thread_join(load->thread);
+    if (load->store)
+        store_close(load->store);
+    mutex_free(load->mutex);
+    free(load->filename);
+    free(load);
+}
+
+bool prefab_load_async_poll(PrefabLoad *load, Scalar budget, Entity *root)
+{
+    double start = glfwGetTime();
+    bool done;
+
+    /* start loading systems once parsed */
+    if (!load->sysload)
+    {
+        if (!prefab_load_async_parsed(load))
+            return false;
+        thread_join(load->thread);
+        load->thread = NULL;
+        error_assert(load->store, "file '%s' must be a readable store",
+                     load->filename);
+        load->sysload = system_load_all_begin(load->store);
+    }
+
+    /*
+     * saved_root is only set by prefab_load_all(...) during a step, take it
+     * right away in case other loads happen before we're done
+     */
+    do
+    {
+        done = system_load_all_step(load->sysload);
+        if (!entity_eq(saved_root, entity_nil))
+        {
+            load->root = saved_root;
+            saved_root = entity_nil;
+        }
+    } while (!done && (budget <= 0 || glfwGetTime() - start < budget));
+
+    if (!done)
+        return false;
+
+    *root = load->root;
+    load->sysload = NULL;
+    _free(load);
+    return true;
+}
+
+void prefab_load_async_cancel(PrefabLoad *load)
+{
+    if (load->sysload)
+        system_load_all_cancel(load->sysload);
+    _free(load);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void prefab_init()
+{
+    cache = array_new(CacheEntry);
+}
+void prefab_deinit()
+{
+    prefab_clear_cache();
+    array_free(cache);
+}
+
 void prefab_save_all(Store *s)
 {
     Store *t;
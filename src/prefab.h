@@ -10,11 +10,39 @@ SCRIPT(prefab,
        /* saves all filtered entites as a prefab, with 'root' as root */
        EXPORT void prefab_save(const char *filename, Entity root);
 
-       /* loads a saved prefab, returns saved root entity */
+       /*
+        * loads a saved prefab, returns saved root entity -- files are kept
+        * parsed after the first load, and parsed again only if modified
+        */
        EXPORT Entity prefab_load(const char *filename);
+       EXPORT void prefab_clear_cache();
+
+       /*
+        * copies root and its transform descendants with all their
+        * components, without saving and loading -- entity references among
+        * them point to the copies, returns copy of root
+        */
+       EXPORT Entity prefab_clone(Entity root);
+
+       /*
+        * load in the background, for levels as well as prefabs -- the file
+        * is read and parsed on a worker thread, then each poll on the main
+        * thread loads systems for up to 'budget' seconds (0 for no limit)
+        * once parsed, returning true when done with the saved root in
+        * *root, at which point the PrefabLoad is freed
+        */
+       typedef struct PrefabLoad PrefabLoad;
+       EXPORT PrefabLoad *prefab_load_async(const char *filename);
+       EXPORT bool prefab_load_async_parsed(PrefabLoad *load);
+       EXPORT bool prefab_load_async_poll(PrefabLoad *load, Scalar budget,
+                                          Entity *root);
+       /* frees load, anything already loaded stays */
+       EXPORT void prefab_load_async_cancel(PrefabLoad *load);
 
     )
 
+void prefab_init();
+void prefab_deinit();
 void prefab_save_all(Store *s);
 void prefab_load_all(Store *s);
 
@@ -5,8 +5,12 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <setjmp.h>
 
 #include "error.h"
+#include "mapfile.h"
+#include "thread.h"
 
 /* growable string stream */
 typedef struct Stream Stream;
@@ -15,13 +19,37 @@ struct Stream
     char *buf;
     size_t pos; /* next char to read, or next pos to write to */
     size_t cap; /* allocated size of buf */
+    size_t len; /* end of data, binary streams only */
+
+    bool borrowed; /* buf is in an arena or mapping, not ours to free */
+    bool escaped;  /* buf[0..len) is still-escaped text from a read */
+
+    jmp_buf *on_error; /* if non-NULL, jumped to when corrupt */
+};
+
+/*
+ * nodes of stores read from a file or string are allocated in an arena
+ * owned by the root along with their unescaped text data, all freed at once
+ */
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock
+{
+    ArenaBlock *prev;
+    size_t pos, cap;
+};
+typedef struct Arena Arena;
+struct Arena
+{
+    ArenaBlock *top;
+    size_t block_size; /* size of next block */
 };
 
 struct Store
 {
-    char *name;
+    const char *name; /* interned, so compared by pointer */
     Stream sm[1];
     bool compressed;
+    bool binary; /* sm holds binary data, same for whole tree */
 
     Store *child;
     Store *parent;
@@ -29,7 +57,14 @@ struct Store
 
     Store *iterchild; /* next child to visit when NULL name */
 
+    unsigned int nchildren;
+    Store **index; /* name to first child with it, NULL until needed */
+    unsigned int index_capacity; /* power of two */
+
     char *str; /* result of store_get_str(...) */
+
+    Arena *arena; /* node allocated here if non-NULL, owned by root */
+    MapFile *map; /* root only, file that borrowed data points into */
 };
 
 /* --- streams ------------------------------------------------------------- */
@@ -39,16 +74,39 @@ static void _stream_init(Stream *sm)
     sm->buf = NULL;
     sm->pos = 0;
     sm->cap = 0;
+    sm->len = 0;
+    sm->borrowed = false;
+    sm->escaped = false;
+    sm->on_error = NULL;
 }
 
 static void _stream_deinit(Stream *sm)
 {
-    free(sm->buf);
+    if (!sm->borrowed)
+        free(sm->buf);
+}
+
+static void _stream_corrupt(Stream *sm)
+{
+    if (sm->on_error)
+        longjmp(*sm->on_error, 1);
+    error("corrupt save");
 }
 
 /* grow so that pos is within allocated space */
 static void _stream_grow(Stream *sm, size_t pos)
 {
+    char *buf;
+
+    /* copy out of arena or mapping first */
+    if (sm->borrowed)
+    {
+        buf = malloc(sm->cap > 0 ? sm->cap : 1);
+        memcpy(buf, sm->buf, sm->cap);
+        sm->buf = buf;
+        sm->borrowed = false;
+    }
+
     if (pos >= sm->cap)
     {
         if (sm->cap < 2)
@@ -60,21 +118,26 @@ static void _stream_grow(Stream *sm, size_t pos)
 }
 
 /* writes at pos, truncates to end of written string */
-static void _stream_printf(Stream *sm, const char *fmt, ...)
+static void _stream_vprintf(Stream *sm, const char *fmt, va_list ap1)
 {
-    va_list ap1, ap2;
+    va_list ap2;
     size_t new_pos;
 
-    va_start(ap1, fmt);
     va_copy(ap2, ap1);
-
     new_pos = sm->pos + vsnprintf(NULL, 0, fmt, ap2);
     va_end(ap2);
 
     _stream_grow(sm, new_pos);
     vsprintf(sm->buf + sm->pos, fmt, ap1);
     sm->pos = new_pos;
-    va_end(ap1);
+}
+static void _stream_printf(Stream *sm, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    _stream_vprintf(sm, fmt, ap);
+    va_end(ap);
 }
 
 static void _stream_scanf_(Stream *sm, const char *fmt, int *n, ...)
@@ -131,8 +194,7 @@ static void _stream_write_string(Stream *sm, const char *s)
 
     _stream_printf(sm, "\" ");
 }
-/* store allocated length in plen if non-NULL */
-static char *_stream_read_string_(Stream *sm, size_t *plen)
+static char *_stream_read_string(Stream *sm)
 {
     Stream rm[1];
 
@@ -140,7 +202,7 @@ static char *_stream_read_string_(Stream *sm, size_t *plen)
     if (sm->buf[sm->pos] == 'n')
     {
         if (strncmp(&sm->buf[sm->pos], "n ", 2))
-            error("corrupt save");
+            _stream_corrupt(sm);
         sm->pos += 2;
         return NULL;
     }
@@ -149,7 +211,7 @@ static char *_stream_read_string_(Stream *sm, size_t *plen)
 
     /* opening quote */
     if (sm->buf[sm->pos] != '"')
-        error("corrupt save");
+        _stream_corrupt(sm);
     ++sm->pos;
 
     while (sm->buf[sm->pos] != '"')
@@ -170,281 +232,1456 @@ static char *_stream_read_string_(Stream *sm, size_t *plen)
     _stream_grow(rm, rm->pos);
     rm->buf[rm->pos] = '\0';
 
-    if (plen)
-        *plen = rm->cap;
-
     return rm->buf;
 }
-#define _stream_read_string(sm) _stream_read_string_(sm, NULL)
 
-/* --- internals ----------------------------------------------------------- */
-
-static Store *_store_new(Store *parent)
+/* char at pos when reading a whole store, '\0' past end */
+static char _stream_peek(Stream *sm)
 {
-    Store *s = malloc(sizeof(Store));
-
-    s->name = NULL;
-    _stream_init(s->sm);
-    s->compressed = false;
+    return sm->pos < sm->len ? sm->buf[sm->pos] : '\0';
+}
 
-    s->parent = parent;
-    s->child = NULL;
-    s->sibling = s->parent ? s->parent->child : NULL;
-    if (s->parent)
-        s->parent->iterchild = s->parent->child = s;
+/*
+ * like _stream_read_string(...) but just gives where the still-escaped
+ * string is in buf, *start = NULL if NULL string -- checks against len
+ */
+static void _stream_read_slice(Stream *sm, const char **start, size_t *n)
+{
+    /* NULL? */
+    if (_stream_peek(sm) == 'n')
+    {
+        if (sm->pos + 2 > sm->len || strncmp(&sm->buf[sm->pos], "n ", 2))
+            _stream_corrupt(sm);
+        sm->pos += 2;
+        *start = NULL;
+        *n = 0;
+        return;
+    }
 
-    s->iterchild = NULL;
-    s->str = NULL;
+    /* opening quote */
+    if (_stream_peek(sm) != '"')
+        _stream_corrupt(sm);
+    *start = &sm->buf[++sm->pos];
 
-    return s;
+    for (; sm->pos < sm->len && sm->buf[sm->pos] != '"'; ++sm->pos)
+        if (sm->buf[sm->pos] == '\\' && sm->pos + 1 < sm->len
+            && sm->buf[sm->pos + 1] == '"')
+            ++sm->pos;
+    if (sm->pos >= sm->len)
+        _stream_corrupt(sm);
+    *n = &sm->buf[sm->pos] - *start;
+    sm->pos += 2; /* closing quote, space */
 }
 
-static void _store_free(Store *s)
+/* unescape n chars from src into dst, returns unescaped length */
+static size_t _unescape(char *dst, const char *src, size_t n)
 {
-    Store *t;
+    const char *end = src + n;
+    char *d = dst;
 
-    while (s->child)
+    while (src < end)
     {
-        t = s->child->sibling;
-        _store_free(s->child);
-        s->child = t;
+        if (src[0] == '\\' && src + 1 < end && src[1] == '"')
+            ++src;
+        *d++ = *src++;
     }
+    return d - dst;
+}
 
-    free(s->name);
-    _stream_deinit(s->sm);
-    free(s->str);
+/* --- binary streams ------------------------------------------------------ */
 
-    free(s);
-}
+/*
+ * binary data is a sequence of values each led by a one-byte tag -- ints
+ * are base-128 varints (zigzag for signed), scalars raw little-endian
+ * float32, strings a varint length followed by the bytes
+ */
 
-/* { ... } for normal, [ ... ] for compressed */
+enum
+{
+    TAG_UINT,
+    TAG_INT,
+    TAG_FLOAT,
+    TAG_STRING,
+    TAG_NULL,   /* NULL string */
+    TAG_RUN,    /* <k> <v>, k equal uint values v */
+};
 
-static void _store_write(Store *s, Stream *sm)
+/* writes at pos, truncates to end of written bytes */
+static void _stream_write_bytes(Stream *sm, const void *p, size_t n)
 {
-    Store *c;
+    _stream_grow(sm, sm->pos + n);
+    memcpy(sm->buf + sm->pos, p, n);
+    sm->len = sm->pos += n;
+}
+static void _stream_read_bytes(Stream *sm, void *p, size_t n)
+{
+    if (sm->pos + n > sm->len)
+        _stream_corrupt(sm);
+    memcpy(p, sm->buf + sm->pos, n);
+    sm->pos += n;
+}
 
-    _stream_printf(sm, s->compressed ? "[ " : "{ ");
-    _stream_write_string(sm, s->name);
-    _stream_write_string(sm, s->sm->buf);
-    for (c = s->child; c; c = c->sibling)
-        _store_write(c, sm);
-    _stream_printf(sm, s->compressed ? "] " : "} ");
+static void _stream_write_byte(Stream *sm, unsigned char c)
+{
+    _stream_write_bytes(sm, &c, 1);
+}
+static unsigned char _stream_read_byte(Stream *sm)
+{
+    unsigned char c;
+    _stream_read_bytes(sm, &c, 1);
+    return c;
+}
+static unsigned char _stream_peek_byte(Stream *sm)
+{
+    if (sm->pos >= sm->len)
+        _stream_corrupt(sm);
+    return sm->buf[sm->pos];
 }
 
-#define INDENT 2
+/* encode into b, returns number of bytes used */
+static size_t _varint_encode(unsigned char b[5], unsigned int u)
+{
+    size_t n = 0;
 
-static void _store_write_pretty(Store *s, unsigned int indent, Stream *sm)
+    for (; u >= 0x80; u >>= 7)
+        b[n++] = (u & 0x7f) | 0x80;
+    b[n++] = u;
+    return n;
+}
+
+static void _stream_write_varint(Stream *sm, unsigned int u)
 {
-    Store *c;
+    unsigned char b[5];
+    _stream_write_bytes(sm, b, _varint_encode(b, u));
+}
+static unsigned int _stream_read_varint(Stream *sm)
+{
+    unsigned int u = 0, shift;
+    unsigned char b;
 
-    /* compressed stuff isn't pretty */
-    if (s->compressed)
+    for (shift = 0; ; shift += 7)
     {
-        _stream_printf(sm, "%*s", indent, "");
-        _store_write(s, sm);
-        _stream_printf(sm, "\n");
-        return;
+        if (shift > 28)
+            _stream_corrupt(sm);
+        b = _stream_read_byte(sm);
+        u |= (unsigned int) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return u;
     }
+}
 
-    /* opening brace */
-    _stream_printf(sm, "%*s{ ", indent, "");
+static void _stream_write_float(Stream *sm, float f)
+{
+    unsigned char b[4];
+    uint32_t u;
+
+    memcpy(&u, &f, 4);
+    b[0] = u;
+    b[1] = u >> 8;
+    b[2] = u >> 16;
+    b[3] = u >> 24;
+    _stream_write_bytes(sm, b, 4);
+}
+static float _stream_read_float(Stream *sm)
+{
+    unsigned char b[4];
+    uint32_t u;
+    float f;
+
+    _stream_read_bytes(sm, b, 4);
+    u = b[0] | (uint32_t) b[1] << 8 | (uint32_t) b[2] << 16
+        | (uint32_t) b[3] << 24;
+    memcpy(&f, &u, 4);
+    return f;
+}
 
-    /* name, data */
-    _stream_write_string(sm, s->name);
-    _stream_write_string(sm, s->sm->buf);
-    if (s->child)
-        _stream_printf(sm, "\n");
+/* varint length then bytes, result must be free(...)'d */
+static void _stream_write_raw_string(Stream *sm, const char *s)
+{
+    size_t n = strlen(s);
 
-    /* children */
-    for (c = s->child; c; c = c->sibling)
-        _store_write_pretty(c, indent + INDENT, sm);
+    _stream_write_varint(sm, n);
+    _stream_write_bytes(sm, s, n);
+}
+static char *_stream_read_raw_string(Stream *sm)
+{
+    unsigned int n;
+    char *s;
+
+    n = _stream_read_varint(sm);
+    if (sm->pos + n > sm->len)
+        _stream_corrupt(sm);
+    s = malloc(n + 1);
+    _stream_read_bytes(sm, s, n);
+    s[n] = '\0';
+    return s;
+}
 
-    /* closing brace */
-    if (s->child)
-        _stream_printf(sm, "%*s}\n", indent, "");
-    else
-        _stream_printf(sm, "}\n");
+/* tagged values */
+
+static void _bin_write_uint(Stream *sm, unsigned int u)
+{
+    _stream_write_byte(sm, TAG_UINT);
+    _stream_write_varint(sm, u);
+}
+static void _bin_write_int(Stream *sm, int i)
+{
+    _stream_write_byte(sm, TAG_INT);
+    _stream_write_varint(sm, ((unsigned int) i << 1) ^ (i < 0 ? ~0u : 0u));
+}
+static void _bin_write_float(Stream *sm, Scalar f)
+{
+    _stream_write_byte(sm, TAG_FLOAT);
+    _stream_write_float(sm, f);
+}
+static void _bin_write_string(Stream *sm, const char *s)
+{
+    if (!s)
+    {
+        _stream_write_byte(sm, TAG_NULL);
+        return;
+    }
+    _stream_write_byte(sm, TAG_STRING);
+    _stream_write_raw_string(sm, s);
+}
+static void _bin_write_run(Stream *sm, unsigned int k, unsigned int v)
+{
+    _stream_write_byte(sm, TAG_RUN);
+    _stream_write_varint(sm, k);
+    _stream_write_varint(sm, v);
 }
 
-static Store *_store_read(Store *parent, Stream *sm)
+static unsigned int _zigzag_decode(unsigned int u)
 {
-    char close_brace = '}'; /* type of close brace to expect */
-    Store *s = _store_new(parent);
+    return (u >> 1) ^ (0u - (u & 1));
+}
 
-    /* opening brace */
-    if (sm->buf[sm->pos] == '[')
+/* uint and int are interchangeable, as with text */
+static unsigned int _bin_read_uint(Stream *sm)
+{
+    switch (_stream_read_byte(sm))
     {
-        s->compressed = true;
-        close_brace = ']';
+        case TAG_UINT:
+            return _stream_read_varint(sm);
+        case TAG_INT:
+            return _zigzag_decode(_stream_read_varint(sm));
+    }
+    _stream_corrupt(sm);
+    return 0;
+}
+static int _bin_read_int(Stream *sm)
+{
+    return (int) _bin_read_uint(sm);
+}
+static Scalar _bin_read_float(Stream *sm)
+{
+    if (_stream_read_byte(sm) != TAG_FLOAT)
+        _stream_corrupt(sm);
+    return _stream_read_float(sm);
+}
+static char *_bin_read_string(Stream *sm)
+{
+    switch (_stream_read_byte(sm))
+    {
+        case TAG_NULL:
+            return NULL;
+        case TAG_STRING:
+            return _stream_read_raw_string(sm);
     }
-    else if (sm->buf[sm->pos] != '{')
-        error("corrupt save");
-    while (isspace(sm->buf[++sm->pos]));
+    _stream_corrupt(sm);
+    return NULL;
+}
 
-    /* name, data */
-    s->name = _stream_read_string(sm);
-    s->sm->buf = _stream_read_string_(sm, &s->sm->cap);
-    s->sm->pos = 0;
+/* --- conversion ---------------------------------------------------------- */
+
+/* is s[0..n) all digits? */
+static bool _all_digits(const char *s, size_t n)
+{
+    return n > 0 && strspn(s, "0123456789") >= n;
+}
+
+/* re-encode a node's text data as binary */
+static void _data_text_to_binary(Stream *dst, Stream *src)
+{
+    const char *tok;
+    char *str, *end;
+    size_t n;
+
+    if (!src->buf)
+        return;
 
-    /* children */
     for (;;)
     {
-        while (isspace(sm->buf[sm->pos]))
-            ++sm->pos;
+        while (isspace(src->buf[src->pos]))
+            ++src->pos;
+        tok = &src->buf[src->pos];
+        if (!*tok)
+            break;
 
-        /* end? */
-        if (sm->buf[sm->pos] == close_brace)
+        /* strings */
+        if (*tok == '"' || !strncmp(tok, "n ", 2))
         {
-            ++sm->pos;
-            break;
+            str = _stream_read_string(src);
+            _bin_write_string(dst, str);
+            free(str);
+            continue;
         }
 
-        _store_read(s, sm);
+        n = strcspn(tok, " \t\n");
+        src->pos += n;
+
+        if (n == 1 && *tok == 'i')
+            _bin_write_float(dst, SCALAR_INFINITY);
+        else if (memchr(tok, '*', n))
+        {
+            unsigned int k = strtoul(tok, &end, 10);
+            _bin_write_run(dst, k, strtoul(end + 1, NULL, 10));
+        }
+        else if (_all_digits(tok, n))
+            _bin_write_uint(dst, strtoul(tok, NULL, 10));
+        else if (*tok == '-' && _all_digits(tok + 1, n - 1))
+            _bin_write_int(dst, strtol(tok, NULL, 10));
+        else
+            _bin_write_float(dst, strtod(tok, NULL));
     }
+}
 
-    return s;
+/* re-encode a node's binary data as text */
+static void _data_binary_to_text(Stream *dst, Stream *src)
+{
+    unsigned int k;
+    Scalar f;
+    char *str;
+
+    while (src->pos < src->len)
+        switch (_stream_read_byte(src))
+        {
+            case TAG_UINT:
+                _stream_printf(dst, "%u ", _stream_read_varint(src));
+                break;
+
+            case TAG_INT:
+                _stream_printf(dst, "%d ",
+                               (int) _zigzag_decode(_stream_read_varint(src)));
+                break;
+
+            case TAG_FLOAT:
+                f = _stream_read_float(src);
+                if (f == SCALAR_INFINITY)
+                    _stream_printf(dst, "i ");
+                else
+                    _stream_printf(dst, "%f ", f);
+                break;
+
+            case TAG_STRING:
+                str = _stream_read_raw_string(src);
+                _stream_write_string(dst, str);
+                free(str);
+                break;
+
+            case TAG_NULL:
+                _stream_write_string(dst, NULL);
+                break;
+
+            case TAG_RUN:
+                k = _stream_read_varint(src);
+                _stream_printf(dst, "%u*%u ", k, _stream_read_varint(src));
+                break;
+
+            default:
+                _stream_corrupt(src);
+        }
 }
 
-/* --- child save/load ----------------------------------------------------- */
+/* --- output -------------------------------------------------------------- */
 
-bool store_child_save(Store **sp, const char *name, Store *parent)
+/*
+ * where whole stores are written -- into a stream, or straight through to a
+ * file so the whole text is never in memory at once
+ */
+typedef struct Output Output;
+struct Output
 {
-    Store *s;
+    Stream *sm; /* if NULL, written to f */
+    FILE *f;
+    size_t n;   /* bytes written to f */
+};
 
-    /* compressed? keep it flat */
-    if (parent->compressed)
-        return (*sp = parent) != NULL;
+static void _output_printf(Output *o, const char *fmt, ...)
+{
+    va_list ap;
 
-    s = _store_new(parent);
-    if (name)
-    {
-        s->name = malloc(strlen(name) + 1);
-        strcpy(s->name, name);
-    }
-    return (*sp = s) != NULL;
+    va_start(ap, fmt);
+    if (o->sm)
+        _stream_vprintf(o->sm, fmt, ap);
+    else
+        o->n += vfprintf(o->f, fmt, ap);
+    va_end(ap);
 }
 
-bool store_child_save_compressed(Store **sp, const char *name, Store *parent)
+static void _output_write(Output *o, const void *p, size_t n)
 {
-    bool r = store_child_save(sp, name, parent);
-    (*sp)->compressed = true;
-    return r;
+    if (o->sm)
+        _stream_write_bytes(o->sm, p, n);
+    else
+        o->n += fwrite(p, 1, n, o->f);
 }
 
-bool store_child_load(Store **sp, const char *name, Store *parent)
+static void _output_write_varint(Output *o, unsigned int u)
 {
-    Store *s;
+    unsigned char b[5];
+    _output_write(o, b, _varint_encode(b, u));
+}
 
-    /* compressed? expect flat */
-    if (parent->compressed)
-        return (*sp = parent) != NULL;
+/* same format as _stream_write_string(...) */
+static void _output_write_string(Output *o, const char *s)
+{
+    const char *q;
 
-    /* if NULL name, pick next iteration child and advance */
-    if (!name)
+    if (o->sm)
     {
-        s = parent->iterchild;
-        if (parent->iterchild)
-            parent->iterchild = parent->iterchild->sibling;
-        return (*sp = s) != NULL;
+        _stream_write_string(o->sm, s);
+        return;
     }
 
-    /* search all children */
-    for (s = parent->child; s && (!s->name || strcmp(s->name, name));
-         s = s->sibling);
-    return (*sp = s) != NULL;
+    if (!s)
+    {
+        _output_printf(o, "n ");
+        return;
+    }
+
+    /* write up to each quote at once, then escaped quote */
+    _output_printf(o, "\"");
+    for (; (q = strchr(s, '"')); s = q + 1)
+    {
+        _output_write(o, s, q - s);
+        _output_write(o, "\\\"", 2);
+    }
+    _output_printf(o, "%s\" ", s);
 }
 
-/* --- open/close ---------------------------------------------------------- */
+/* --- arena --------------------------------------------------------------- */
 
-Store *store_open()
-{
-    return _store_new(NULL);
-}
+#define ARENA_ALIGN 16
+#define ARENA_HEADER \
+    ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
 
-Store *store_open_str(const char *str)
+static Arena *_arena_new(size_t block_size)
 {
-    Stream sm = { (char *) str, 0, 0 };
-    return _store_read(NULL, &sm);
+    Arena *a = malloc(sizeof(Arena));
+
+    a->top = NULL;
+    a->block_size = block_size < 65536 ? 65536 : block_size;
+    return a;
 }
-const char *store_write_str(Store *s)
+
+static void _arena_free(Arena *a)
 {
-    Stream sm[1];
+    ArenaBlock *b;
 
-    _stream_init(sm);
-    _store_write_pretty(s, 0, sm);
-    free(s->str);
-    s->str = sm->buf;
-    return s->str; /* don't deinit sm, keep string */
+    while (a->top)
+    {
+        b = a->top->prev;
+        free(a->top);
+        a->top = b;
+    }
+    free(a);
 }
 
-/* file stores store_write_str(...) result in "<len>\n<str>" format */
-Store *store_open_file(const char *filename)
+static void *_arena_alloc(Arena *a, size_t size)
 {
-    Store *s;
-    FILE *f;
-    unsigned int n;
-    char *str;
+    ArenaBlock *b;
+    void *p;
 
-    f = fopen(filename, "r");
-    error_assert(f, "file '%s' must be open for reading", filename);
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
 
-    fscanf(f, "%u\n", &n);
-    str = malloc(n + 1);
-    fread(str, 1, n, f);
-    fclose(f);
-    str[n] = '\0';
-    s = store_open_str(str);
-    free(str);
-    return s;
+    /* new block if full, each one bigger */
+    if (!a->top || a->top->pos + size > a->top->cap)
+    {
+        if (a->block_size < size)
+            a->block_size = size;
+        b = malloc(ARENA_HEADER + a->block_size);
+        b->prev = a->top;
+        b->pos = 0;
+        b->cap = a->block_size;
+        a->top = b;
+        a->block_size *= 2;
+    }
+
+    p = (char *) a->top + ARENA_HEADER + a->top->pos;
+    a->top->pos += size;
+    return p;
 }
-void store_write_file(Store *s, const char *filename)
-{
-    FILE *f;
-    const char *str;
-    unsigned int n;
 
-    f = fopen(filename, "w");
-    error_assert(f, "file '%s' must be open for writing", filename);
+/* --- names --------------------------------------------------------------- */
 
-    str = store_write_str(s);
-    n = strlen(str);
-    fprintf(f, "%u\n", n);
-    fwrite(str, 1, n, f);
-    fclose(f);
-}
+/*
+ * node names are interned so that nodes share one copy of each and compare
+ * them by pointer -- open addressing hash set, kept at most half full, the
+ * strings live until saveload_deinit() -- locked since stores may be read
+ * on other threads
+ */
+static Mutex *intern_mutex;
+static char **intern_slots = NULL;
+static unsigned int intern_capacity = 0; /* power of two */
+static unsigned int intern_count = 0;
 
-void store_close(Store *s)
+static unsigned int _hash(const char *s)
 {
-    _store_free(s);
+    unsigned int h = 2166136261u; /* FNV-1a */
+    for (; *s; ++s)
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    return h;
 }
 
-/* --- primitives ---------------------------------------------------------- */
+/* slot for name -- either holding it or the empty one to insert at */
+static char **_intern_slot(const char *name)
+{
+    unsigned int i;
 
-#define _store_printf(s, fmt, ...) \
-    _stream_printf(s->sm, fmt, ##__VA_ARGS__)
-#define _store_scanf(s, fmt, ...) \
-    _stream_scanf(s->sm, fmt, ##__VA_ARGS__)
+    for (i = _hash(name) & (intern_capacity - 1); ;
+         i = (i + 1) & (intern_capacity - 1))
+        if (!intern_slots[i] || !strcmp(intern_slots[i], name))
+            return &intern_slots[i];
+}
 
-/* use 'i' for infinity */
-void scalar_save(const Scalar *f, const char *n, Store *s)
+static void _intern_grow()
 {
-    Store *t;
+    char **old_slots;
+    unsigned int old_capacity, i;
+
+    old_slots = intern_slots;
+    old_capacity = intern_capacity;
+    intern_capacity = old_capacity ? 2 * old_capacity : 256;
+    intern_slots = calloc(intern_capacity, sizeof(char *));
+
+    for (i = 0; i < old_capacity; ++i)
+        if (old_slots[i])
+            *_intern_slot(old_slots[i]) = old_slots[i];
+    free(old_slots);
+}
 
-    if (store_child_save(&t, n, s))
+/* interned copy of name, NULL if NULL */
+static const char *_intern(const char *name)
+{
+    char **slot, *interned;
+
+    if (!name)
+        return NULL;
+
+    mutex_lock(intern_mutex);
+    if (2 * (intern_count + 1) > intern_capacity)
+        _intern_grow();
+    slot = _intern_slot(name);
+    if (!*slot)
     {
-        if (*f == SCALAR_INFINITY)
-            _store_printf(t, "i ");
-        else
-            _store_printf(t, "%f ", *f);
+        *slot = malloc(strlen(name) + 1);
+        strcpy(*slot, name);
+        ++intern_count;
     }
+    interned = *slot;
+    mutex_unlock(intern_mutex);
+    return interned;
 }
-bool scalar_load(Scalar *f, const char *n, Scalar d, Store *s)
-{
-    Store *t;
+
+/* interned copy of still-escaped slice, using scratch to unescape */
+static const char *_intern_slice(const char *start, size_t n, Stream *scratch)
+{
+    if (!start)
+        return NULL;
+    _stream_grow(scratch, n);
+    scratch->buf[_unescape(scratch->buf, start, n)] = '\0';
+    return _intern(scratch->buf);
+}
+
+/* interned copy of name if any, else NULL as no node can have it */
+static const char *_intern_find(const char *name)
+{
+    const char *interned = NULL;
+
+    mutex_lock(intern_mutex);
+    if (intern_capacity)
+        interned = *_intern_slot(name);
+    mutex_unlock(intern_mutex);
+    return interned;
+}
+
+/* --- child index --------------------------------------------------------- */
+
+/*
+ * nodes with many children get an open addressing hash from interned name
+ * to the first child with that name, kept at most half full and rebuilt
+ * from the child list when it grows
+ */
+
+#define INDEX_MIN_CHILDREN 8
+
+static unsigned int _ptr_hash(const void *p)
+{
+    return (unsigned int) ((uintptr_t) p >> 3) * 2654435761u;
+}
+
+/* slot for name -- either holding its child or the empty one */
+static Store **_index_slot(Store *s, const char *name)
+{
+    unsigned int i;
+
+    for (i = _ptr_hash(name) & (s->index_capacity - 1); ;
+         i = (i + 1) & (s->index_capacity - 1))
+        if (!s->index[i] || s->index[i]->name == name)
+            return &s->index[i];
+}
+
+static void _index_build(Store *s)
+{
+    Store *c, **slot;
+
+    free(s->index);
+    s->index_capacity = 16;
+    while (s->index_capacity < 2 * s->nchildren)
+        s->index_capacity <<= 1;
+    s->index = calloc(s->index_capacity, sizeof(Store *));
+
+    /* keep earliest in list for each name */
+    for (c = s->child; c; c = c->sibling)
+        if (c->name && !*(slot = _index_slot(s, c->name)))
+            *slot = c;
+}
+
+/* --- internals ----------------------------------------------------------- */
+
+/* name must be interned, allocated from arena if non-NULL */
+static Store *_store_new(Store *parent, const char *name, Arena *arena)
+{
+    Store *s;
+
+    s = arena ? _arena_alloc(arena, sizeof(Store)) : malloc(sizeof(Store));
+
+    s->name = name;
+    _stream_init(s->sm);
+    s->compressed = false;
+    s->binary = parent ? parent->binary : false;
+
+    s->parent = parent;
+    s->child = NULL;
+    s->sibling = s->parent ? s->parent->child : NULL;
+    if (s->parent)
+        s->parent->iterchild = s->parent->child = s;
+
+    s->iterchild = NULL;
+    s->nchildren = 0;
+    s->index = NULL;
+    s->index_capacity = 0;
+    s->str = NULL;
+    s->arena = arena;
+    s->map = NULL;
+
+    /* new child is first in list, so wins in index */
+    if (parent)
+    {
+        ++parent->nchildren;
+        if (parent->index && 2 * parent->nchildren > parent->index_capacity)
+            _index_build(parent);
+        else if (parent->index && name)
+            *_index_slot(parent, name) = s;
+    }
+
+    return s;
+}
+
+static void _store_free(Store *s)
+{
+    Store *t;
+
+    while (s->child)
+    {
+        t = s->child->sibling;
+        _store_free(s->child);
+        s->child = t;
+    }
+
+    _stream_deinit(s->sm);
+    free(s->index);
+    free(s->str);
+
+    if (!s->arena)
+        free(s);
+}
+
+/* unescape text data read from a file or string on first access */
+static void _store_data(Store *s)
+{
+    char *buf;
+    size_t n;
+
+    if (!s->sm->escaped)
+        return;
+
+    buf = _arena_alloc(s->arena, s->sm->len + 1);
+    n = _unescape(buf, s->sm->buf, s->sm->len);
+    buf[n] = '\0';
+    s->sm->buf = buf;
+    s->sm->cap = n + 1;
+    s->sm->len = n;
+    s->sm->escaped = false;
+}
+
+/* node data as a text string, converting if binary */
+static void _store_write_data(Store *s, Output *o)
+{
+    Stream src, text[1];
+
+    _store_data(s);
+    if (!s->binary)
+    {
+        _output_write_string(o, s->sm->buf);
+        return;
+    }
+
+    src = *s->sm;
+    src.pos = 0;
+    _stream_init(text);
+    _data_binary_to_text(text, &src);
+    _output_write_string(o, text->buf);
+    _stream_deinit(text);
+}
+
+/* { ... } for normal, [ ... ] for compressed */
+
+static void _store_write(Store *s, Output *o)
+{
+    Store *c;
+
+    _output_printf(o, s->compressed ? "[ " : "{ ");
+    _output_write_string(o, s->name);
+    _store_write_data(s, o);
+    for (c = s->child; c; c = c->sibling)
+        _store_write(c, o);
+    _output_printf(o, s->compressed ? "] " : "} ");
+}
+
+#define INDENT 2
+
+static void _store_write_pretty(Store *s, unsigned int indent, Output *o)
+{
+    Store *c;
+
+    /* compressed stuff isn't pretty */
+    if (s->compressed)
+    {
+        _output_printf(o, "%*s", indent, "");
+        _store_write(s, o);
+        _output_printf(o, "\n");
+        return;
+    }
+
+    /* opening brace */
+    _output_printf(o, "%*s{ ", indent, "");
+
+    /* name, data */
+    _output_write_string(o, s->name);
+    _store_write_data(s, o);
+    if (s->child)
+        _output_printf(o, "\n");
+
+    /* children */
+    for (c = s->child; c; c = c->sibling)
+        _store_write_pretty(c, indent + INDENT, o);
+
+    /* closing brace */
+    if (s->child)
+        _output_printf(o, "%*s}\n", indent, "");
+    else
+        _output_printf(o, "}\n");
+}
+
+/*
+ * nodes go in arena, data is left as a slice of sm->buf to unescape on
+ * first access, scratch is for unescaping names
+ */
+static Store *_store_read(Store *parent, Stream *sm, Arena *arena,
+                          Stream *scratch)
+{
+    char close_brace = '}'; /* type of close brace to expect */
+    const char *start;
+    size_t n;
+    Store *s;
+
+    /* opening brace */
+    if (_stream_peek(sm) == '[')
+        close_brace = ']';
+    else if (_stream_peek(sm) != '{')
+        _stream_corrupt(sm);
+    ++sm->pos;
+    while (isspace(_stream_peek(sm)))
+        ++sm->pos;
+
+    /* name, data */
+    _stream_read_slice(sm, &start, &n);
+    s = _store_new(parent, _intern_slice(start, n, scratch), arena);
+    s->compressed = close_brace == ']';
+    _stream_read_slice(sm, &start, &n);
+    if (start)
+    {
+        s->sm->buf = (char *) start;
+        s->sm->cap = s->sm->len = n;
+        s->sm->borrowed = s->sm->escaped = true;
+    }
+
+    /* children */
+    for (;;)
+    {
+        while (isspace(_stream_peek(sm)))
+            ++sm->pos;
+
+        /* end? */
+        if (_stream_peek(sm) == close_brace)
+        {
+            ++sm->pos;
+            break;
+        }
+
+        _store_read(s, sm, arena, scratch);
+    }
+
+    return s;
+}
+
+/* re-encode data of whole tree */
+static void _store_convert(Store *s, bool binary)
+{
+    Stream src, dst[1];
+    Store *c;
+
+    if (s->binary != binary)
+    {
+        _store_data(s);
+        src = *s->sm;
+        src.pos = 0;
+        _stream_init(dst);
+        if (binary)
+            _data_text_to_binary(dst, &src);
+        else
+            _data_binary_to_text(dst, &src);
+        _stream_deinit(s->sm);
+        *s->sm = *dst;
+        s->sm->pos = 0;
+        s->binary = binary;
+    }
+
+    for (c = s->child; c; c = c->sibling)
+        _store_convert(c, binary);
+}
+
+/* --- binary files -------------------------------------------------------- */
+
+/*
+ * binary files are "CGSB" <version> <nnames> <names ...> <root>, each node
+ * being <flags> <name id> <data len> <data> <nchildren> <children ...> with
+ * name id 0 for NULL and n + 1 for the nth name, all integers as varints --
+ * each distinct name is stored once in the name table
+ */
+
+#define BINARY_MAGIC "CGSB"
+#define BINARY_VERSION 1
+
+#define FLAG_COMPRESSED 1
+
+/*
+ * name table used when writing -- open addressing hash from interned name
+ * to id, 0 for empty slot, kept at most half full
+ */
+typedef struct NameTable NameTable;
+struct NameTable
+{
+    const char **names;
+    unsigned int nnames;
+    unsigned int *slots;
+    unsigned int capacity; /* power of two */
+};
+
+/* slot for name -- either holding it or the empty one to insert at */
+static unsigned int *_name_slot(NameTable *t, const char *name)
+{
+    unsigned int i, *slot;
+
+    for (i = _ptr_hash(name) & (t->capacity - 1); ;
+         i = (i + 1) & (t->capacity - 1))
+    {
+        slot = &t->slots[i];
+        if (*slot == 0 || t->names[*slot - 1] == name)
+            return slot;
+    }
+}
+
+static void _name_grow(NameTable *t)
+{
+    unsigned int i;
+
+    free(t->slots);
+    t->capacity = t->capacity ? 2 * t->capacity : 64;
+    t->slots = calloc(t->capacity, sizeof(unsigned int));
+    t->names = realloc(t->names, (t->capacity / 2) * sizeof(const char *));
+    for (i = 0; i < t->nnames; ++i)
+        *_name_slot(t, t->names[i]) = i + 1;
+}
+
+static unsigned int _name_id(NameTable *t, const char *name)
+{
+    unsigned int *slot;
+
+    if (!name)
+        return 0;
+
+    slot = _name_slot(t, name);
+    if (*slot == 0)
+    {
+        if (2 * (t->nnames + 1) > t->capacity)
+        {
+            _name_grow(t);
+            slot = _name_slot(t, name);
+        }
+        t->names[t->nnames++] = name;
+        *slot = t->nnames;
+    }
+    return *slot;
+}
+
+static void _store_collect_names(Store *s, NameTable *t)
+{
+    Store *c;
+
+    _name_id(t, s->name);
+    for (c = s->child; c; c = c->sibling)
+        _store_collect_names(c, t);
+}
+
+static void _store_write_binary(Store *s, NameTable *t, Output *o)
+{
+    Store *c;
+    unsigned char flags = s->compressed ? FLAG_COMPRESSED : 0;
+    unsigned int nchildren = 0;
+
+    _output_write(o, &flags, 1);
+    _output_write_varint(o, _name_id(t, s->name));
+    _output_write_varint(o, s->sm->len);
+    if (s->sm->len)
+        _output_write(o, s->sm->buf, s->sm->len);
+
+    for (c = s->child; c; c = c->sibling)
+        ++nchildren;
+    _output_write_varint(o, nchildren);
+    for (c = s->child; c; c = c->sibling)
+        _store_write_binary(c, t, o);
+}
+
+/* names are interned, nodes go in arena, data points into sm->buf */
+static Store *_store_read_binary(Store *parent, const char **names,
+                                 unsigned int nnames, Stream *sm, Arena *arena)
+{
+    Store *s;
+    unsigned int flags, id, n;
+
+    /* flags, name */
+    flags = _stream_read_byte(sm);
+    id = _stream_read_varint(sm);
+    if (id > nnames)
+        _stream_corrupt(sm);
+    s = _store_new(parent, id ? names[id - 1] : NULL, arena);
+    s->binary = true;
+    s->compressed = flags & FLAG_COMPRESSED;
+
+    /* data */
+    n = _stream_read_varint(sm);
+    if (n)
+    {
+        if (sm->pos + n > sm->len)
+            _stream_corrupt(sm);
+        s->sm->buf = &sm->buf[sm->pos];
+        s->sm->cap = s->sm->len = n;
+        s->sm->borrowed = true;
+        sm->pos += n;
+    }
+
+    /* children */
+    for (n = _stream_read_varint(sm); n > 0; --n)
+        _store_read_binary(s, names, nnames, sm, arena);
+
+    return s;
+}
+
+/* sm is positioned just after magic */
+static Store *_store_read_binary_root(Stream *sm, Arena *arena)
+{
+    const char **names;
+    char *name;
+    unsigned int nnames, i;
+
+    if (_stream_read_varint(sm) != BINARY_VERSION)
+        _stream_corrupt(sm);
+
+    /* name table */
+    nnames = _stream_read_varint(sm);
+    if (nnames > sm->len)
+        _stream_corrupt(sm);
+    names = _arena_alloc(arena, nnames * sizeof(const char *));
+    for (i = 0; i < nnames; ++i)
+    {
+        name = _stream_read_raw_string(sm);
+        names[i] = _intern(name);
+        free(name);
+    }
+
+    return _store_read_binary(NULL, names, nnames, sm, arena);
+}
+
+/* nodes are written as they're visited, nothing is buffered but by f */
+static void _store_write_binary_file(Store *s, FILE *f)
+{
+    NameTable t = { NULL, 0, NULL, 0 };
+    Output o = { NULL, f, 0 };
+    unsigned int i, n;
+
+    _name_grow(&t);
+    _store_collect_names(s, &t);
+
+    _output_write(&o, BINARY_MAGIC, 4);
+    _output_write_varint(&o, BINARY_VERSION);
+    _output_write_varint(&o, t.nnames);
+    for (i = 0; i < t.nnames; ++i)
+    {
+        n = strlen(t.names[i]);
+        _output_write_varint(&o, n);
+        _output_write(&o, t.names[i], n);
+    }
+    _store_write_binary(s, &t, &o);
+
+    free(t.names);
+    free(t.slots);
+}
+
+/*
+ * the length isn't known until the end, so a blank line is left for it and
+ * filled in by seeking back
+ */
+#define LENGTH_WIDTH 10
+
+static void _store_write_text_file(Store *s, FILE *f)
+{
+    Output o = { NULL, f, 0 };
+
+    fprintf(f, "%*s\n", LENGTH_WIDTH, "");
+    _store_write_pretty(s, 0, &o);
+    fseek(f, 0, SEEK_SET);
+    fprintf(f, "%*lu", LENGTH_WIDTH, (unsigned long) o.n);
+}
+
+/* --- child save/load ----------------------------------------------------- */
+
+bool store_child_save(Store **sp, const char *name, Store *parent)
+{
+    Store *s;
+
+    /* compressed? keep it flat */
+    if (parent->compressed)
+    {
+        _store_data(parent);
+        return (*sp = parent) != NULL;
+    }
+
+    s = _store_new(parent, _intern(name), NULL);
+    return (*sp = s) != NULL;
+}
+
+bool store_child_save_compressed(Store **sp, const char *name, Store *parent)
+{
+    bool r = store_child_save(sp, name, parent);
+    (*sp)->compressed = true;
+    return r;
+}
+
+bool store_child_load(Store **sp, const char *name, Store *parent)
+{
+    Store *s;
+
+    /* compressed? expect flat */
+    if (parent->compressed)
+        s = parent;
+
+    /* if NULL name, pick next iteration child and advance */
+    else if (!name)
+    {
+        s = parent->iterchild;
+        if (parent->iterchild)
+            parent->iterchild = parent->iterchild->sibling;
+    }
+
+    /* never interned? then no child has it */
+    else if (!(name = _intern_find(name)))
+        s = NULL;
+
+    /* index if many children, else search all */
+    else
+    {
+        if (!parent->index && parent->nchildren >= INDEX_MIN_CHILDREN)
+            _index_build(parent);
+        if (parent->index)
+            s = *_index_slot(parent, name);
+        else
+            for (s = parent->child; s && s->name != name; s = s->sibling);
+    }
+
+    if (s)
+        _store_data(s);
+    return (*sp = s) != NULL;
+}
+
+/* --- open/close ---------------------------------------------------------- */
+
+void saveload_init()
+{
+    intern_mutex = mutex_new();
+}
+void saveload_deinit()
+{
+    unsigned int i;
+
+    for (i = 0; i < intern_capacity; ++i)
+        free(intern_slots[i]);
+    free(intern_slots);
+    intern_slots = NULL;
+    intern_capacity = intern_count = 0;
+
+    mutex_free(intern_mutex);
+}
+
+Store *store_open()
+{
+    return _store_new(NULL, NULL, NULL);
+}
+
+/* file contents may be binary or text with a length line */
+static Store *_store_read_root(Stream *sm, bool file, Arena *arena,
+                               Stream *scratch)
+{
+    if (file && sm->len >= 4 && !memcmp(sm->buf, BINARY_MAGIC, 4))
+    {
+        sm->pos = 4;
+        return _store_read_binary_root(sm, arena);
+    }
+
+    /* skip length line, the tree itself says where it ends */
+    if (file)
+    {
+        for (; _stream_peek(sm) != '\n'; ++sm->pos)
+            if (sm->pos >= sm->len)
+                _stream_corrupt(sm);
+        ++sm->pos;
+    }
+
+    return _store_read(NULL, sm, arena, scratch);
+}
+
+/*
+ * read a whole store from buf[0..n), which must live as long as it, nodes
+ * going in arena -- if recover, returns NULL when corrupt rather than
+ * error(...), leaving arena to be freed
+ */
+static Store *_store_parse(char *buf, size_t n, bool file, Arena *arena,
+                           bool recover)
+{
+    jmp_buf on_error;
+    Stream sm[1], *scratch;
+    Store *s;
+
+    /* scratch on heap so it's intact after longjmp(...) */
+    scratch = malloc(sizeof(Stream));
+    _stream_init(scratch);
+
+    _stream_init(sm);
+    sm->buf = buf;
+    sm->len = n;
+
+    if (!recover)
+        s = _store_read_root(sm, file, arena, scratch);
+    else if (setjmp(on_error))
+        s = NULL;
+    else
+    {
+        sm->on_error = &on_error;
+        s = _store_read_root(sm, file, arena, scratch);
+    }
+
+    _stream_deinit(scratch);
+    free(scratch);
+    return s;
+}
+
+Store *store_open_str(const char *str)
+{
+    Arena *arena;
+    size_t n;
+    char *copy;
+
+    /* copy into arena for data to point into */
+    n = strlen(str);
+    arena = _arena_new(n);
+    copy = _arena_alloc(arena, n + 1);
+    memcpy(copy, str, n);
+    return _store_parse(copy, n, false, arena, false);
+}
+const char *store_write_str(Store *s)
+{
+    Stream sm[1];
+    Output o = { sm, NULL, 0 };
+
+    _stream_init(sm);
+    _store_write_pretty(s, 0, &o);
+    free(s->str);
+    s->str = sm->buf;
+    return s->str; /* don't deinit sm, keep string */
+}
+
+void store_set_binary(Store *s, bool binary)
+{
+    error_assert(!s->parent, "must be a root store");
+    _store_convert(s, binary);
+}
+bool store_get_binary(Store *s)
+{
+    return s->binary;
+}
+
+/*
+ * text file stores store_write_str(...) result in "<len>\n<str>" format,
+ * binary file format is described above -- either is read straight out of
+ * a mapping of the file, nodes pointing into it for their data -- or
+ * into a copy of it in the arena if 'copy'
+ */
+static Store *_store_open_file(const char *filename, bool recover, bool copy)
+{
+    MapFile *map;
+    Arena *arena;
+    Store *s;
+    char *buf;
+    size_t n;
+
+    map = mapfile_open(filename);
+    if (!map && recover)
+        return NULL;
+    error_assert(map, "file '%s' must be open for reading", filename);
+
+    n = mapfile_size(map);
+    arena = _arena_new(n);
+    if (copy)
+    {
+        buf = _arena_alloc(arena, n + 1);
+        if (n)
+            memcpy(buf, mapfile_data(map), n);
+        buf[n] = '\0';
+    }
+    else
+        buf = (char *) mapfile_data(map);
+    s = _store_parse(buf, n, true, arena, recover);
+    if (!s)
+    {
+        _arena_free(arena);
+        mapfile_close(map);
+        return NULL;
+    }
+
+    if (copy)
+        mapfile_close(map);
+    else
+        s->map = map;
+    return s;
+}
+Store *store_open_file(const char *filename)
+{
+    return _store_open_file(filename, false, false);
+}
+Store *store_try_open_file(const char *filename)
+{
+    return _store_open_file(filename, true, true);
+}
+Store *store_open_file_copy(const char *filename)
+{
+    return _store_open_file(filename, false, true);
+}
+void store_write_file(Store *s, const char *filename)
+{
+    FILE *f;
+    bool failed;
+
+    f = fopen(filename, "wb");
+    error_assert(f, "file '%s' must be open for writing", filename);
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+
+    if (s->binary)
+        _store_write_binary_file(s, f);
+    else
+        _store_write_text_file(s, f);
+
+    failed = ferror(f);
+    failed = fclose(f) != 0 || failed;
+    error_assert(!failed, "file '%s' must be written fully", filename);
+}
+
+void store_close(Store *s)
+{
+    Arena *arena = s->arena;
+    MapFile *map = s->map;
+
+    _store_free(s);
+    if (arena)
+        _arena_free(arena);
+    if (map)
+        mapfile_close(map);
+}
+
+void store_rewind(Store *s)
+{
+    Store *c;
+
+    s->sm->pos = 0;
+    s->iterchild = s->child;
+    for (c = s->child; c; c = c->sibling)
+        store_rewind(c);
+}
+
+void store_reverse(Store *s)
+{
+    Store *c, *t, *r = NULL;
+
+    for (c = s->child; c; c = t)
+    {
+        t = c->sibling;
+        c->sibling = r;
+        r = c;
+        store_reverse(c);
+    }
+    s->child = s->iterchild = r;
+
+    /* earliest in list wins in index, so that changed too */
+    free(s->index);
+    s->index = NULL;
+    s->index_capacity = 0;
+}
+
+/* --- copy/compare -------------------------------------------------------- */
+
+const char *store_get_name(Store *s)
+{
+    return s->name;
+}
+unsigned int store_get_num_children(Store *s)
+{
+    return s->nchildren;
+}
+
+const char *store_get_data(Store *s)
+{
+    error_assert(!s->binary, "must be a text store");
+    _store_data(s);
+    return s->sm->buf;
+}
+void store_set_data(Store *s, const char *data)
+{
+    error_assert(!s->binary, "must be a text store");
+    _stream_deinit(s->sm);
+    _stream_init(s->sm);
+    if (data)
+        _stream_printf(s->sm, "%s", data);
+}
+
+static bool _data_equal(Store *a, Store *b)
+{
+    _store_data(a);
+    _store_data(b);
+
+    if (!a->sm->buf || !b->sm->buf)
+        return !a->sm->buf && !b->sm->buf;
+    if (a->binary)
+        return a->sm->len == b->sm->len
+            && !memcmp(a->sm->buf, b->sm->buf, a->sm->len);
+    return !strcmp(a->sm->buf, b->sm->buf);
+}
+
+bool store_equal(Store *a, Store *b)
+{
+    Store *c, *d;
+
+    if (a->name != b->name || a->compressed != b->compressed
+        || a->binary != b->binary || a->nchildren != b->nchildren
+        || !_data_equal(a, b))
+        return false;
+
+    for (c = a->child, d = b->child; c; c = c->sibling, d = d->sibling)
+        if (!store_equal(c, d))
+            return false;
+    return true;
+}
+
+Store *store_child_copy(Store *parent, Store *s)
+{
+    Store *c, *t, **children;
+    unsigned int i;
+
+    error_assert(!parent || parent->binary == s->binary,
+                 "binary and text stores can't be mixed");
+
+    c = _store_new(parent, s->name, NULL);
+    c->compressed = s->compressed;
+    c->binary = s->binary;
+
+    _store_data(s);
+    if (s->sm->buf && s->binary)
+        _stream_write_bytes(c->sm, s->sm->buf, s->sm->len);
+    else if (s->sm->buf)
+        _stream_printf(c->sm, "%s", s->sm->buf);
+
+    /* new children go first, so copy from the last to keep the order */
+    children = malloc(s->nchildren * sizeof(Store *));
+    for (i = 0, t = s->child; t; t = t->sibling)
+        children[i++] = t;
+    while (i > 0)
+        store_child_copy(c, children[--i]);
+    free(children);
+
+    return c;
+}
+
+/* --- primitives ---------------------------------------------------------- */
+
+#define _store_printf(s, fmt, ...) \
+    _stream_printf(s->sm, fmt, ##__VA_ARGS__)
+#define _store_scanf(s, fmt, ...) \
+    _stream_scanf(s->sm, fmt, ##__VA_ARGS__)
+
+/* use 'i' for infinity */
+void scalar_save(const Scalar *f, const char *n, Store *s)
+{
+    Store *t;
+
+    if (store_child_save(&t, n, s))
+    {
+        if (t->binary)
+            _bin_write_float(t->sm, *f);
+        else if (*f == SCALAR_INFINITY)
+            _store_printf(t, "i ");
+        else
+            _store_printf(t, "%f ", *f);
+    }
+}
+bool scalar_load(Scalar *f, const char *n, Scalar d, Store *s)
+{
+    Store *t;
 
     if (store_child_load(&t, n, s))
     {
-        if (t->sm->buf[t->sm->pos] == 'i')
+        if (t->binary)
+            *f = _bin_read_float(t->sm);
+        else if (_stream_peek(t->sm) == 'i')
         {
             *f = SCALAR_INFINITY;
             _store_scanf(t, "i ");
@@ -463,16 +1700,23 @@ void uint_save(const unsigned int *u, const char *n, Store *s)
     Store *t;
 
     if (store_child_save(&t, n, s))
-        _store_printf(t, "%u ", *u);
+    {
+        if (t->binary)
+            _bin_write_uint(t->sm, *u);
+        else
+            _store_printf(t, "%u ", *u);
+    }
 }
 bool uint_load(unsigned int *u, const char *n, unsigned int d, Store *s)
 {
     Store *t;
 
-    if (store_child_load(&t, n, s))
-        _store_scanf(t, "%u ", u);
-    else
+    if (!store_child_load(&t, n, s))
         *u = d;
+    else if (t->binary)
+        *u = _bin_read_uint(t->sm);
+    else
+        _store_scanf(t, "%u ", u);
     return t != NULL;
 }
 
@@ -481,16 +1725,23 @@ void int_save(const int *i, const char *n, Store *s)
     Store *t;
 
     if (store_child_save(&t, n, s))
-        _store_printf(t, "%d ", *i);
+    {
+        if (t->binary)
+            _bin_write_int(t->sm, *i);
+        else
+            _store_printf(t, "%d ", *i);
+    }
 }
 bool int_load(int *i, const char *n, int d, Store *s)
 {
     Store *t;
 
-    if (store_child_load(&t, n, s))
-        _store_scanf(t, "%d ", i);
-    else
+    if (!store_child_load(&t, n, s))
         *i = d;
+    else if (t->binary)
+        *i = _bin_read_int(t->sm);
+    else
+        _store_scanf(t, "%d ", i);
     return t != NULL;
 }
 
@@ -499,7 +1750,12 @@ void bool_save(const bool *b, const char *n, Store *s)
     Store *t;
 
     if (store_child_save(&t, n, s))
-        _store_printf(t, "%d ", (int) *b);
+    {
+        if (t->binary)
+            _bin_write_uint(t->sm, *b);
+        else
+            _store_printf(t, "%d ", (int) *b);
+    }
 }
 bool bool_load(bool *b, const char *n, bool d, Store *s)
 {
@@ -507,17 +1763,116 @@ bool bool_load(bool *b, const char *n, bool d, Store *s)
     Store *t;
 
     if (store_child_load(&t, n, s))
-        _store_scanf(t, "%d ", &i);
+    {
+        if (t->binary)
+            i = _bin_read_int(t->sm);
+        else
+            _store_scanf(t, "%d ", &i);
+    }
     *b = i;
     return t != NULL;
 }
 
+/*
+ * arrays are written into a single node as "<len> " followed by runs, a run
+ * of k > 1 equal values v written as "<k>*<v> " and a single value as "<v> "
+ * -- binary uses TAG_RUN values for runs
+ */
+void uint_array_save(const unsigned int *u, unsigned int len, const char *n,
+                     Store *s)
+{
+    Store *t;
+    unsigned int i, k;
+
+    if (store_child_save(&t, n, s))
+    {
+        if (t->binary)
+            _bin_write_uint(t->sm, len);
+        else
+            _store_printf(t, "%u ", len);
+        for (i = 0; i < len; i += k)
+        {
+            for (k = 1; i + k < len && u[i + k] == u[i]; ++k);
+            if (t->binary && k > 1)
+                _bin_write_run(t->sm, k, u[i]);
+            else if (t->binary)
+                _bin_write_uint(t->sm, u[i]);
+            else if (k > 1)
+                _store_printf(t, "%u*%u ", k, u[i]);
+            else
+                _store_printf(t, "%u ", u[i]);
+        }
+    }
+}
+/* k = 1 for a single value */
+static void _uint_array_read_run(Store *t, unsigned int *k, unsigned int *v)
+{
+    if (t->binary)
+    {
+        if (_stream_peek_byte(t->sm) == TAG_RUN)
+        {
+            _stream_read_byte(t->sm);
+            *k = _stream_read_varint(t->sm);
+            *v = _stream_read_varint(t->sm);
+        }
+        else
+        {
+            *k = 1;
+            *v = _bin_read_uint(t->sm);
+        }
+        return;
+    }
+
+    _store_scanf(t, "%u", k);
+    if (t->sm->buf[t->sm->pos] == '*')
+        _store_scanf(t, "*%u ", v);
+    else
+    {
+        _store_scanf(t, " ");
+        *v = *k;
+        *k = 1;
+    }
+}
+bool uint_array_load(unsigned int **u, unsigned int *len, const char *n,
+                     Store *s)
+{
+    Store *t;
+    unsigned int i, k, v;
+
+    if (!store_child_load(&t, n, s))
+    {
+        *u = NULL;
+        *len = 0;
+        return false;
+    }
+
+    if (t->binary)
+        *len = _bin_read_uint(t->sm);
+    else
+        _store_scanf(t, "%u ", len);
+    *u = malloc(*len * sizeof(unsigned int));
+    for (i = 0; i < *len; )
+    {
+        _uint_array_read_run(t, &k, &v);
+        if (i + k > *len)
+            error("corrupt save");
+        while (k--)
+            (*u)[i++] = v;
+    }
+    return true;
+}
+
 void string_save(const char **c, const char *n, Store *s)
 {
     Store *t;
 
     if (store_child_save(&t, n, s))
-        _stream_write_string(t->sm, *c);
+    {
+        if (t->binary)
+            _bin_write_string(t->sm, *c);
+        else
+            _stream_write_string(t->sm, *c);
+    }
 }
 bool string_load(char **c, const char *n, const char *d, Store *s)
 {
@@ -525,7 +1880,7 @@ bool string_load(char **c, const char *n, const char *d, Store *s)
 
     if (store_child_load(&t, n, s))
     {
-        *c = _stream_read_string(t->sm);
+        *c = t->binary ? _bin_read_string(t->sm) : _stream_read_string(t->sm);
         return true;
     }
 
@@ -26,8 +26,59 @@ SCRIPT(saveload,
        EXPORT void store_write_file(Store *s, const char *filename);
        EXPORT void store_close(Store *s);
 
+       /*
+        * binary stores are written to file in a compact binary format
+        * rather than text, store_open_file(...) reads either -- only on
+        * root stores, converts anything already saved
+        */
+       EXPORT void store_set_binary(Store *s, bool binary);
+       EXPORT bool store_get_binary(Store *s);
+
     )
 
+void saveload_init();
+void saveload_deinit(); /* all stores must be closed */
+
+/*
+ * like store_open_file_copy(...) but NULL rather than error(...) if the file
+ * can't be opened or is corrupt, so can be used off the main thread -- the
+ * store is often kept over many frames while the file may be saved over
+ */
+Store *store_try_open_file(const char *filename);
+
+/*
+ * like store_open_file(...) but reads the file into memory, for stores kept
+ * open while the file may be written over
+ */
+Store *store_open_file_copy(const char *filename);
+
+/* start reading s and its descendants from the beginning again */
+void store_rewind(Store *s);
+
+/*
+ * reverse the order of children of s and its descendants -- children read
+ * from a file or string are listed in the reverse of the order they were
+ * written in, so reverse before writing a read store back out to keep it
+ */
+void store_reverse(Store *s);
+
+/* names are interned, so equal names give equal pointers */
+const char *store_get_name(Store *s);
+unsigned int store_get_num_children(Store *s);
+
+/* data of a node in a text store as saved, NULL if none */
+const char *store_get_data(Store *s);
+void store_set_data(Store *s, const char *data);
+
+/* same names, data and children in the same order */
+bool store_equal(Store *a, Store *b);
+
+/*
+ * copy of s and its descendants as a new child of parent, or as a new root
+ * if parent is NULL
+ */
+Store *store_child_copy(Store *parent, Store *s);
+
 /* store trees help with backwards-compatible save/load */
 bool store_child_save(Store **sp, const char *name, Store *parent);
 bool store_child_save_compressed(Store **sp, const char *name, Store *parent);
@@ -54,5 +105,12 @@ void string_save(const char **c, const char *n, Store *s);
 bool string_load(char **c, const char *n, const char *d, Store *s);
     /* must free(*c) later, copy of d (possibly NULL) if not found */
 
+/* whole array in one node, runs of equal values are stored compactly */
+void uint_array_save(const unsigned int *u, unsigned int len, const char *n,
+                     Store *s);
+bool uint_array_load(unsigned int **u, unsigned int *len, const char *n,
+                     Store *s);
+    /* must free(*u) later, NULL and *len = 0 if not found */
+
 #endif
 
@@ -1,11 +1,12 @@
 #include "scratch.h"
 
+#include <stddef.h>
 #include <stdbool.h>
 #include <sys/stat.h>
-#include <time.h>
 
 #include "dirs.h"
 #include "script.h"
+#include "watch.h"
 
 static const char *filename = usr_path("scratch.lua");
 
@@ -15,24 +16,10 @@ bool _exists()
     return stat(filename, &st) == 0;
 }
 
-/* whether modified since last time _modified() was called, false at first */
-bool _modified()
+static void _changed(const char *f, void *data)
 {
-    struct stat st;
-    static time_t prev_time = 0;
-    bool modified;
-    static bool first = true;
-
-    if (stat(filename, &st) != 0)
-    {
-        first = false;
-        return false; /* doesn't exist or error */
-    }
-
-    modified = !first && st.st_mtime != prev_time;
-    prev_time = st.st_mtime;
-    first = false;
-    return modified;
+    if (_exists())
+        scratch_run();
 }
 
 void scratch_run()
@@ -40,8 +27,7 @@ void scratch_run()
     script_run_file(filename);
 }
 
-void scratch_update()
+void scratch_init()
 {
-    if (_modified())
-        scratch_run();
+    watch_add(filename, _changed, NULL);
 }
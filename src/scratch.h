@@ -2,6 +2,6 @@
 #define SCRATCH_H
 
 void scratch_run();
-void scratch_update();
+void scratch_init(); /* runs scratch file whenever it changes */
 
 #endif
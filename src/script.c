@@ -273,23 +273,97 @@ void script_save_all(Store *s)
     }
 }
 
+static void _load_str(const char *str)
+{
+    lua_getglobal(L, "cg");
+    lua_getfield(L, -1, "__load_all");
+    lua_remove(L, -2);
+    lua_pushstring(L, str);
+    errcheck(_pcall(L, 1, 0));
+}
+
 void script_load_all(Store *s)
 {
-    Store *t;
+    Store *t, *pool_s, *row_s;
     char *str;
 
     if (store_child_load(&t, "script", s))
+    {
         if (string_load(&str, "str", NULL, t))
         {
             /* send it to Lua */
-            lua_getglobal(L, "cg");
-            lua_getfield(L, -1, "__load_all");
-            lua_remove(L, -2);
-            lua_pushstring(L, str);
-            errcheck(_pcall(L, 1, 0));
+            _load_str(str);
 
             /* release */
             free(str);
         }
+
+        /* rows from script_save_ents(...), loaded just like the above */
+        if (store_child_load(&pool_s, "pool", t))
+            while (store_child_load(&row_s, NULL, pool_s))
+                if (string_load(&str, "str", NULL, row_s))
+                {
+                    _load_str(str);
+                    free(str);
+                }
+    }
+}
+
+void script_save_ents(Store *s, unsigned int n, const Entity *ents)
+{
+    Store *t, *pool_s, *row_s;
+    const char *str;
+    Entity ent;
+    unsigned int i;
+
+    if (store_child_save(&t, "script", s)
+        && store_child_save(&pool_s, "pool", t))
+        for (i = 0; i < n; ++i)
+        {
+            /* Lua filters to one entity at a time, see cg.__save_ent(...) */
+            ent = ents[i];
+            entity_clear_save_filters();
+            entity_set_save_filter(ent, true);
+
+            lua_getglobal(L, "cg");
+            lua_getfield(L, -1, "__save_ent");
+            lua_remove(L, -2);
+            _push_cdata("Entity *", &ent);
+            errcheck(_pcall(L, 1, 1));
+            str = lua_tostring(L, -1);
+
+            /* saved like an entitypool row, nothing if no data */
+            if (str && store_child_save(&row_s, NULL, pool_s))
+            {
+                entity_save(&ent, "pool_elem", row_s);
+                string_save(&str, "str", row_s);
+            }
+
+            lua_pop(L, 1);
+        }
+
+    /* put the filter back for whatever saves after */
+    entity_clear_save_filters();
+    for (i = 0; i < n; ++i)
+        entity_set_save_filter(ents[i], true);
+}
+
+
+void script_remove(Entity ent)
+{
+    lua_getglobal(L, "cg");
+    lua_getfield(L, -1, "__remove_ent");
+    lua_remove(L, -2);
+    _push_cdata("Entity *", &ent);
+    errcheck(_pcall(L, 1, 0));
 }
 
+void script_clone(Entity from, Entity to)
+{
+    lua_getglobal(L, "cg");
+    lua_getfield(L, -1, "__clone");
+    lua_remove(L, -2);
+    _push_cdata("Entity *", &from);
+    _push_cdata("Entity *", &to);
+    errcheck(_pcall(L, 2, 0));
+}
@@ -4,6 +4,7 @@
 #include "scalar.h"
 #include "script_export.h"
 #include "saveload.h"
+#include "entity.h"
 #include "input.h"
 
 void script_run_string(const char *s);
@@ -23,6 +24,9 @@ void script_mouse_move(Vec2 pos);
 void script_scroll(Vec2 scroll);
 void script_save_all(Store *s);
 void script_load_all(Store *s);
+void script_save_ents(Store *s, unsigned int n, const Entity *ents);
+void script_remove(Entity ent); /* just what script_save_ents(...) saves */
+void script_clone(Entity from, Entity to);
 
 #endif
 
@@ -336,3 +336,26 @@ void sound_load_all(Store *s)
             ga_handle_setParamf(sound->handle, GA_HANDLE_PARAM_GAIN, gain);
         }
 }
+
+void sound_clone(Entity from, Entity to)
+{
+    Sound *sound, *src;
+    gc_float32 gain;
+
+    sound = entitypool_clone(pool, from, to);
+    if (!sound)
+        return;
+    src = entitypool_get(pool, from);
+
+    /* own handle on same file, in same state */
+    sound->path = NULL;
+    sound->handle = NULL;
+    _set_path(sound, src->path);
+
+    if (ga_handle_playing(src->handle))
+        ga_handle_play(sound->handle);
+    ga_handle_seek(sound->handle,
+                   ga_handle_tell(src->handle, GA_TELL_PARAM_CURRENT));
+    ga_handle_getParamf(src->handle, GA_HANDLE_PARAM_GAIN, &gain);
+    ga_handle_setParamf(sound->handle, GA_HANDLE_PARAM_GAIN, gain);
+}
@@ -35,5 +35,6 @@ void sound_deinit();
 void sound_update_all();
 void sound_save_all(Store *s);
 void sound_load_all(Store *s);
+void sound_clone(Entity from, Entity to);
 
 #endif
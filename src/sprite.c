@@ -11,9 +11,9 @@
 #include "saveload.h"
 #include "transform.h"
 #include "gfx.h"
-#include "camera.h"
 #include "texture.h"
 #include "edit.h"
+#include "array.h"
 
 typedef struct Sprite Sprite;
 struct Sprite
@@ -25,27 +25,186 @@ struct Sprite
     Vec2 size;
     Vec2 texcell;
     Vec2 texsize;
+    float layer; /* layer in texture array, resolved before drawing */
 
     int depth;
+
+    int tex;   /* index into textures, -1 to use atlas */
+    int sheet; /* index into sheets, resolved before drawing */
+
+    unsigned int dirty_count; /* transform world dirty count at last update */
+    bool dirty; /* needs wmat update and/or upload to GPU buffer */
 };
 
 static EntityPool *pool;
 
+/*
+ * sprites are kept in a GPU buffer across frames, in the same order as in
+ * the pool -- if order changes everything is sorted and uploaded again,
+ * otherwise only dirty rows are patched, so sprites that don't change cost
+ * nothing to upload
+ */
+static bool order_dirty = true;   /* need resolve, sort, full upload */
+static unsigned int capacity = 0; /* number of rows allocated in vbo */
+
 static char *atlas = NULL;
+static int atlas_tex = -1;
+
+/*
+ * every texture used by some sprite gets an entry in 'textures', and
+ * textures with equal size are packed as layers of one GL_TEXTURE_2D_ARRAY
+ * in 'sheets' -- a draw call can then cover all sprites using a sheet
+ */
+typedef struct SpriteTexture SpriteTexture;
+struct SpriteTexture
+{
+    TextureHandle handle;
+    int sheet;
+    int layer;
+};
+
+typedef struct Sheet Sheet;
+struct Sheet
+{
+    Vec2 size; /* (width, height) of each layer */
+    unsigned int nlayers;
+    GLuint gl_name;
+};
+
+static Array *textures;
+static Array *sheets;
+static bool sheets_dirty = true;
+static unsigned int sheets_generation = 0; /* texture_get_generation()
+                                              when sheets were built */
 
 /* GL stuff */
 static GLuint program;
 static GLuint vao;
 static GLuint vbo;
+static GLint atlas_size_loc;
+
+/* ------------------------------------------------------------------------- */
+
+/* --- sheets -------------------------------------------------------------- */
+
+/* find texture entry for filename, add if new -- -1 if couldn't load */
+static int _texture_find(const char *filename)
+{
+    SpriteTexture *tex;
+    TextureHandle handle;
+
+    handle = texture_load(filename);
+    array_foreach(tex, textures)
+        if (tex->handle == handle)
+            return tex - (SpriteTexture *) array_begin(textures);
+
+    if (!texture_is_loaded(handle))
+        return -1;
+
+    tex = array_add(textures);
+    tex->handle = handle;
+    tex->sheet = -1;
+    tex->layer = 0;
+    sheets_dirty = true;
+    return array_length(textures) - 1;
+}
+
+static void _sheets_clear()
+{
+    Sheet *sheet;
+
+    array_foreach(sheet, sheets)
+        gfx_delete_texture(sheet->gl_name);
+    array_clear(sheets);
+}
+
+/* group textures by size, copy each group into a texture array */
+static void _sheets_build()
+{
+    SpriteTexture *tex;
+    Sheet *sheet;
+    Vec2 size;
+    unsigned int i;
+    unsigned char *pixels = NULL;
+    size_t pixels_size = 0, n;
+
+    _sheets_clear();
+
+    /* assign layers */
+    array_foreach(tex, textures)
+    {
+        size = texture_get_size(tex->handle);
+        for (i = 0; i < array_length(sheets); ++i)
+        {
+            sheet = array_get(sheets, i);
+            if (sheet->size.x == size.x && sheet->size.y == size.y)
+                break;
+        }
+        if (i == array_length(sheets))
+        {
+            sheet = array_add(sheets);
+            sheet->size = size;
+            sheet->nlayers = 0;
+        }
+        tex->sheet = i;
+        tex->layer = sheet->nlayers++;
+    }
+
+    /* allocate arrays */
+    gfx_context_acquire();
+    glActiveTexture(GL_TEXTURE0);
+    array_foreach(sheet, sheets)
+    {
+        glGenTextures(1, &sheet->gl_name);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sheet->gl_name);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA,
+                     sheet->size.x, sheet->size.y, sheet->nlayers,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    /* copy each texture into its layer -- data is already on the GPU so just
+       read it back rather than decoding the image again */
+    array_foreach(tex, textures)
+    {
+        sheet = array_get(sheets, tex->sheet);
+        n = 4 * (size_t) sheet->size.x * (size_t) sheet->size.y;
+        if (n > pixels_size)
+            pixels = realloc(pixels, pixels_size = n);
+
+        texture_bind(tex->handle);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sheet->gl_name);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, tex->layer,
+                        sheet->size.x, sheet->size.y, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    }
+    gfx_context_release();
+    free(pixels);
+
+    sheets_dirty = false;
+    sheets_generation = texture_get_generation();
+    order_dirty = true;
+}
+
+/* rebuild if textures were added or reloaded */
+static void _sheets_update()
+{
+    if (sheets_dirty || sheets_generation != texture_get_generation())
+        _sheets_build();
+}
 
 /* ------------------------------------------------------------------------- */
 
 /* copy string from filename, err is whether to error(...) if bad */
 static void _set_atlas(const char *filename, bool err)
 {
-    Vec2 atlas_size;
+    int tex;
 
-    if (!texture_load(filename))
+    tex = _texture_find(filename);
+    if (tex < 0)
     {
         if (err)
             error("couldn't load atlas from path '%s', check path and format",
@@ -56,11 +215,8 @@ static void _set_atlas(const char *filename, bool err)
     free(atlas);
     atlas = malloc(strlen(filename) + 1);
     strcpy(atlas, filename);
-
-    atlas_size = texture_get_size(atlas);
-    glUseProgram(program);
-    glUniform2fv(glGetUniformLocation(program, "atlas_size"), 1,
-                 (const GLfloat *) &atlas_size);
+    atlas_tex = tex;
+    order_dirty = true;
 }
 void sprite_set_atlas(const char *filename)
 {
@@ -85,9 +241,19 @@ void sprite_add(Entity ent)
     sprite->texcell = vec2(32.0f, 32.0f);
     sprite->texsize = vec2(32.0f, 32.0f);
     sprite->depth = 0;
+    sprite->tex = -1;
+    sprite->sheet = 0;
+    sprite->layer = 0;
+    sprite->wmat = transform_get_world_matrix(ent);
+    sprite->dirty_count = transform_get_world_dirty_count(ent);
+    sprite->dirty = true;
+
+    order_dirty = true;
 }
 void sprite_remove(Entity ent)
 {
+    if (entitypool_get(pool, ent))
+        order_dirty = true;
     entitypool_remove(pool, ent);
 }
 bool sprite_has(Entity ent)
@@ -95,11 +261,51 @@ bool sprite_has(Entity ent)
     return entitypool_get(pool, ent) != NULL;
 }
 
+/* err is whether to error(...) if bad */
+static void _set_texture(Sprite *sprite, const char *filename, bool err)
+{
+    int tex;
+
+    if (!filename)
+    {
+        sprite->tex = -1;
+        order_dirty = true;
+        return;
+    }
+
+    tex = _texture_find(filename);
+    if (tex < 0)
+    {
+        if (err)
+            error("couldn't load sprite texture from path '%s', check path "
+                  "and format", filename);
+        return;
+    }
+    sprite->tex = tex;
+    order_dirty = true;
+}
+void sprite_set_texture(Entity ent, const char *filename)
+{
+    Sprite *sprite = entitypool_get(pool, ent);
+    error_assert(sprite);
+    _set_texture(sprite, filename, true);
+}
+const char *sprite_get_texture(Entity ent)
+{
+    Sprite *sprite = entitypool_get(pool, ent);
+    error_assert(sprite);
+    if (sprite->tex < 0)
+        return atlas;
+    return texture_get_filename(array_get_val(SpriteTexture, textures,
+                                              sprite->tex).handle);
+}
+
 void sprite_set_size(Entity ent, Vec2 size)
 {
     Sprite *sprite = entitypool_get(pool, ent);
     error_assert(sprite);
     sprite->size = size;
+    sprite->dirty = true;
 }
 Vec2 sprite_get_size(Entity ent)
 {
@@ -113,6 +319,7 @@ void sprite_set_texcell(Entity ent, Vec2 texcell)
     Sprite *sprite = entitypool_get(pool, ent);
     error_assert(sprite);
     sprite->texcell = texcell;
+    sprite->dirty = true;
 }
 Vec2 sprite_get_texcell(Entity ent)
 {
@@ -125,6 +332,7 @@ void sprite_set_texsize(Entity ent, Vec2 texsize)
     Sprite *sprite = entitypool_get(pool, ent);
     error_assert(sprite);
     sprite->texsize = texsize;
+    sprite->dirty = true;
 }
 Vec2 sprite_get_texsize(Entity ent)
 {
@@ -138,6 +346,7 @@ void sprite_set_depth(Entity ent, int depth)
     Sprite *sprite = entitypool_get(pool, ent);
     error_assert(sprite);
     sprite->depth = depth;
+    order_dirty = true;
 }
 int sprite_get_depth(Entity ent)
 {
@@ -150,8 +359,10 @@ int sprite_get_depth(Entity ent)
 
 void sprite_init()
 {
-    /* initialize pool */
+    /* initialize pool, texture tables */
     pool = entitypool_new(Sprite);
+    textures = array_new(SpriteTexture);
+    sheets = array_new(Sheet);
 
     /* create shader program, load atlas */
     program = gfx_create_program(data_path("sprite.vert"),
@@ -159,6 +370,7 @@ void sprite_init()
                                  data_path("sprite.frag"));
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "tex0"), 0);
+    atlas_size_loc = glGetUniformLocation(program, "atlas_size");
     sprite_set_atlas(data_path("default.png"));
 
     /* make vao, vbo, bind attributes */
@@ -172,17 +384,21 @@ void sprite_init()
     gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "size", Sprite, size);
     gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "texcell", Sprite, texcell);
     gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "texsize", Sprite, texsize);
+    gfx_bind_vertex_attrib(program, GL_FLOAT, 1, "layer", Sprite, layer);
 }
 
 void sprite_deinit()
 {
     /* clean up GL stuff */
+    _sheets_clear();
     glDeleteProgram(program);
     glDeleteBuffers(1, &vbo);
     glDeleteVertexArrays(1, &vao);
 
-    /* deinit pool */
+    /* deinit pool, texture tables */
     entitypool_free(pool);
+    array_free(textures);
+    array_free(sheets);
 
     free(atlas);
 }
@@ -190,13 +406,22 @@ void sprite_deinit()
 void sprite_update_all()
 {
     Sprite *sprite;
+    unsigned int dirty_count;
     static Vec2 min = { -0.5, -0.5 }, max = { 0.5, 0.5 };
 
     entitypool_remove_destroyed(pool, sprite_remove);
 
-    /* update world transform matrices */
+    /* update world transform matrices of moved sprites */
     entitypool_foreach(sprite, pool)
-        sprite->wmat = transform_get_world_matrix(sprite->pool_elem.ent);
+    {
+        dirty_count = transform_get_world_dirty_count(sprite->pool_elem.ent);
+        if (sprite->dirty || dirty_count != sprite->dirty_count)
+        {
+            sprite->wmat = transform_get_world_matrix(sprite->pool_elem.ent);
+            sprite->dirty_count = dirty_count;
+            sprite->dirty = true;
+        }
+    }
 
     /* update edit bbox */
     if (edit_get_enabled())
@@ -210,42 +435,135 @@ static int _depth_compare(const void *a, const void *b)
 {
     const Sprite *sa = a, *sb = b;
 
-    /* descending, break ties by Entity id for stability */
-    if (sb->depth == sa->depth)
-        return ((int) sa->pool_elem.ent.id) - ((int) sb->pool_elem.ent.id);
-    return sb->depth - sa->depth;
+    /*
+     * descending depth, then group by sheet so that a draw call only
+     * needs to be made where sheet changes -- break remaining ties by
+     * Entity id for stability
+     */
+    if (sb->depth != sa->depth)
+        return sb->depth - sa->depth;
+    if (sa->sheet != sb->sheet)
+        return sa->sheet - sb->sheet;
+    return ((int) sa->pool_elem.ent.id) - ((int) sb->pool_elem.ent.id);
 }
 
-void sprite_draw_all()
+/*
+ * set sheet, layer of each sprite from its texture, sheet -1 if none --
+ * only changes when textures, sheets or atlas change, which also dirties
+ * order
+ */
+static void _resolve_textures()
 {
-    unsigned int nsprites;
+    Sprite *sprite;
+    SpriteTexture *tex;
+    int i;
 
-    /* depth sort */
-    entitypool_sort(pool, _depth_compare);
+    entitypool_foreach(sprite, pool)
+    {
+        i = sprite->tex >= 0 ? sprite->tex : atlas_tex;
+        if (i < 0)
+        {
+            sprite->sheet = -1;
+            continue;
+        }
+        tex = array_get(textures, i);
+        sprite->sheet = tex->sheet;
+        sprite->layer = tex->layer;
+    }
+}
 
-    /* bind program, update uniforms */
-    glUseProgram(program);
-    glUniformMatrix3fv(glGetUniformLocation(program, "inverse_view_matrix"),
-                       1, GL_FALSE,
-                       (const GLfloat *) camera_get_inverse_view_matrix_ptr());
+/* maximum gap between dirty rows to still upload them in one call */
+#define UPLOAD_MAX_GAP 16
 
-    /* bind atlas */
-    glActiveTexture(GL_TEXTURE0);
-    texture_bind(atlas);
+/* upload changed sprites to vbo */
+static void _upload()
+{
+    Sprite *sprites;
+    unsigned int nsprites, i, start, end;
 
-    /* draw! */
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
     nsprites = entitypool_size(pool);
-    glBufferData(GL_ARRAY_BUFFER, nsprites * sizeof(Sprite),
-                 entitypool_begin(pool), GL_STREAM_DRAW);
-    glDrawArrays(GL_POINTS, 0, nsprites);
+    sprites = entitypool_begin(pool);
+
+    /* everything? */
+    if (order_dirty || nsprites > capacity)
+    {
+        if (nsprites > capacity)
+        {
+            capacity = nsprites < 2 * capacity ? 2 * capacity : nsprites;
+            gfx_buffer_data(vbo, capacity * sizeof(Sprite), NULL,
+                            GL_DYNAMIC_DRAW);
+        }
+        gfx_buffer_sub_data(vbo, 0, nsprites * sizeof(Sprite), sprites);
+        for (i = 0; i < nsprites; ++i)
+            sprites[i].dirty = false;
+        return;
+    }
+
+    /* patch runs of dirty rows, merging runs separated by small gaps */
+    for (i = 0; i < nsprites; )
+    {
+        if (!sprites[i].dirty)
+        {
+            ++i;
+            continue;
+        }
+
+        start = end = i;
+        for (; i < nsprites && i <= end + UPLOAD_MAX_GAP; ++i)
+            if (sprites[i].dirty)
+            {
+                sprites[i].dirty = false;
+                end = i;
+            }
+
+        gfx_buffer_sub_data(vbo, start * sizeof(Sprite),
+                            (end - start + 1) * sizeof(Sprite),
+                            &sprites[start]);
+    }
+}
+
+void sprite_draw_all()
+{
+    Sprite *sprites;
+    Sheet *sheet;
+    GfxDraw *draw;
+    unsigned int nsprites, i, start, run;
+
+    /* resolve textures and depth sort only if something changed */
+    _sheets_update();
+    if (order_dirty)
+    {
+        _resolve_textures();
+        entitypool_sort(pool, _depth_compare);
+    }
+
+    /* upload */
+    _upload();
+    order_dirty = false;
+    nsprites = entitypool_size(pool);
+    sprites = entitypool_begin(pool);
+
+    /* draw! -- one call per run of sprites sharing a sheet */
+    for (start = 0, run = 0; start < nsprites; start = i, ++run)
+    {
+        for (i = start + 1; i < nsprites
+                 && sprites[i].sheet == sprites[start].sheet; ++i);
+
+        if (sprites[start].sheet < 0)
+            continue; /* no texture to draw with */
+        sheet = array_get(sheets, sprites[start].sheet);
+        draw = gfx_draw(GFX_LAYER_SPRITE, run, program, vao, GL_POINTS,
+                        start, i - start);
+        gfx_draw_texture(draw, GL_TEXTURE_2D_ARRAY, sheet->gl_name);
+        gfx_draw_uniform_vec2(draw, atlas_size_loc, sheet->size);
+    }
 }
 
 void sprite_save_all(Store *s)
 {
     Store *t, *sprite_s;
     Sprite *sprite;
+    const char *filename;
 
     if (store_child_save(&t, "sprite", s))
     {
@@ -253,6 +571,12 @@ void sprite_save_all(Store *s)
 
         entitypool_save_foreach(sprite, sprite_s, pool, "pool", t)
         {
+            if (sprite->tex >= 0)
+            {
+                filename = texture_get_filename(
+                    array_get_val(SpriteTexture, textures, sprite->tex).handle);
+                string_save(&filename, "texture", sprite_s);
+            }
             vec2_save(&sprite->size, "size", sprite_s);
             vec2_save(&sprite->texcell, "texcell", sprite_s);
             vec2_save(&sprite->texsize, "texsize", sprite_s);
@@ -264,7 +588,7 @@ void sprite_load_all(Store *s)
 {
     Store *t, *sprite_s;
     Sprite *sprite;
-    char *tatlas;
+    char *tatlas, *ttex;
 
     if (store_child_load(&t, "sprite", s))
     {
@@ -275,13 +599,41 @@ void sprite_load_all(Store *s)
             free(tatlas);
         }
 
+        order_dirty = true;
+
         entitypool_load_foreach(sprite, sprite_s, pool, "pool", t)
         {
             vec2_load(&sprite->size, "size", vec2(1, 1), sprite_s);
             vec2_load(&sprite->texcell, "texcell", vec2(32, 32), sprite_s);
             vec2_load(&sprite->texsize, "texsize", vec2(32, 32), sprite_s);
             int_load(&sprite->depth, "depth", 0, sprite_s);
+
+            sprite->wmat = transform_get_world_matrix(sprite->pool_elem.ent);
+            sprite->dirty_count
+                = transform_get_world_dirty_count(sprite->pool_elem.ent);
+            sprite->dirty = true;
+            sprite->tex = -1;
+            if (string_load(&ttex, "texture", NULL, sprite_s))
+            {
+                _set_texture(sprite, ttex, false);
+                free(ttex);
+            }
         }
     }
 }
 
+
+void sprite_clone(Entity from, Entity to)
+{
+    Sprite *sprite;
+
+    sprite = entitypool_clone(pool, from, to);
+    if (!sprite)
+        return;
+
+    sprite->wmat = transform_get_world_matrix(to);
+    sprite->dirty_count = transform_get_world_dirty_count(to);
+    sprite->dirty = true;
+
+    order_dirty = true;
+}
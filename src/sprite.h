@@ -15,6 +15,14 @@ SCRIPT(sprite,
        EXPORT void sprite_remove(Entity ent);
        EXPORT bool sprite_has(Entity ent);
 
+       /*
+        * texture to draw this sprite from, NULL to use the atlas --
+        * sprites are batched by texture, and textures of the same size
+        * share a texture array so they can still be drawn together
+        */
+       EXPORT void sprite_set_texture(Entity ent, const char *filename);
+       EXPORT const char *sprite_get_texture(Entity ent); /* atlas if unset */
+
        /* size to draw in world units, centered at transform position */
        EXPORT void sprite_set_size(Entity ent, Vec2 size);
        EXPORT Vec2 sprite_get_size(Entity ent);
@@ -39,6 +47,7 @@ void sprite_update_all();
 void sprite_draw_all();
 void sprite_save_all(Store *s);
 void sprite_load_all(Store *s);
+void sprite_clone(Entity from, Entity to);
 
 #endif
 
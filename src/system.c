@@ -1,22 +1,30 @@
 #include "system.h"
 
+#include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "entity.h"
 #include "prefab.h"
+#include "undo.h"
 #include "script.h"
 #include "timing.h"
 #include "input.h"
 #include "transform.h"
 #include "camera.h"
+#include "watch.h"
+#include "gfx.h"
 #include "texture.h"
 #include "sprite.h"
+#include "animation.h"
+#include "tilemap.h"
 #include "gui.h"
 #include "console.h"
 #include "scratch.h"
 #include "physics.h"
 #include "edit.h"
 #include "sound.h"
+#include "error.h"
 
 #include "test/keyboard_controlled.h"
 
@@ -55,18 +63,26 @@ static void _scroll(Vec2 scroll)
 
 void system_init()
 {
+    saveload_init();
     input_init();
     entity_init();
+    prefab_init();
+    undo_init();
     transform_init();
     camera_init();
+    watch_init();
+    gfx_init();
     texture_init();
     sprite_init();
+    animation_init();
+    tilemap_init();
     gui_init();
     console_init();
     sound_init();
     physics_init();
     edit_init();
     script_init();
+    scratch_init();
 
     input_add_key_down_callback(_key_down);
     input_add_key_up_callback(_key_up);
@@ -84,13 +100,20 @@ void system_deinit()
     physics_deinit();
     sound_deinit();
     console_deinit();
+    tilemap_deinit();
+    animation_deinit();
     sprite_deinit();
     gui_deinit();
     texture_deinit();
+    gfx_deinit();
+    watch_deinit();
     camera_deinit();
     transform_deinit();
+    undo_deinit();
+    prefab_deinit();
     entity_deinit();
     input_deinit();
+    saveload_deinit();
 }
 
 void system_update_all()
@@ -99,8 +122,8 @@ void system_update_all()
 
     timing_update();
 
+    watch_update();
     texture_update();
-    scratch_update();
 
     script_update_all();
 
@@ -110,7 +133,9 @@ void system_update_all()
     transform_update_all();
     camera_update_all();
     gui_update_all();
+    animation_update_all();
     sprite_update_all();
+    tilemap_update_all();
     sound_update_all();
 
     edit_update_all();
@@ -124,46 +149,199 @@ void system_update_all()
 
 void system_draw_all()
 {
+    gfx_update_frame_uniforms();
     script_draw_all();
+    tilemap_draw_all();
     sprite_draw_all();
     edit_draw_all();
     physics_draw_all();
     gui_draw_all();
+    gfx_flush();
 }
 
-/* do it this way so we save/load in the same order */
-static void _saveload_all(void *s, bool save)
+/*
+ * do it this way so we save/load in the same order -- save_ents is for
+ * systems that save differently for system_save_ents(...), NULL if not
+ */
+#define saveload(sys) { sys##_save_all, sys##_load_all, NULL }
+static const struct
 {
-#define saveload(sys)                                   \
-    if (save) sys##_save_all(s); else sys##_load_all(s)
+    void (*save)(Store *s);
+    void (*load)(Store *s);
+    void (*save_ents)(Store *s, unsigned int n, const Entity *ents);
+} saveloads[] = {
+    saveload(entity),
+    saveload(prefab),
+    saveload(timing),
+    saveload(transform),
+    saveload(camera),
+    saveload(sprite),
+    saveload(animation),
+    saveload(tilemap),
+    saveload(physics),
+    saveload(gui),
+    saveload(edit),
+    saveload(sound),
+
+    saveload(keyboard_controlled),
+
+    { script_save_all, script_load_all, script_save_ents },
+};
+#undef saveload
+#define NUM_SAVELOADS (sizeof(saveloads) / sizeof(saveloads[0]))
+
+void system_save_all(Store *s)
+{
+    unsigned int i;
 
     entity_load_all_begin();
+    for (i = 0; i < NUM_SAVELOADS; ++i)
+        saveloads[i].save(s);
+    entity_load_all_end();
+}
 
-    saveload(entity);
-    saveload(prefab);
-    saveload(timing);
-    saveload(transform);
-    saveload(camera);
-    saveload(sprite);
-    saveload(physics);
-    saveload(gui);
-    saveload(edit);
-    saveload(sound);
+void system_load_all(Store *s)
+{
+    unsigned int i;
 
-    saveload(keyboard_controlled);
+    entity_load_all_begin();
+    for (i = 0; i < NUM_SAVELOADS; ++i)
+        saveloads[i].load(s);
+    entity_load_all_end();
+}
 
-    saveload(script);
+void system_save_ents(Store *s, unsigned int n, const Entity *ents)
+{
+    unsigned int i;
+
+    if (n == 0)
+        return; /* no filter set would save everything */
 
+    entity_load_all_begin();
+    for (i = 0; i < n; ++i)
+        entity_set_save_filter(ents[i], true);
+    for (i = 0; i < NUM_SAVELOADS; ++i)
+        if (saveloads[i].save_ents)
+            saveloads[i].save_ents(s, n, ents);
+        else
+            saveloads[i].save(s);
     entity_load_all_end();
 }
 
-void system_save_all(Store *s)
+static void _edit_remove(Entity ent)
 {
-    _saveload_all(s, true);
+    edit_set_editable(ent, true);
 }
 
-void system_load_all(Store *s)
+/* how to take a row out of an entity, by system and pool as saved */
+static const struct
+{
+    const char *system, *pool;
+    void (*remove)(Entity ent);
+    bool linked; /* rows refer to each other */
+} removes[] = {
+    { "entity", "exists_pool", entity_destroy, false },
+    { "transform", "pool", transform_remove, true },
+    { "camera", "pool", camera_remove, false },
+    { "sprite", "pool", sprite_remove, false },
+    { "animation", "pool", animation_remove, false },
+    { "tilemap", "pool", tilemap_remove, false },
+    { "physics", "pool", physics_remove, false },
+    { "gui", "pool", gui_remove, false },
+    { "gui_rect", "pool", gui_rect_remove, false },
+    { "gui_text", "pool", gui_text_remove, false },
+    { "gui_textedit", "pool", gui_textedit_remove, false },
+    { "edit", "uneditable_pool", _edit_remove, false },
+    { "sound", "pool", sound_remove, false },
+
+    { "script", "pool", script_remove, false },
+};
+#define NUM_REMOVES (sizeof(removes) / sizeof(removes[0]))
+
+static unsigned int _remove_find(const char *system, const char *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_REMOVES; ++i)
+        if (!strcmp(removes[i].system, system)
+            && !strcmp(removes[i].pool, pool))
+            return i;
+    error("no row '%s' '%s' to remove", system, pool);
+    return 0;
+}
+void system_remove_row(const char *system, const char *pool, Entity ent)
 {
-    _saveload_all(s, false);
+    removes[_remove_find(system, pool)].remove(ent);
+}
+bool system_row_linked(const char *system, const char *pool)
+{
+    return removes[_remove_find(system, pool)].linked;
+}
+
+/*
+ * systems that can copy components directly, in the same order as above --
+ * Lua systems are done last through script
+ */
+static void (*const clones[])(Entity from, Entity to) = {
+    transform_clone,
+    camera_clone,
+    sprite_clone,
+    animation_clone,
+    tilemap_clone,
+    physics_clone,
+    gui_clone,
+    edit_clone,
+    sound_clone,
+
+    script_clone,
+};
+#define NUM_CLONES (sizeof(clones) / sizeof(clones[0]))
+
+void system_clone_all(unsigned int n, const Entity *ents)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < NUM_CLONES; ++i)
+        for (j = 0; j < n; ++j)
+            clones[i](ents[j], _entity_resolve_clone(ents[j]));
+}
+
+struct SystemLoad
+{
+    Store *s;
+    unsigned int next; /* index into saveloads[] */
+    struct EntityMap *map; /* saved id map between steps */
+};
+
+SystemLoad *system_load_all_begin(Store *s)
+{
+    SystemLoad *load = malloc(sizeof(SystemLoad));
+
+    load->s = s;
+    load->next = 0;
+    entity_load_all_begin();
+    load->map = entity_load_all_suspend();
+    return load;
+}
+bool system_load_all_step(SystemLoad *load)
+{
+    entity_load_all_resume(load->map);
+    saveloads[load->next++].load(load->s);
+
+    if (load->next < NUM_SAVELOADS)
+    {
+        load->map = entity_load_all_suspend();
+        return false;
+    }
+
+    entity_load_all_end();
+    free(load);
+    return true;
+}
+void system_load_all_cancel(SystemLoad *load)
+{
+    entity_load_all_resume(load->map);
+    entity_load_all_end();
+    free(load);
 }
 
@@ -2,6 +2,7 @@
 #define SYSTEM_H
 
 #include "saveload.h"
+#include "entity.h"
 #include "script_export.h"
 
 SCRIPT(system,
@@ -11,6 +12,40 @@ SCRIPT(system,
 
     )
 
+/*
+ * system_load_all(...) spread over several calls, one system per step --
+ * step returns true once done, when load is freed, and s must stay open
+ * until then
+ */
+typedef struct SystemLoad SystemLoad;
+SystemLoad *system_load_all_begin(Store *s);
+bool system_load_all_step(SystemLoad *load);
+void system_load_all_cancel(SystemLoad *load); /* frees, keeps what's
+                                                  loaded so far */
+
+/*
+ * save just ents, each as rows of its own in each system's pools -- Lua
+ * systems too, where system_save_all(...) saves all their data together --
+ * entities referred to must be among ents, nothing is saved if n is 0, and
+ * loading with system_load_all(...) merges the rows in
+ */
+void system_save_ents(Store *s, unsigned int n, const Entity *ents);
+
+/*
+ * take the row saved by system_save_ents(...) under system and pool names
+ * out of ent, so one saved earlier can be loaded back in -- rows of a
+ * linked pool refer to each other, so are only consistent if all those
+ * that do are replaced together
+ */
+void system_remove_row(const char *system, const char *pool, Entity ent);
+bool system_row_linked(const char *system, const char *pool);
+
+/*
+ * copy components of each ents[i] to its clone, claimed through
+ * entity_clone_add(...) beforehand -- parents must come before children
+ */
+void system_clone_all(unsigned int n, const Entity *ents);
+
 void system_init();
 void system_deinit();
 void system_update_all();
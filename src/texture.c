@@ -2,6 +2,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <GL/glew.h>
 #include <stb_image.h>
 #include <sys/stat.h>
@@ -10,47 +11,186 @@
 #include "error.h"
 #include "array.h"
 #include "console.h"
+#include "gfx.h"
+#include "watch.h"
+#include "thread.h"
+#include "mapfile.h"
+#include "cgtx.h"
 
 typedef struct Texture Texture;
 struct Texture
 {
     char *filename;
-    GLuint gl_name; /* 0 if uninitialized or error texture */
+    GLuint gl_name; /* placeholder while first decode is pending, 0 if
+                       file couldn't be found */
     int width;
     int height;
-    int components;
 
-    time_t last_modified;
+    time_t last_modified; /* of latest version queued for decoding */
+    unsigned int seq; /* of latest job queued, older ones are dropped */
 };
 
 static Array *textures;
+static unsigned int generation = 0;
 
-/* ------------------------------------------------------------------------- */
+static GLuint placeholder; /* 1x1 white, shown till decoded */
+
+/* --- decoding ------------------------------------------------------------ */
+
+/*
+ * images are decoded on worker threads -- the main thread queues a job and
+ * later, in texture_update(), uploads whatever's been decoded since
+ */
+
+typedef struct Job Job;
+struct Job
+{
+    TextureHandle tex;
+    unsigned int seq;
+    char *filename;
+    const unsigned char *data; /* RGBA, bottom row first, mipmap levels
+                                  one after another, NULL if failed */
+    int width;
+    int height;
+    unsigned int nlevels;
+    MapFile *map; /* data is in here if .cgtx */
+};
+
+#define NUM_WORKERS 2
+
+static Thread *workers[NUM_WORKERS];
+static Mutex *mutex;
+static Cond *cond;          /* signalled on any change to below */
+static Array *queued;       /* Job, waiting for a worker */
+static unsigned int queued_head = 0; /* next in queued to take, so taken in
+                                        order queued */
+static Array *decoded;      /* Job, waiting for upload */
+static unsigned int npending = 0; /* queued or being decoded */
+static bool stop_requested = false;
 
+/* flip rows so bottom row is first as GL expects, in place */
 static void _flip_image_vertical(unsigned char *data,
                                  unsigned int width, unsigned int height)
 {
-    unsigned int size, stride, i, j;
-    unsigned char *new_data;
+    unsigned int stride, i, j;
+    unsigned char *row;
 
-    size = width * height * 4;
     stride = sizeof(char) * width * 4;
+    row = malloc(stride);
+    for (i = 0, j = height - 1; i < j; ++i, --j)
+    {
+        memcpy(row, data + i * stride, stride);
+        memcpy(data + i * stride, data + j * stride, stride);
+        memcpy(data + j * stride, row, stride);
+    }
+    free(row);
+}
+
+/* point job at pixels of a .cgtx file, which are ready to upload as is */
+static void _map_cgtx(Job *job)
+{
+    const CgtxHeader *header;
+    size_t size, i;
+
+    job->data = NULL;
+    if (!(job->map = mapfile_open(job->filename)))
+        return;
 
-    new_data = malloc(sizeof(char) * size);
-    for (i = 0; i < height; i++)
+    /* check header, that all levels are there */
+    header = mapfile_data(job->map);
+    size = sizeof(CgtxHeader);
+    if (mapfile_size(job->map) >= size
+        && !memcmp(header->magic, CGTX_MAGIC, 4)
+        && header->version == CGTX_VERSION
+        && header->width > 0 && header->width <= CGTX_MAX_DIM
+        && header->height > 0 && header->height <= CGTX_MAX_DIM
+        && header->nlevels > 0 && header->nlevels <= CGTX_MAX_LEVELS)
+        for (i = 0; i < header->nlevels; ++i)
+            size += cgtx_level_size(header->width, header->height, i);
+    if (size == sizeof(CgtxHeader) || mapfile_size(job->map) < size)
     {
-        j = height - i - 1;
-        memcpy(new_data + j * stride, data + i * stride, stride);
+        mapfile_close(job->map);
+        job->map = NULL;
+        return;
     }
 
-    memcpy(data, new_data, size);
-    free(new_data);
+    job->data = (const unsigned char *) (header + 1);
+    job->width = header->width;
+    job->height = header->height;
+    job->nlevels = header->nlevels;
 }
 
-static bool _load(Texture *tex)
+static void _decode(Job *job)
 {
-    struct stat st;
     unsigned char *data;
+    int components;
+
+    data = stbi_load(job->filename, &job->width, &job->height,
+                     &components, 4);
+    if (data)
+        _flip_image_vertical(data, job->width, job->height);
+    job->data = data;
+    job->nlevels = 1;
+    job->map = NULL;
+}
+
+static void _job_free_data(Job *job)
+{
+    if (job->map)
+        mapfile_close(job->map);
+    else if (job->data)
+        stbi_image_free((unsigned char *) job->data);
+}
+
+static bool _is_cgtx(const char *filename)
+{
+    const char *dot = strrchr(filename, '.');
+    return dot && !strcmp(dot, ".cgtx");
+}
+
+static void _worker(void *data)
+{
+    Job job;
+
+    mutex_lock(mutex);
+    for (;;)
+    {
+        if (queued_head < array_length(queued))
+        {
+            job = array_get_val(Job, queued, queued_head++);
+            if (queued_head == array_length(queued))
+            {
+                array_clear(queued);
+                queued_head = 0;
+            }
+            mutex_unlock(mutex);
+
+            if (_is_cgtx(job.filename))
+                _map_cgtx(&job);
+            else
+                _decode(&job);
+
+            mutex_lock(mutex);
+            array_add_val(Job, decoded) = job;
+            --npending;
+            cond_broadcast(cond);
+        }
+        else if (stop_requested)
+            break;
+        else
+            cond_wait(cond, mutex);
+    }
+    mutex_unlock(mutex);
+}
+
+/* queue decode of texture if file changed since last queued */
+static void _load(TextureHandle handle)
+{
+    Texture *tex;
+    struct stat st;
+    Job *job;
+
+    tex = array_get(textures, handle);
 
     /* already have latest? */
     if (stat(tex->filename, &st) != 0)
@@ -61,108 +201,335 @@ static bool _load(Texture *tex)
                            tex->filename);
             time(&tex->last_modified);
         }
-        return false;
+        return;
     }
     if (st.st_mtime == tex->last_modified)
-        return tex->gl_name != 0;
+        return;
+    tex->last_modified = st.st_mtime;
 
-    console_printf("texture: loading texture '%s' ...", tex->filename);
+    /* first load? show placeholder meanwhile */
+    if (tex->gl_name == 0)
+    {
+        tex->gl_name = placeholder;
+        tex->width = tex->height = 1;
+    }
+
+    mutex_lock(mutex);
+    job = array_add(queued);
+    job->tex = handle;
+    job->seq = ++tex->seq;
+    job->filename = tex->filename; /* freed only at deinit */
+    ++npending;
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+}
+
+static void _upload(Job *job)
+{
+    Texture *tex;
+    const unsigned char *data;
+    unsigned int level;
 
-    /* read in texture data */
-    data = stbi_load(tex->filename, &tex->width, &tex->height,
-                     &tex->components, 0);
-    if (!data)
+    tex = array_get(textures, job->tex);
+
+    /* newer version queued since? may be decoded after, wait for it */
+    if (job->seq != tex->seq)
+    {
+        _job_free_data(job);
+        return;
+    }
+
+    console_printf("texture: loading texture '%s' ...", tex->filename);
+    if (!job->data)
     {
-        tex->last_modified = st.st_mtime;
         console_printf(" unsuccessful\n");
-        return false; /* keep old GL texture */
+        return; /* keep old GL texture */
     }
 
-    /* release old GL texture if exists */
-    if (tex->gl_name != 0)
-        glDeleteTextures(1, &tex->gl_name);
+    /* release old GL texture if exists -- frames in flight may use it */
+    if (tex->gl_name != placeholder)
+        gfx_delete_texture(tex->gl_name);
 
-    /* generate GL texture */
+    /* generate GL texture, copy data */
     glGenTextures(1, &tex->gl_name);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tex->gl_name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    job->nlevels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, job->nlevels - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (level = 0, data = job->data; level < job->nlevels; ++level)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA,
+                     cgtx_level_dim(job->width, level),
+                     cgtx_level_dim(job->height, level),
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        data += cgtx_level_size(job->width, job->height, level);
+    }
+    _job_free_data(job);
+
+    tex->width = job->width;
+    tex->height = job->height;
+    ++generation;
+    console_printf(" successful\n");
+}
+
+/* upload all decoded jobs */
+static void _upload_decoded()
+{
+    Array *jobs;
+    Job *job;
+
+    /* take whole list so workers can go on meanwhile */
+    mutex_lock(mutex);
+    if (array_length(decoded) == 0)
+    {
+        mutex_unlock(mutex);
+        return;
+    }
+    jobs = decoded;
+    decoded = array_new(Job);
+    mutex_unlock(mutex);
+
+    gfx_context_acquire();
+    array_foreach(job, jobs)
+        _upload(job);
+    gfx_context_release();
+    array_free(jobs);
+}
+
+static void _placeholder_init()
+{
+    static const unsigned char white[4] = { 255, 255, 255, 255 };
+
+    glGenTextures(1, &placeholder);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, placeholder);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+}
 
-    /* copy texture data to GL */
-    _flip_image_vertical(data, tex->width, tex->height);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->width, tex->height,
-                 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free(data);
+void texture_wait_all()
+{
+    mutex_lock(mutex);
+    while (npending > 0)
+        cond_wait(cond, mutex);
+    mutex_unlock(mutex);
 
-    tex->last_modified = st.st_mtime;
-    console_printf(" successful\n");
-    return true;
+    _upload_decoded();
 }
 
-static Texture *_find(const char *filename)
+/* --- path index ---------------------------------------------------------- */
+
+/*
+ * open addressing hash from filename to handle + 1, 0 for empty slot --
+ * textures are never removed so there are no tombstones, kept at most half
+ * full
+ */
+static unsigned int *index_slots = NULL;
+static unsigned int index_capacity = 0; /* power of two */
+
+static unsigned int _hash(const char *s)
 {
+    unsigned int h = 2166136261u; /* FNV-1a */
+    for (; *s; ++s)
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    return h;
+}
+
+/* slot for filename -- either holding it or the empty one to insert at */
+static unsigned int *_index_slot(const char *filename)
+{
+    unsigned int i, *slot;
     Texture *tex;
 
-    array_foreach(tex, textures)
+    for (i = _hash(filename) & (index_capacity - 1); ;
+         i = (i + 1) & (index_capacity - 1))
+    {
+        slot = &index_slots[i];
+        if (*slot == 0)
+            return slot;
+        tex = array_get(textures, *slot - 1);
         if (!strcmp(tex->filename, filename))
-            return tex;
-    return NULL;
+            return slot;
+    }
 }
 
-bool texture_load(const char *filename)
+static void _index_grow()
 {
+    unsigned int *old_slots, old_capacity, i;
     Texture *tex;
 
+    old_slots = index_slots;
+    old_capacity = index_capacity;
+    index_capacity = old_capacity ? 2 * old_capacity : 64;
+    index_slots = calloc(index_capacity, sizeof(unsigned int));
+
+    for (i = 0; i < old_capacity; ++i)
+        if (old_slots[i])
+        {
+            tex = array_get(textures, old_slots[i] - 1);
+            *_index_slot(tex->filename) = old_slots[i];
+        }
+    free(old_slots);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* reload when file changes */
+static void _changed(const char *filename, void *data)
+{
+    _load((uintptr_t) data);
+}
+
+static Texture *_get(TextureHandle tex)
+{
+    error_assert(tex < array_length(textures), "texture handle must be valid");
+    return array_get(textures, tex);
+}
+
+bool texture_find(TextureHandle *tex, const char *filename)
+{
+    unsigned int *slot;
+
+    slot = _index_slot(filename);
+    if (*slot == 0)
+        return false;
+    *tex = *slot - 1;
+    return true;
+}
+
+TextureHandle texture_load(const char *filename)
+{
+    Texture *tex;
+    unsigned int *slot;
+
     /* already exists? */
-    if ((tex = _find(filename)))
-        return tex->gl_name != 0;
+    slot = _index_slot(filename);
+    if (*slot)
+        return *slot - 1;
 
     tex = array_add(textures);
     tex->gl_name = 0;
+    tex->width = tex->height = 0;
     tex->last_modified = 0;
+    tex->seq = 0;
     tex->filename = malloc(strlen(filename) + 1);
     strcpy(tex->filename, filename);
-    return _load(tex);
+    _load(array_length(textures) - 1);
+    watch_add(filename, _changed,
+              (void *) (uintptr_t) (array_length(textures) - 1));
+
+    /* index it, growing if over half full */
+    if (2 * array_length(textures) > index_capacity)
+        _index_grow();
+    *_index_slot(filename) = array_length(textures);
+    return array_length(textures) - 1;
 }
 
-void texture_bind(const char *filename)
+bool texture_is_loaded(TextureHandle tex)
 {
-    Texture *tex;
+    return _get(tex)->gl_name != 0;
+}
 
-    tex = _find(filename);
-    if (tex && tex->gl_name != 0)
-        glBindTexture(GL_TEXTURE_2D, tex->gl_name);
+const char *texture_get_filename(TextureHandle tex)
+{
+    return _get(tex)->filename;
 }
 
-Vec2 texture_get_size(const char *filename)
+void texture_bind(TextureHandle tex)
 {
-    Texture *tex;
+    Texture *t = _get(tex);
+    if (t->gl_name != 0)
+        glBindTexture(GL_TEXTURE_2D, t->gl_name);
+}
+
+unsigned int texture_get_gl_name(TextureHandle tex)
+{
+    return _get(tex)->gl_name;
+}
+
+Vec2 texture_get_size(TextureHandle tex)
+{
+    Texture *t = _get(tex);
+    return vec2(t->width, t->height);
+}
 
-    tex = _find(filename);
-    error_assert(tex);
-    return vec2(tex->width, tex->height);
+bool texture_load_file(const char *filename)
+{
+    return texture_is_loaded(texture_load(filename));
+}
+Vec2 texture_get_size_file(const char *filename)
+{
+    TextureHandle tex;
+
+    if (!texture_find(&tex, filename))
+        error("texture '%s' must be loaded", filename);
+    return texture_get_size(tex);
+}
+
+unsigned int texture_get_generation()
+{
+    return generation;
 }
 
 /* ------------------------------------------------------------------------- */
 
 void texture_init()
 {
+    unsigned int i;
+
     textures = array_new(Texture);
+    _index_grow();
+    _placeholder_init();
+
+    queued = array_new(Job);
+    decoded = array_new(Job);
+    mutex = mutex_new();
+    cond = cond_new();
+    for (i = 0; i < NUM_WORKERS; ++i)
+        workers[i] = thread_new(_worker, NULL);
 }
 void texture_deinit()
 {
     Texture *tex;
+    Job *job;
+    unsigned int i;
+
+    /* stop workers, dropping queued jobs */
+    mutex_lock(mutex);
+    npending -= array_length(queued) - queued_head;
+    array_clear(queued);
+    queued_head = 0;
+    stop_requested = true;
+    cond_broadcast(cond);
+    mutex_unlock(mutex);
+    for (i = 0; i < NUM_WORKERS; ++i)
+        thread_join(workers[i]);
+    array_foreach(job, decoded)
+        _job_free_data(job);
+    array_free(decoded);
+    array_free(queued);
+    cond_free(cond);
+    mutex_free(mutex);
+
     array_foreach(tex, textures)
+    {
+        if (tex->gl_name != placeholder)
+            glDeleteTextures(1, &tex->gl_name);
         free(tex->filename);
+    }
+    glDeleteTextures(1, &placeholder);
     array_free(textures);
+    free(index_slots);
+    index_slots = NULL;
+    index_capacity = 0;
 }
 
 void texture_update()
 {
-    struct stat st;
-    Texture *tex;
-
-    array_foreach(tex, textures)
-        _load(tex);
+    _upload_decoded();
 }
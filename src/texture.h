@@ -1,11 +1,53 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <stdbool.h>
+
 #include "vec2.h"
+#include "script_export.h"
+
+/*
+ * textures are referred to by integer handle, stable until texture_deinit()
+ * -- loading the same path again gives the same handle, found by hashed
+ * lookup, and a handle is kept even if loading fails so that it picks up a
+ * fixed file when reloaded
+ *
+ * .cgtx files (see cgtx.h) are mapped as is, others are decoded as
+ * images -- either way in the background, with the upload at a later
+ * texture_update() -- till then a texture is a 1x1 white placeholder and
+ * texture_get_generation() changes when the real one arrives
+ */
+
+typedef unsigned int TextureHandle;
+
+TextureHandle texture_load(const char *filename);
+bool texture_find(TextureHandle *tex, const char *filename); /* doesn't load,
+                                                                 false if
+                                                                 unknown */
+bool texture_is_loaded(TextureHandle tex); /* has GL texture, possibly
+                                              placeholder -- false if file
+                                              wasn't found */
+const char *texture_get_filename(TextureHandle tex);
+void texture_bind(TextureHandle tex); /* needs GL context, see gfx.h */
+unsigned int texture_get_gl_name(TextureHandle tex); /* 0 if none */
+Vec2 texture_get_size(TextureHandle tex); /* (width, height) */
+
+SCRIPT(texture,
+
+       /* by path, for scripts */
+       EXPORT bool texture_load_file(const char *filename); /* true if
+                                                               loaded */
+       EXPORT Vec2 texture_get_size_file(const char *filename);
+
+       /* block till all queued textures are decoded and uploaded, for
+          loading screens */
+       EXPORT void texture_wait_all();
+
+    )
 
-bool texture_load(const char *filename);
-void texture_bind(const char *filename);
-Vec2 texture_get_size(const char *filename); /* (width, height) */
+/* incremented whenever any texture is (re)uploaded to GL, textures are
+   reloaded when their files change */
+unsigned int texture_get_generation();
 
 void texture_init();
 void texture_deinit();
@@ -0,0 +1,176 @@
+#include "thread.h"
+
+#include <stdlib.h>
+
+#include "error.h"
+
+#ifdef CGAME_WINDOWS
+
+#include <windows.h>
+
+struct Thread
+{
+    HANDLE handle;
+    ThreadFunc func;
+    void *data;
+};
+
+struct Mutex
+{
+    CRITICAL_SECTION cs;
+};
+
+struct Cond
+{
+    CONDITION_VARIABLE cv;
+};
+
+static DWORD WINAPI _thread_start(LPVOID param)
+{
+    Thread *thread = param;
+    thread->func(thread->data);
+    return 0;
+}
+
+Thread *thread_new(ThreadFunc func, void *data)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    thread->func = func;
+    thread->data = data;
+    thread->handle = CreateThread(NULL, 0, _thread_start, thread, 0, NULL);
+    error_assert(thread->handle, "thread must be created");
+    return thread;
+}
+void thread_join(Thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+Mutex *mutex_new()
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    InitializeCriticalSection(&mutex->cs);
+    return mutex;
+}
+void mutex_free(Mutex *mutex)
+{
+    DeleteCriticalSection(&mutex->cs);
+    free(mutex);
+}
+void mutex_lock(Mutex *mutex)
+{
+    EnterCriticalSection(&mutex->cs);
+}
+void mutex_unlock(Mutex *mutex)
+{
+    LeaveCriticalSection(&mutex->cs);
+}
+
+Cond *cond_new()
+{
+    Cond *cond = malloc(sizeof(Cond));
+    InitializeConditionVariable(&cond->cv);
+    return cond;
+}
+void cond_free(Cond *cond)
+{
+    free(cond);
+}
+void cond_wait(Cond *cond, Mutex *mutex)
+{
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+void cond_broadcast(Cond *cond)
+{
+    WakeAllConditionVariable(&cond->cv);
+}
+
+#else
+
+#include <pthread.h>
+
+struct Thread
+{
+    pthread_t pthread;
+    ThreadFunc func;
+    void *data;
+};
+
+struct Mutex
+{
+    pthread_mutex_t pmutex;
+};
+
+struct Cond
+{
+    pthread_cond_t pcond;
+};
+
+static void *_thread_start(void *param)
+{
+    Thread *thread = param;
+    thread->func(thread->data);
+    return NULL;
+}
+
+Thread *thread_new(ThreadFunc func, void *data)
+{
+    Thread *thread = malloc(sizeof(Thread));
+    int r;
+
+    thread->func = func;
+    thread->data = data;
+    r = pthread_create(&thread->pthread, NULL, _thread_start, thread);
+    error_assert(r == 0, "thread must be created");
+    return thread;
+}
+void thread_join(Thread *thread)
+{
+    pthread_join(thread->pthread, NULL);
+    free(thread);
+}
+
+Mutex *mutex_new()
+{
+    Mutex *mutex = malloc(sizeof(Mutex));
+    pthread_mutex_init(&mutex->pmutex, NULL);
+    return mutex;
+}
+void mutex_free(Mutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->pmutex);
+    free(mutex);
+}
+void mutex_lock(Mutex *mutex)
+{
+    pthread_mutex_lock(&mutex->pmutex);
+}
+void mutex_unlock(Mutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->pmutex);
+}
+
+Cond *cond_new()
+{
+    Cond *cond = malloc(sizeof(Cond));
+    pthread_cond_init(&cond->pcond, NULL);
+    return cond;
+}
+void cond_free(Cond *cond)
+{
+    pthread_cond_destroy(&cond->pcond);
+    free(cond);
+}
+void cond_wait(Cond *cond, Mutex *mutex)
+{
+    pthread_cond_wait(&cond->pcond, &mutex->pmutex);
+}
+void cond_broadcast(Cond *cond)
+{
+    pthread_cond_broadcast(&cond->pcond);
+}
+
+#endif
+
@@ -0,0 +1,31 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdbool.h>
+
+/*
+ * minimal threads, mutexes and condition variables -- pthreads, or win32
+ * on windows
+ */
+
+typedef struct Thread Thread;
+typedef struct Mutex Mutex;
+typedef struct Cond Cond;
+
+typedef void (*ThreadFunc)(void *data);
+
+Thread *thread_new(ThreadFunc func, void *data); /* starts running func */
+void thread_join(Thread *thread); /* waits for func to return, frees */
+
+Mutex *mutex_new();
+void mutex_free(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+Cond *cond_new();
+void cond_free(Cond *cond);
+void cond_wait(Cond *cond, Mutex *mutex); /* mutex must be locked */
+void cond_broadcast(Cond *cond);
+
+#endif
+
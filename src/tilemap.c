@@ -0,0 +1,619 @@
+#include "tilemap.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "error.h"
+#include "entitypool.h"
+#include "array.h"
+#include "dirs.h"
+#include "mat3.h"
+#include "transform.h"
+#include "texture.h"
+#include "sprite.h"
+#include "gfx.h"
+#include "edit.h"
+
+/* chunks are CHUNK_SIZE x CHUNK_SIZE tiles */
+#define CHUNK_SIZE 16
+
+/* one per non-empty tile, expanded to a quad in the geometry shader */
+typedef struct TileVertex TileVertex;
+struct TileVertex
+{
+    Vec2 position; /* tile center in entity space */
+    Vec2 texcell;
+};
+
+typedef struct Chunk Chunk;
+struct Chunk
+{
+    GLuint vao;
+    GLuint vbo;
+    unsigned int nverts;
+    bool dirty; /* tiles changed since vbo was built */
+};
+
+typedef struct Tilemap Tilemap;
+struct Tilemap
+{
+    EntityPoolElem pool_elem;
+
+    char *texture; /* NULL to use sprite atlas */
+    TextureHandle tex; /* handle of texture if set */
+    Vec2 tile_size;
+    Vec2 texsize;
+    Array *palette; /* texcell for type i at index i - 1 */
+    int depth;
+
+    unsigned int width, height;
+    unsigned int *tiles; /* row-major, width * height */
+
+    /* ceil(width / CHUNK_SIZE) x ceil(height / CHUNK_SIZE), row-major */
+    unsigned int chunks_width, chunks_height;
+    Chunk *chunks;
+};
+
+static EntityPool *pool;
+static bool order_dirty = true; /* need depth sort */
+static bool chunks_new = false; /* some chunks need vao, vbo */
+
+/* GL stuff */
+static GLuint program;
+static GLint wmat_loc, tile_size_loc, texsize_loc, atlas_size_loc;
+
+/* --- chunks -------------------------------------------------------------- */
+
+static void _chunks_free(Tilemap *tilemap)
+{
+    unsigned int i, n;
+    Chunk *chunk;
+
+    n = tilemap->chunks_width * tilemap->chunks_height;
+    for (i = 0; i < n; ++i)
+    {
+        chunk = &tilemap->chunks[i];
+        gfx_delete_buffer(chunk->vbo);
+        gfx_delete_vertex_array(chunk->vao);
+    }
+    free(tilemap->chunks);
+    tilemap->chunks = NULL;
+    tilemap->chunks_width = tilemap->chunks_height = 0;
+}
+
+/* (re)create empty chunk table to cover tile grid */
+static void _chunks_init(Tilemap *tilemap)
+{
+    unsigned int i, n;
+
+    _chunks_free(tilemap);
+
+    tilemap->chunks_width = (tilemap->width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    tilemap->chunks_height = (tilemap->height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    n = tilemap->chunks_width * tilemap->chunks_height;
+    tilemap->chunks = malloc(n * sizeof(Chunk));
+    for (i = 0; i < n; ++i)
+    {
+        tilemap->chunks[i].vao = tilemap->chunks[i].vbo = 0;
+        tilemap->chunks[i].nverts = 0;
+        tilemap->chunks[i].dirty = true;
+    }
+    chunks_new = true;
+}
+
+/* make vao, vbo, bind attributes for chunks that have none */
+static void _chunks_create(Tilemap *tilemap)
+{
+    unsigned int i, n;
+    Chunk *chunk;
+
+    n = tilemap->chunks_width * tilemap->chunks_height;
+    for (i = 0; i < n; ++i)
+    {
+        chunk = &tilemap->chunks[i];
+        if (chunk->vbo)
+            continue;
+
+        glGenVertexArrays(1, &chunk->vao);
+        glBindVertexArray(chunk->vao);
+        glGenBuffers(1, &chunk->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+        gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "position",
+                               TileVertex, position);
+        gfx_bind_vertex_attrib(program, GL_FLOAT, 2, "texcell",
+                               TileVertex, texcell);
+    }
+}
+
+static void _chunks_dirty_all(Tilemap *tilemap)
+{
+    unsigned int i, n;
+
+    n = tilemap->chunks_width * tilemap->chunks_height;
+    for (i = 0; i < n; ++i)
+        tilemap->chunks[i].dirty = true;
+}
+
+/* rebuild vbo of chunk (cx, cy) from tiles */
+static void _chunk_build(Tilemap *tilemap, unsigned int cx, unsigned int cy)
+{
+    Chunk *chunk;
+    TileVertex verts[CHUNK_SIZE * CHUNK_SIZE];
+    unsigned int x, y, xmax, ymax, type, npalette;
+
+    chunk = &tilemap->chunks[cy * tilemap->chunks_width + cx];
+
+    /* collect non-empty tiles */
+    npalette = array_length(tilemap->palette);
+    xmax = (cx + 1) * CHUNK_SIZE;
+    if (xmax > tilemap->width)
+        xmax = tilemap->width;
+    ymax = (cy + 1) * CHUNK_SIZE;
+    if (ymax > tilemap->height)
+        ymax = tilemap->height;
+    chunk->nverts = 0;
+    for (y = cy * CHUNK_SIZE; y < ymax; ++y)
+        for (x = cx * CHUNK_SIZE; x < xmax; ++x)
+        {
+            type = tilemap->tiles[y * tilemap->width + x];
+            if (type == 0 || type > npalette)
+                continue;
+            verts[chunk->nverts].position = vec2(x * tilemap->tile_size.x,
+                                                 y * tilemap->tile_size.y);
+            verts[chunk->nverts].texcell
+                = array_get_val(Vec2, tilemap->palette, type - 1);
+            ++chunk->nverts;
+        }
+
+    gfx_buffer_data(chunk->vbo, chunk->nverts * sizeof(TileVertex),
+                    verts, GL_STATIC_DRAW);
+    chunk->dirty = false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void _free(Tilemap *tilemap)
+{
+    _chunks_free(tilemap);
+    free(tilemap->texture);
+    free(tilemap->tiles);
+    array_free(tilemap->palette);
+}
+
+void tilemap_add(Entity ent)
+{
+    Tilemap *tilemap;
+
+    if (entitypool_get(pool, ent))
+        return;
+
+    transform_add(ent);
+
+    tilemap = entitypool_add(pool, ent);
+    tilemap->texture = NULL;
+    tilemap->tile_size = vec2(1, 1);
+    tilemap->texsize = vec2(32, 32);
+    tilemap->palette = array_new(Vec2);
+    tilemap->depth = 0;
+    tilemap->width = tilemap->height = 0;
+    tilemap->tiles = NULL;
+    tilemap->chunks_width = tilemap->chunks_height = 0;
+    tilemap->chunks = NULL;
+
+    order_dirty = true;
+}
+void tilemap_remove(Entity ent)
+{
+    Tilemap *tilemap;
+
+    tilemap = entitypool_get(pool, ent);
+    if (tilemap)
+    {
+        _free(tilemap);
+        order_dirty = true;
+    }
+    entitypool_remove(pool, ent);
+}
+bool tilemap_has(Entity ent)
+{
+    return entitypool_get(pool, ent) != NULL;
+}
+
+/* err is whether to error(...) if bad */
+static void _set_texture(Tilemap *tilemap, const char *filename, bool err)
+{
+    TextureHandle tex = 0;
+
+    if (filename && !texture_is_loaded(tex = texture_load(filename)))
+    {
+        if (err)
+            error("couldn't load tilemap texture from path '%s', check path "
+                  "and format", filename);
+        return;
+    }
+
+    free(tilemap->texture);
+    tilemap->texture = NULL;
+    if (filename)
+    {
+        tilemap->texture = malloc(strlen(filename) + 1);
+        strcpy(tilemap->texture, filename);
+        tilemap->tex = tex;
+    }
+}
+void tilemap_set_texture(Entity ent, const char *filename)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    _set_texture(tilemap, filename, true);
+}
+const char *tilemap_get_texture(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->texture ? tilemap->texture : sprite_get_atlas();
+}
+
+void tilemap_set_tile_size(Entity ent, Vec2 size)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    tilemap->tile_size = size;
+    _chunks_dirty_all(tilemap); /* tile positions changed */
+}
+Vec2 tilemap_get_tile_size(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->tile_size;
+}
+
+void tilemap_set_texsize(Entity ent, Vec2 texsize)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    tilemap->texsize = texsize;
+}
+Vec2 tilemap_get_texsize(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->texsize;
+}
+
+void tilemap_set_palette(Entity ent, unsigned int type, Vec2 texcell)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    error_assert(type > 0, "tile type 0 is reserved for empty tiles");
+
+    while (array_length(tilemap->palette) < type)
+        array_add_val(Vec2, tilemap->palette) = vec2_zero;
+    array_get_val(Vec2, tilemap->palette, type - 1) = texcell;
+    _chunks_dirty_all(tilemap);
+}
+Vec2 tilemap_get_palette(Entity ent, unsigned int type)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    if (type == 0 || type > array_length(tilemap->palette))
+        return vec2_zero;
+    return array_get_val(Vec2, tilemap->palette, type - 1);
+}
+
+void tilemap_resize(Entity ent, unsigned int width, unsigned int height)
+{
+    Tilemap *tilemap;
+    unsigned int *tiles, x, y;
+
+    tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+
+    if (width == tilemap->width && height == tilemap->height)
+        return;
+
+    /* copy over overlapping region */
+    tiles = calloc(width * height, sizeof(unsigned int));
+    for (y = 0; y < height && y < tilemap->height; ++y)
+        for (x = 0; x < width && x < tilemap->width; ++x)
+            tiles[y * width + x] = tilemap->tiles[y * tilemap->width + x];
+    free(tilemap->tiles);
+    tilemap->tiles = tiles;
+    tilemap->width = width;
+    tilemap->height = height;
+
+    _chunks_init(tilemap);
+}
+unsigned int tilemap_get_width(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->width;
+}
+unsigned int tilemap_get_height(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->height;
+}
+
+void tilemap_set_tile(Entity ent, unsigned int x, unsigned int y,
+                      unsigned int type)
+{
+    Tilemap *tilemap;
+    unsigned int *tile;
+
+    tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    error_assert(x < tilemap->width && y < tilemap->height,
+                 "tile (%u, %u) must be within tilemap bounds", x, y);
+
+    tile = &tilemap->tiles[y * tilemap->width + x];
+    if (*tile == type)
+        return;
+    *tile = type;
+    tilemap->chunks[(y / CHUNK_SIZE) * tilemap->chunks_width
+                    + x / CHUNK_SIZE].dirty = true;
+}
+unsigned int tilemap_get_tile(Entity ent, unsigned int x, unsigned int y)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    error_assert(x < tilemap->width && y < tilemap->height,
+                 "tile (%u, %u) must be within tilemap bounds", x, y);
+    return tilemap->tiles[y * tilemap->width + x];
+}
+
+void tilemap_set_depth(Entity ent, int depth)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    tilemap->depth = depth;
+    order_dirty = true;
+}
+int tilemap_get_depth(Entity ent)
+{
+    Tilemap *tilemap = entitypool_get(pool, ent);
+    error_assert(tilemap);
+    return tilemap->depth;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void tilemap_init()
+{
+    pool = entitypool_new(Tilemap);
+
+    program = gfx_create_program(data_path("tilemap.vert"),
+                                 data_path("tilemap.geom"),
+                                 data_path("tilemap.frag"));
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "tex0"), 0);
+    wmat_loc = glGetUniformLocation(program, "wmat");
+    tile_size_loc = glGetUniformLocation(program, "tile_size");
+    texsize_loc = glGetUniformLocation(program, "texsize");
+    atlas_size_loc = glGetUniformLocation(program, "atlas_size");
+}
+void tilemap_deinit()
+{
+    Tilemap *tilemap;
+
+    glDeleteProgram(program);
+
+    entitypool_foreach(tilemap, pool)
+        _free(tilemap);
+    entitypool_free(pool);
+}
+
+void tilemap_update_all()
+{
+    Tilemap *tilemap;
+    Vec2 min, max;
+
+    entitypool_remove_destroyed(pool, tilemap_remove);
+
+    /* update edit bbox to cover whole grid */
+    if (edit_get_enabled())
+        entitypool_foreach(tilemap, pool)
+        {
+            min = vec2_scalar_mul(tilemap->tile_size, -0.5);
+            max = vec2(tilemap->width - 0.5, tilemap->height - 0.5);
+            max = vec2_mul(tilemap->tile_size, max);
+            edit_bboxes_update(tilemap->pool_elem.ent, bbox(min, max));
+        }
+}
+
+static int _depth_compare(const void *a, const void *b)
+{
+    const Tilemap *ta = a, *tb = b;
+
+    /* descending depth, break ties by Entity id for stability */
+    if (tb->depth != ta->depth)
+        return tb->depth - ta->depth;
+    return ((int) ta->pool_elem.ent.id) - ((int) tb->pool_elem.ent.id);
+}
+
+void tilemap_draw_all()
+{
+    Tilemap *tilemap;
+    Chunk *chunk;
+    const char *atlas;
+    TextureHandle tex;
+    Mat3 wmat;
+    Vec2 atlas_size;
+    GfxDraw *draw;
+    GLuint gl_name;
+    unsigned int cx, cy, depth;
+
+    if (entitypool_size(pool) == 0)
+        return;
+
+    if (order_dirty)
+    {
+        entitypool_sort(pool, _depth_compare);
+        order_dirty = false;
+    }
+
+    /* GL objects for new chunks -- needs context, so make all at once */
+    if (chunks_new)
+    {
+        gfx_context_acquire();
+        entitypool_foreach(tilemap, pool)
+            _chunks_create(tilemap);
+        gfx_context_release();
+        chunks_new = false;
+    }
+
+    atlas = sprite_get_atlas();
+    entitypool_foreach(tilemap, pool)
+    {
+        if (tilemap->texture)
+            tex = tilemap->tex;
+        else if (!atlas || !texture_find(&tex, atlas))
+            continue;
+        if (!(gl_name = texture_get_gl_name(tex)))
+            continue;
+        atlas_size = texture_get_size(tex);
+        wmat = transform_get_world_matrix(tilemap->pool_elem.ent);
+        depth = tilemap - (Tilemap *) entitypool_begin(pool);
+
+        /* draw chunks, rebuilding dirty ones first */
+        for (cy = 0; cy < tilemap->chunks_height; ++cy)
+            for (cx = 0; cx < tilemap->chunks_width; ++cx)
+            {
+                chunk = &tilemap->chunks[cy * tilemap->chunks_width + cx];
+                if (chunk->dirty)
+                    _chunk_build(tilemap, cx, cy);
+                if (chunk->nverts == 0)
+                    continue;
+
+                draw = gfx_draw(GFX_LAYER_TILEMAP, depth, program, chunk->vao,
+                                GL_POINTS, 0, chunk->nverts);
+                gfx_draw_texture(draw, GL_TEXTURE_2D, gl_name);
+                gfx_draw_uniform_mat3(draw, wmat_loc, wmat);
+                gfx_draw_uniform_vec2(draw, tile_size_loc, tilemap->tile_size);
+                gfx_draw_uniform_vec2(draw, texsize_loc, tilemap->texsize);
+                gfx_draw_uniform_vec2(draw, atlas_size_loc, atlas_size);
+            }
+    }
+}
+
+static void _palette_save(Tilemap *tilemap, Store *s)
+{
+    Store *t;
+    Vec2 *texcell;
+
+    if (store_child_save(&t, "palette", s))
+        array_foreach(texcell, tilemap->palette)
+            vec2_save(texcell, NULL, t);
+}
+static void _palette_load(Tilemap *tilemap, Store *s)
+{
+    Store *t;
+    Vec2 texcell;
+
+    tilemap->palette = array_new(Vec2);
+    if (store_child_load(&t, "palette", s))
+        while (vec2_load(&texcell, NULL, vec2_zero, t))
+            array_add_val(Vec2, tilemap->palette) = texcell;
+}
+
+void tilemap_save_all(Store *s)
+{
+    Store *t, *tilemap_s;
+    Tilemap *tilemap;
+
+    if (store_child_save(&t, "tilemap", s))
+        entitypool_save_foreach(tilemap, tilemap_s, pool, "pool", t)
+        {
+            if (tilemap->texture)
+                string_save((const char **) &tilemap->texture, "texture",
+                            tilemap_s);
+            vec2_save(&tilemap->tile_size, "tile_size", tilemap_s);
+            vec2_save(&tilemap->texsize, "texsize", tilemap_s);
+            int_save(&tilemap->depth, "depth", tilemap_s);
+
+            uint_save(&tilemap->width, "width", tilemap_s);
+            uint_save(&tilemap->height, "height", tilemap_s);
+            uint_array_save(tilemap->tiles, tilemap->width * tilemap->height,
+                            "tiles", tilemap_s);
+            _palette_save(tilemap, tilemap_s);
+        }
+}
+void tilemap_load_all(Store *s)
+{
+    Store *t, *tilemap_s;
+    Tilemap *tilemap;
+    char *ttex;
+    unsigned int ntiles;
+
+    if (store_child_load(&t, "tilemap", s))
+    {
+        order_dirty = true;
+
+        entitypool_load_foreach(tilemap, tilemap_s, pool, "pool", t)
+        {
+            tilemap->texture = NULL;
+            if (string_load(&ttex, "texture", NULL, tilemap_s))
+            {
+                _set_texture(tilemap, ttex, false);
+                free(ttex);
+            }
+            vec2_load(&tilemap->tile_size, "tile_size", vec2(1, 1),
+                      tilemap_s);
+            vec2_load(&tilemap->texsize, "texsize", vec2(32, 32), tilemap_s);
+            int_load(&tilemap->depth, "depth", 0, tilemap_s);
+
+            uint_load(&tilemap->width, "width", 0, tilemap_s);
+            uint_load(&tilemap->height, "height", 0, tilemap_s);
+            uint_array_load(&tilemap->tiles, &ntiles, "tiles", tilemap_s);
+            if (ntiles != tilemap->width * tilemap->height)
+            {
+                free(tilemap->tiles);
+                tilemap->tiles = calloc(tilemap->width * tilemap->height,
+                                        sizeof(unsigned int));
+            }
+            _palette_load(tilemap, tilemap_s);
+
+            tilemap->chunks_width = tilemap->chunks_height = 0;
+            tilemap->chunks = NULL;
+            _chunks_init(tilemap);
+        }
+    }
+}
+
+void tilemap_clone(Entity from, Entity to)
+{
+    Tilemap *tilemap;
+    char *texture;
+    unsigned int *tiles;
+    size_t n;
+
+    tilemap = entitypool_clone(pool, from, to);
+    if (!tilemap)
+        return;
+
+    if (tilemap->texture)
+    {
+        texture = malloc(strlen(tilemap->texture) + 1);
+        strcpy(texture, tilemap->texture);
+        tilemap->texture = texture;
+    }
+    tilemap->palette = array_copy(tilemap->palette);
+
+    if (tilemap->tiles)
+    {
+        n = tilemap->width * tilemap->height * sizeof(unsigned int);
+        tiles = malloc(n);
+        memcpy(tiles, tilemap->tiles, n);
+        tilemap->tiles = tiles;
+    }
+
+    /* chunks get their own GL buffers */
+    tilemap->chunks_width = tilemap->chunks_height = 0;
+    tilemap->chunks = NULL;
+    _chunks_init(tilemap);
+
+    order_dirty = true;
+}
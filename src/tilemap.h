@@ -0,0 +1,71 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "saveload.h"
+#include "entity.h"
+#include "vec2.h"
+#include "script_export.h"
+
+/*
+ * a grid of tiles drawn as part of one entity -- tile (x, y) is centered at
+ * (x * tile_size.x, y * tile_size.y) in the entity's local space
+ *
+ * each tile holds a type, 0 for empty, and each type's texcell is given by
+ * the tilemap's palette -- the grid is drawn in chunks whose vertex buffers
+ * are only rebuilt when their tiles change
+ *
+ * all tilemaps are drawn in a layer below all sprites, whatever their
+ * depths -- decor that must be drawn above some sprites still needs to be
+ * made of sprites
+ */
+
+SCRIPT(tilemap,
+
+       EXPORT void tilemap_add(Entity ent);
+       EXPORT void tilemap_remove(Entity ent);
+       EXPORT bool tilemap_has(Entity ent);
+
+       /* texture to draw tiles from, NULL to use sprite atlas */
+       EXPORT void tilemap_set_texture(Entity ent, const char *filename);
+       EXPORT const char *tilemap_get_texture(Entity ent); /* atlas if
+                                                              unset */
+
+       /* size of each tile in world units */
+       EXPORT void tilemap_set_tile_size(Entity ent, Vec2 size);
+       EXPORT Vec2 tilemap_get_tile_size(Entity ent);
+
+       /* size of each tile's atlas region in pixels */
+       EXPORT void tilemap_set_texsize(Entity ent, Vec2 texsize);
+       EXPORT Vec2 tilemap_get_texsize(Entity ent);
+
+       /* bottom left corner of atlas region in pixels for tile type > 0 */
+       EXPORT void tilemap_set_palette(Entity ent, unsigned int type,
+                                       Vec2 texcell);
+       EXPORT Vec2 tilemap_get_palette(Entity ent, unsigned int type);
+
+       /* grid size in tiles, tiles within new size are kept */
+       EXPORT void tilemap_resize(Entity ent, unsigned int width,
+                                  unsigned int height);
+       EXPORT unsigned int tilemap_get_width(Entity ent);
+       EXPORT unsigned int tilemap_get_height(Entity ent);
+
+       EXPORT void tilemap_set_tile(Entity ent, unsigned int x, unsigned int y,
+                                    unsigned int type);
+       EXPORT unsigned int tilemap_get_tile(Entity ent, unsigned int x,
+                                            unsigned int y);
+
+       /* lower depth drawn on top, only orders tilemaps among themselves */
+       EXPORT void tilemap_set_depth(Entity ent, int depth);
+       EXPORT int tilemap_get_depth(Entity ent);
+
+    )
+
+void tilemap_init();
+void tilemap_deinit();
+void tilemap_update_all();
+void tilemap_draw_all();
+void tilemap_save_all(Store *s);
+void tilemap_load_all(Store *s);
+void tilemap_clone(Entity from, Entity to);
+
+#endif
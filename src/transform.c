@@ -26,6 +26,7 @@ struct Transform
     Mat3 worldmat_cache; /* cached on parent-child update */
 
     unsigned int dirty_count;
+    unsigned int world_dirty_count;
 };
 
 static EntityPool *pool;
@@ -39,6 +40,7 @@ static void _update_child(Transform *parent, Entity ent)
 
     transform = entitypool_get(pool, ent);
     error_assert(transform);
+    ++transform->world_dirty_count;
     transform->worldmat_cache = mat3_mul(parent->worldmat_cache,
                                          transform->mat_cache);
     if (transform->children)
@@ -51,6 +53,7 @@ static void _modified(Transform *transform)
     Entity *child;
 
     ++transform->dirty_count;
+    ++transform->world_dirty_count;
 
     transform->mat_cache = mat3_scaling_rotation_translation(
         transform->scale,
@@ -138,6 +141,7 @@ void transform_add(Entity ent)
     transform->children = NULL;
 
     transform->dirty_count = 0;
+    transform->world_dirty_count = 0;
 
     _modified(transform);
 }
@@ -342,6 +346,12 @@ unsigned int transform_get_dirty_count(Entity ent)
     error_assert(transform);
     return transform->dirty_count;
 }
+unsigned int transform_get_world_dirty_count(Entity ent)
+{
+    Transform *transform = entitypool_get(pool, ent);
+    error_assert(transform);
+    return transform->world_dirty_count;
+}
 
 void transform_set_save_filter_rec(Entity ent, bool filter)
 {
@@ -467,5 +477,28 @@ void transform_load_all(Store *s)
                       mat3_identity(), transform_s);
 
             uint_load(&transform->dirty_count, "dirty_count", 0, transform_s);
+            transform->world_dirty_count = transform->dirty_count;
         }
 }
+
+void transform_clone(Entity from, Entity to)
+{
+    Transform *transform;
+    Entity parent;
+
+    transform = entitypool_clone(pool, from, to);
+    if (!transform)
+        return;
+
+    /* children are attached by their own clones, if cloned */
+    parent = _entity_resolve_clone(transform->parent);
+    transform->parent = entity_nil;
+    transform->children = NULL;
+    transform->dirty_count = 0;
+    transform->world_dirty_count = 0;
+
+    if (entity_eq(parent, entity_nil))
+        _modified(transform);
+    else
+        transform_set_parent(to, parent);
+}
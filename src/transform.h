@@ -53,7 +53,13 @@ SCRIPT(transform,
        EXPORT Vec2 transform_local_to_world(Entity ent, Vec2 v);
        EXPORT Vec2 transform_world_to_local(Entity ent, Vec2 v);
 
+       /*
+        * dirty count is incremented on each change to this transform, world
+        * dirty count also on each change to the world matrix through an
+        * ancestor
+        */
        EXPORT unsigned int transform_get_dirty_count(Entity ent);
+       EXPORT unsigned int transform_get_world_dirty_count(Entity ent);
 
        /* set save filter for ent and all its descendants */
        EXPORT void transform_set_save_filter_rec(Entity ent, bool filter);
@@ -65,6 +71,7 @@ void transform_deinit();
 void transform_update_all();
 void transform_save_all(Store *s);
 void transform_load_all(Store *s);
+void transform_clone(Entity from, Entity to);
 
 #endif
 
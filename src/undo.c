@@ -0,0 +1,501 @@
+#include "undo.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "saveload.h"
+#include "entity.h"
+#include "entitymap.h"
+#include "transform.h"
+#include "system.h"
+#include "array.h"
+#include "error.h"
+
+/*
+ * rows are pool elements saved by system_save_ents(...), keyed by system,
+ * pool and the stable id of their entity (see entity_stable_ids_begin()) --
+ * tracked entities are saved along with everything connected to them by
+ * transform, so rows refer only to entities saved with them
+ *
+ * rows of each tracked entity are kept from the point before or from when
+ * it was tracked, and at the next point compared with its rows then -- each
+ * point keeps the old and new copies of just the rows that differ, so
+ * undoing only has to take the new rows out and load the old ones back
+ */
+
+typedef struct Key Key;
+struct Key
+{
+    const char *system, *pool; /* interned, compared by pointer */
+    unsigned int id;
+};
+
+typedef struct Row Row;
+struct Row
+{
+    Key key;
+    Store *s;
+};
+
+typedef struct Change Change;
+struct Change
+{
+    Key key;
+    Store *old, *new; /* copies of row before and after, NULL if none */
+};
+
+static Array *saves; /* Store * of saves rows below are in */
+static Array *rows; /* Row of each known entity, sorted by key */
+static EntityMap *known; /* stable id --> whether its rows are in rows */
+static Array *known_ids; /* stable ids in known */
+static Array *tracked; /* stable ids tracked since last point */
+static Array *points; /* Array of Changes sorted by key for each point */
+
+/* --- keys, rows ---------------------------------------------------------- */
+
+static int _key_cmp(const void *a, const void *b)
+{
+    const Key *ka = a, *kb = b;
+
+    if (ka->system != kb->system)
+        return (uintptr_t) ka->system < (uintptr_t) kb->system ? -1 : 1;
+    if (ka->pool != kb->pool)
+        return (uintptr_t) ka->pool < (uintptr_t) kb->pool ? -1 : 1;
+    if (ka->id != kb->id)
+        return ka->id < kb->id ? -1 : 1;
+    return 0;
+}
+
+static Entity _id_key(unsigned int id)
+{
+    Entity key = { id };
+    return key;
+}
+
+static void _know(unsigned int id)
+{
+    if (!entitymap_get(known, _id_key(id)))
+    {
+        entitymap_set(known, _id_key(id), true);
+        array_add_val(unsigned int, known_ids) = id;
+    }
+}
+
+/* add rows of s to arr, just those of entities in only if not NULL */
+static void _rows_add(Array *arr, Store *s, EntityMap *only)
+{
+    Store *sys, *pool, *row, *elem;
+    Row *r;
+    unsigned int id;
+
+    store_rewind(s);
+    while (store_child_load(&sys, NULL, s))
+        while (store_child_load(&pool, NULL, sys))
+        {
+            /* a pool if first child is a pool row */
+            if (!store_child_load(&row, NULL, pool) || store_get_name(row)
+                || !store_child_load(&elem, "pool_elem", row))
+                continue;
+            do
+            {
+                error_assert(store_child_load(&elem, "pool_elem", row)
+                             && uint_load(&id, "id", 0, elem) && id != 0,
+                             "rows must be saved with ids");
+                if (only && !entitymap_get(only, _id_key(id)))
+                    continue;
+
+                r = array_add(arr);
+                r->key.system = store_get_name(sys);
+                r->key.pool = store_get_name(pool);
+                r->key.id = id;
+                r->s = row;
+            }
+            while (store_child_load(&row, NULL, pool));
+        }
+}
+
+static void _rows_clear()
+{
+    Store **s;
+
+    array_foreach(s, saves)
+        store_close(*s);
+    array_reset(saves, 0);
+    array_reset(rows, 0);
+    entitymap_clear(known);
+    array_reset(known_ids, 0);
+}
+
+/* --- entities ------------------------------------------------------------ */
+
+static void _add_rec(Array *ents, EntityMap *seen, Entity ent)
+{
+    unsigned int i, n;
+    Entity *children;
+
+    if (entitymap_get(seen, ent))
+        return;
+    entitymap_set(seen, ent, true);
+    array_add_val(Entity, ents) = ent;
+
+    if (transform_has(ent))
+    {
+        n = transform_get_num_children(ent);
+        children = transform_get_children(ent);
+        for (i = 0; i < n; ++i)
+            _add_rec(ents, seen, children[i]);
+    }
+}
+
+/* add ent and all connected to it by transform */
+static void _add_connected(Array *ents, EntityMap *seen, Entity ent)
+{
+    if (entity_eq(ent, entity_nil) || entity_destroyed(ent))
+        return;
+
+    while (transform_has(ent)
+           && !entity_eq(transform_get_parent(ent), entity_nil))
+        ent = transform_get_parent(ent);
+    _add_rec(ents, seen, ent);
+}
+
+static Store *_save(Array *ents)
+{
+    Store *s;
+
+    s = store_open();
+    entity_stable_ids_begin();
+    system_save_ents(s, array_length(ents), array_begin(ents));
+    entity_stable_ids_end();
+    return s;
+}
+
+/* --- changes ------------------------------------------------------------- */
+
+static void _change_add(Array *changes, Row *old, Row *new)
+{
+    Change *change;
+
+    change = array_add(changes);
+    change->key = old ? old->key : new->key;
+    change->old = old ? store_child_copy(NULL, old->s) : NULL;
+    change->new = new ? store_child_copy(NULL, new->s) : NULL;
+}
+
+static bool _key_in(Array *keys, Key *key)
+{
+    Key *k;
+
+    array_foreach(k, keys)
+        if (k->system == key->system && k->pool == key->pool)
+            return true;
+    return false;
+}
+
+/*
+ * changes from rows to new rows b, both sorted by key -- rows of entities
+ * not known before aren't compared
+ */
+static Array *_diff(Array *b)
+{
+    Array *changes, *linked;
+    Change *change;
+    Row *p, *q;
+    unsigned int i, j;
+    int cmp;
+
+    changes = array_new(Change);
+    for (i = j = 0; i < array_length(rows) || j < array_length(b); )
+    {
+        p = i < array_length(rows) ? array_get(rows, i) : NULL;
+        q = j < array_length(b) ? array_get(b, j) : NULL;
+        cmp = !p ? 1 : !q ? -1 : _key_cmp(p, q);
+
+        if (cmp < 0)
+            _change_add(changes, p, NULL), ++i; /* removed since */
+        else if (cmp > 0)
+        {
+            /* added since */
+            if (entitymap_get(known, _id_key(q->key.id)))
+                _change_add(changes, NULL, q);
+            ++j;
+        }
+        else
+        {
+            if (!store_equal(p->s, q->s))
+                _change_add(changes, p, q);
+            ++i, ++j;
+        }
+    }
+
+    /* rows of a linked pool are only consistent if replaced together */
+    linked = array_new(Key);
+    array_foreach(change, changes)
+        if (!_key_in(linked, &change->key)
+            && system_row_linked(change->key.system, change->key.pool))
+            array_add_val(Key, linked) = change->key;
+    if (array_length(linked) > 0)
+    {
+        for (i = j = 0; i < array_length(rows) && j < array_length(b); )
+        {
+            p = array_get(rows, i);
+            q = array_get(b, j);
+            cmp = _key_cmp(p, q);
+
+            if (cmp < 0)
+                ++i;
+            else if (cmp > 0)
+                ++j;
+            else
+            {
+                if (_key_in(linked, &p->key) && store_equal(p->s, q->s))
+                    _change_add(changes, p, q);
+                ++i, ++j;
+            }
+        }
+        array_sort(changes, _key_cmp);
+    }
+    array_free(linked);
+
+    return changes;
+}
+
+static void _changes_free(Array *changes)
+{
+    Change *change;
+
+    array_foreach(change, changes)
+    {
+        if (change->old)
+            store_close(change->old);
+        if (change->new)
+            store_close(change->new);
+    }
+    array_free(changes);
+}
+
+/* --- build --------------------------------------------------------------- */
+
+/* puts a store together from copies of rows given in order of key */
+typedef struct Builder Builder;
+struct Builder
+{
+    Store *s, *sys, *pool;
+};
+
+static void _build_add(Builder *b, Key *key, Store *row)
+{
+    if (!b->sys || store_get_name(b->sys) != key->system)
+    {
+        store_child_save(&b->sys, key->system, b->s);
+        b->pool = NULL;
+    }
+    if (!b->pool || store_get_name(b->pool) != key->pool)
+        store_child_save(&b->pool, key->pool, b->sys);
+    store_child_copy(b->pool, row);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void undo_track(Entity ent)
+{
+    Array *ents;
+    EntityMap *seen, *only;
+    Entity *e;
+    unsigned int id;
+    bool any = false;
+
+    if (entity_destroyed(ent))
+        return;
+
+    /* save everything connected if some of it isn't known yet */
+    ents = array_new(Entity);
+    seen = entitymap_new(false);
+    only = entitymap_new(false);
+    _add_connected(ents, seen, ent);
+    array_foreach(e, ents)
+    {
+        id = entity_get_stable_id(*e);
+        if (!entitymap_get(known, _id_key(id)))
+        {
+            entitymap_set(only, _id_key(id), true);
+            any = true;
+        }
+    }
+    if (any)
+    {
+        array_add_val(Store *, saves) = _save(ents);
+        _rows_add(rows, array_top_val(Store *, saves), only);
+        array_sort(rows, _key_cmp);
+        array_foreach(e, ents)
+            _know(entity_get_stable_id(*e));
+    }
+    entitymap_free(only);
+    entitymap_free(seen);
+    array_free(ents);
+
+    array_add_val(unsigned int, tracked) = entity_get_stable_id(ent);
+}
+
+static void _track_created_rec(Entity ent)
+{
+    unsigned int i, n, id;
+    Entity *children;
+
+    /* known with no rows, so it didn't exist before */
+    id = entity_get_stable_id(ent);
+    if (entitymap_get(known, _id_key(id)))
+        return; /* given already, eg. through an ancestor */
+    _know(id);
+    array_add_val(unsigned int, tracked) = id;
+
+    if (transform_has(ent))
+    {
+        n = transform_get_num_children(ent);
+        children = transform_get_children(ent);
+        for (i = 0; i < n; ++i)
+            _track_created_rec(children[i]);
+    }
+}
+void undo_track_created(Entity ent)
+{
+    if (!entity_destroyed(ent))
+        _track_created_rec(ent);
+}
+
+void undo_save()
+{
+    Array *ents, *b, *changes;
+    EntityMap *seen;
+    Store *s = NULL;
+    Entity *e;
+    Row *row;
+    unsigned int *id;
+
+    /* save known entities, tracked ones and all connected to either */
+    ents = array_new(Entity);
+    seen = entitymap_new(false);
+    array_foreach(id, known_ids)
+        _add_connected(ents, seen, entity_find_stable_id(*id));
+    array_foreach(id, tracked)
+        _add_connected(ents, seen, entity_find_stable_id(*id));
+    b = array_new(Row);
+    if (array_length(ents) > 0)
+    {
+        s = _save(ents);
+        _rows_add(b, s, NULL);
+        array_sort(b, _key_cmp);
+    }
+
+    /* keep what changed since last point, nothing if no change */
+    changes = _diff(b);
+    if (array_length(changes) > 0)
+        array_add_val(Array *, points) = changes;
+    else
+        _changes_free(changes);
+
+    /* from here on, know just tracked ones and all connected to them */
+    _rows_clear();
+    array_reset(ents, 0);
+    entitymap_clear(seen);
+    array_foreach(id, tracked)
+        _add_connected(ents, seen, entity_find_stable_id(*id));
+    array_foreach(e, ents)
+        _know(entity_get_stable_id(*e));
+    array_foreach(row, b)
+        if (entitymap_get(known, _id_key(row->key.id)))
+            array_add_val(Row, rows) = *row;
+    if (s)
+        array_add_val(Store *, saves) = s;
+    array_reset(tracked, 0);
+
+    array_free(b);
+    entitymap_free(seen);
+    array_free(ents);
+}
+
+bool undo_can_undo()
+{
+    return array_length(points) > 0;
+}
+
+void undo_undo()
+{
+    Array *changes, *ents;
+    Change *change;
+    Builder b = { NULL, NULL, NULL };
+    Store *s;
+    unsigned int i;
+
+    error_assert(undo_can_undo(), "must have a point to go back to");
+
+    changes = array_top_val(Array *, points);
+    array_pop(points);
+
+    /* find entities first, taking entity rows out destroys them */
+    ents = array_new(Entity);
+    array_foreach(change, changes)
+        array_add_val(Entity, ents) = entity_find_stable_id(change->key.id);
+
+    /* take out new rows */
+    for (i = 0; i < array_length(changes); ++i)
+    {
+        change = array_get(changes, i);
+        if (change->new && !entity_eq(array_get_val(Entity, ents, i),
+                                      entity_nil))
+            system_remove_row(change->key.system, change->key.pool,
+                              array_get_val(Entity, ents, i));
+    }
+
+    /* load old rows back in, from text so they're read like a saved file */
+    b.s = store_open();
+    array_foreach(change, changes)
+        if (change->old)
+            _build_add(&b, &change->key, change->old);
+    s = store_open_str(store_write_str(b.s));
+    entity_stable_ids_begin();
+    system_load_all(s);
+    entity_stable_ids_end();
+    store_close(s);
+    store_close(b.s);
+
+    _changes_free(changes);
+    array_free(ents);
+
+    /* rows known needn't be what's there now, start over from here */
+    _rows_clear();
+    array_reset(tracked, 0);
+}
+
+void undo_clear()
+{
+    Array **changes;
+
+    array_foreach(changes, points)
+        _changes_free(*changes);
+    array_reset(points, 0);
+    _rows_clear();
+    array_reset(tracked, 0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void undo_init()
+{
+    points = array_new(Array *);
+    saves = array_new(Store *);
+    rows = array_new(Row);
+    known = entitymap_new(false);
+    known_ids = array_new(unsigned int);
+    tracked = array_new(unsigned int);
+}
+void undo_deinit()
+{
+    undo_clear();
+    array_free(tracked);
+    array_free(known_ids);
+    entitymap_free(known);
+    array_free(rows);
+    array_free(saves);
+    array_free(points);
+}
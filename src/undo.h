@@ -0,0 +1,55 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include <stdbool.h>
+
+#include "entity.h"
+#include "script_export.h"
+
+/*
+ * undo journal for the editor -- each point keeps the old and new values of
+ * just the rows that changed, a row being what a system keeps for one
+ * entity, and undoing takes out the new rows and loads the old ones back
+ *
+ * only rows of tracked entities and all connected to them by transform are
+ * compared, so edits must track what they touch before changing it --
+ * anything else, and whatever systems keep other than per entity, isn't
+ * journaled
+ */
+
+SCRIPT(undo,
+
+       /*
+        * rows of ent and all connected to it are compared at the next
+        * point, with those at the point before or, if it wasn't tracked
+        * then, those now
+        */
+       EXPORT void undo_track(Entity ent);
+
+       /*
+        * ent was just created, with its transform descendants, so undoing
+        * the next point destroys them -- track before anything else
+        */
+       EXPORT void undo_track_created(Entity ent);
+
+       /* keep rows of tracked entities that changed as a new point */
+       EXPORT void undo_save();
+
+       /* whether there is a point to undo */
+       EXPORT bool undo_can_undo();
+
+       /*
+        * undo the last point, dropping it -- tracked entities are then
+        * forgotten, so track again before editing
+        */
+       EXPORT void undo_undo();
+
+       /* drop all points, eg. after loading what they don't know about */
+       EXPORT void undo_clear();
+
+    )
+
+void undo_init();
+void undo_deinit();
+
+#endif
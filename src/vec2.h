@@ -38,5 +38,6 @@ SCRIPT(vec2,
 /* C inline stuff */
 
 #define vec2(x, y) ((Vec2) { (x), (y) })
+#define vec2_eq(u, v) ((u).x == (v).x && (u).y == (v).y) /* exact */
 
 #endif
@@ -0,0 +1,273 @@
+#include "watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef CGAME_LINUX
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "array.h"
+#include "timing.h"
+#include "console.h"
+
+typedef struct Watch Watch;
+struct Watch
+{
+    char *filename;
+    const char *base;   /* part of filename after last '/' */
+    WatchFunc func;     /* NULL if only for scripts */
+    void *data;
+
+    int wd;             /* inotify watch of directory, -1 if none */
+    time_t mtime;       /* last seen, 0 if didn't exist */
+
+    bool changed;
+};
+
+/* seconds between modification time checks when polling */
+#define POLL_INTERVAL 0.5f
+
+static Array *watches;      /* Watch */
+static Array *changed;      /* const char *, script-watched filenames
+                               changed this frame */
+static bool enabled = true;
+static bool polling = false;
+static Scalar poll_time = 0;
+
+#ifdef CGAME_LINUX
+static int inotify_fd = -1; /* -1 if polling */
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static time_t _mtime(const char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+        return 0;
+    return st.st_mtime;
+}
+
+/* watch directory containing file -- directory rather than file itself
+   so that replacing or creating it is noticed */
+static void _watch_dir(Watch *w)
+{
+#ifdef CGAME_LINUX
+    char *dir;
+    size_t len;
+
+    w->wd = -1;
+    if (inotify_fd < 0)
+        return;
+
+    len = w->base - w->filename;
+    if (len == 0)
+        w->wd = inotify_add_watch(inotify_fd, ".",
+                                  IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    else
+    {
+        dir = malloc(len + 1);
+        memcpy(dir, w->filename, len);
+        dir[len] = '\0';
+        w->wd = inotify_add_watch(inotify_fd, dir,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        free(dir);
+    }
+#else
+    w->wd = -1;
+#endif
+}
+
+/* start or stop inotify to match enabled, polling */
+static void _notify_update()
+{
+#ifdef CGAME_LINUX
+    Watch *w;
+    bool want = enabled && !polling;
+
+    if (want == (inotify_fd >= 0))
+        return;
+
+    if (want)
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK);
+        if (inotify_fd < 0)
+            console_puts("watch: inotify unavailable, polling instead");
+    }
+    else
+    {
+        close(inotify_fd); /* also removes all watches */
+        inotify_fd = -1;
+    }
+
+    array_foreach(w, watches)
+        _watch_dir(w);
+#endif
+}
+
+static bool _notifying()
+{
+#ifdef CGAME_LINUX
+    return inotify_fd >= 0;
+#else
+    return false;
+#endif
+}
+
+/* mark files with changed modification times */
+static void _poll()
+{
+    Watch *w;
+    time_t mtime;
+
+    poll_time += timing_true_dt;
+    if (poll_time < POLL_INTERVAL)
+        return;
+    poll_time = 0;
+
+    array_foreach(w, watches)
+        if ((mtime = _mtime(w->filename)) != w->mtime)
+        {
+            w->mtime = mtime;
+            w->changed = true;
+        }
+}
+
+/* mark files named in pending inotify events */
+static void _read_events()
+{
+#ifdef CGAME_LINUX
+    union
+    {
+        struct inotify_event ev; /* for alignment */
+        char buf[4096];
+    } u;
+    const struct inotify_event *ev;
+    ssize_t len;
+    char *p;
+    Watch *w;
+
+    while ((len = read(inotify_fd, u.buf, sizeof(u.buf))) > 0)
+        for (p = u.buf; p < u.buf + len;
+             p += sizeof(struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event *) p;
+            if (ev->len == 0)
+                continue;
+            array_foreach(w, watches)
+                if (w->wd == ev->wd && !strcmp(w->base, ev->name))
+                    w->changed = true;
+        }
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+void watch_add(const char *filename, WatchFunc func, void *data)
+{
+    Watch *w;
+    const char *slash;
+
+    w = array_add(watches);
+    w->filename = malloc(strlen(filename) + 1);
+    strcpy(w->filename, filename);
+    slash = strrchr(w->filename, '/');
+    w->base = slash ? slash + 1 : w->filename;
+    w->func = func;
+    w->data = data;
+    w->mtime = _mtime(filename);
+    w->changed = false;
+    _watch_dir(w);
+}
+
+void watch_set_enabled(bool e)
+{
+    enabled = e;
+    _notify_update();
+}
+bool watch_get_enabled()
+{
+    return enabled;
+}
+
+void watch_set_polling(bool p)
+{
+    polling = p;
+    _notify_update();
+}
+bool watch_get_polling()
+{
+#ifdef CGAME_LINUX
+    return polling || inotify_fd < 0;
+#else
+    return true;
+#endif
+}
+
+void watch_file(const char *filename)
+{
+    watch_add(filename, NULL, NULL);
+}
+unsigned int watch_get_num_changed()
+{
+    return array_length(changed);
+}
+const char *watch_get_nth_changed(unsigned int n)
+{
+    return array_get_val(const char *, changed, n);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void watch_init()
+{
+    watches = array_new(Watch);
+    changed = array_new(const char *);
+    _notify_update();
+}
+void watch_deinit()
+{
+    Watch *w;
+
+    enabled = false;
+    _notify_update();
+
+    array_foreach(w, watches)
+        free(w->filename);
+    array_free(changed);
+    array_free(watches);
+}
+
+void watch_update()
+{
+    unsigned int i;
+    Watch *w;
+
+    if (array_length(changed) > 0)
+        array_clear(changed);
+    if (!enabled)
+        return;
+
+    if (_notifying())
+        _read_events();
+    else
+        _poll();
+
+    /* callbacks may add watches, so index rather than iterate */
+    for (i = 0; i < array_length(watches); ++i)
+    {
+        w = array_get(watches, i);
+        if (!w->changed)
+            continue;
+        w->changed = false;
+        if (w->func)
+            w->func(w->filename, w->data);
+        else
+            array_add_val(const char *, changed) = w->filename;
+    }
+}
+
@@ -0,0 +1,46 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+#include "script_export.h"
+
+/*
+ * notifies of changes to files, for hot reloading -- uses inotify on
+ * linux, elsewhere (or if forced) falls back to checking modification
+ * times a couple times a second
+ *
+ * a watched file needn't exist yet, creating it counts as a change
+ */
+
+typedef void (*WatchFunc)(const char *filename, void *data);
+
+/* call func(filename, data) in watch_update() after filename changes */
+void watch_add(const char *filename, WatchFunc func, void *data);
+
+SCRIPT(watch,
+
+       /* off means no polling or notifications at all */
+       EXPORT void watch_set_enabled(bool enabled);
+       EXPORT bool watch_get_enabled();
+
+       /* poll modification times even where inotify is available */
+       EXPORT void watch_set_polling(bool polling);
+       EXPORT bool watch_get_polling();
+
+       /*
+        * for scripts -- watch a file, then check each frame which files
+        * watched this way changed since last frame
+        */
+       EXPORT void watch_file(const char *filename);
+       EXPORT unsigned int watch_get_num_changed();
+       EXPORT const char *watch_get_nth_changed(unsigned int n);
+
+    )
+
+void watch_init();
+void watch_deinit();
+void watch_update();
+
+#endif
+
@@ -0,0 +1,366 @@
+/*
+ * cgame_atlas -- pack a directory of images into atlases
+ *
+ *     cgame_atlas [-m] [-s max_size] [-p padding] input_dir output_prefix
+ *
+ * writes output_prefix-0.cgtx, output_prefix-1.cgtx, ... (see cgtx.h),
+ * which texture_load(...) reads without decoding, and a rect table
+ * output_prefix.lua returning, for each image file name,
+ *
+ *     { atlas = 'output_prefix-N.cgtx', x = ..., y = ..., w = ..., h = ... }
+ *
+ * where (x, y) is the bottom left corner in pixels and (w, h) the size, as
+ * for sprite_set_texcell(...) and sprite_set_texsize(...)
+ *
+ *     -m           also write mipmaps
+ *     -s max_size  maximum atlas width and height, a power of two no more
+ *                  than CGTX_MAX_DIM, default 2048
+ *     -p padding   empty pixels around each image, default 1
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <stb_image.h>
+
+#include "cgtx.h"
+
+typedef struct Image Image;
+struct Image
+{
+    char *name;
+    unsigned char *data; /* RGBA, top row first */
+    int w, h;
+
+    int page;
+    int x, y;            /* top left in page, top row first */
+};
+
+typedef struct Page Page;
+struct Page
+{
+    int w, h;
+};
+
+static bool mipmaps = false;
+static int max_size = 2048;
+static int padding = 1;
+
+static Image *images = NULL;
+static int nimages = 0;
+static Page *pages = NULL;
+static int npages = 0;
+
+/* ------------------------------------------------------------------------- */
+
+static bool _is_image(const char *name)
+{
+    static const char *exts[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+    const char *dot;
+    unsigned int i;
+
+    if (!(dot = strrchr(name, '.')))
+        return false;
+    for (i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i)
+        if (!strcmp(dot, exts[i]))
+            return true;
+    return false;
+}
+
+static void _load_images(const char *dir_path)
+{
+    DIR *dir;
+    struct dirent *ent;
+    char *path;
+    Image *img;
+    int comp;
+
+    if (!(dir = opendir(dir_path)))
+    {
+        fprintf(stderr, "cgame_atlas: couldn't open directory '%s'\n",
+                dir_path);
+        exit(1);
+    }
+
+    while ((ent = readdir(dir)))
+    {
+        if (!_is_image(ent->d_name))
+            continue;
+
+        path = malloc(strlen(dir_path) + strlen(ent->d_name) + 2);
+        sprintf(path, "%s/%s", dir_path, ent->d_name);
+
+        images = realloc(images, (nimages + 1) * sizeof(Image));
+        img = &images[nimages];
+        img->data = stbi_load(path, &img->w, &img->h, &comp, 4);
+        if (!img->data)
+        {
+            fprintf(stderr, "cgame_atlas: couldn't load '%s', skipping\n",
+                    path);
+            free(path);
+            continue;
+        }
+        if (img->w + 2 * padding > max_size
+            || img->h + 2 * padding > max_size)
+        {
+            fprintf(stderr, "cgame_atlas: '%s' is larger than %d pixels\n",
+                    path, max_size);
+            exit(1);
+        }
+        free(path);
+
+        img->name = malloc(strlen(ent->d_name) + 1);
+        strcpy(img->name, ent->d_name);
+        ++nimages;
+    }
+    closedir(dir);
+}
+
+/* taller first so shelves waste less, then by name to be deterministic */
+static int _image_compare(const void *a, const void *b)
+{
+    const Image *ia = a, *ib = b;
+    if (ia->h != ib->h)
+        return ib->h - ia->h;
+    return strcmp(ia->name, ib->name);
+}
+
+static int _pow2(int n)
+{
+    int p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+/* shelf packing -- fill rows left to right, new page when full */
+static void _pack()
+{
+    int i, x = 0, y = 0, shelf_h = 0, w, h;
+    Page *page = NULL;
+
+    qsort(images, nimages, sizeof(Image), _image_compare);
+
+    for (i = 0; i < nimages; ++i)
+    {
+        w = images[i].w + 2 * padding;
+        h = images[i].h + 2 * padding;
+
+        if (page && x + w > max_size)
+        {
+            x = 0;
+            y += shelf_h;
+            shelf_h = 0;
+        }
+        if (!page || y + h > max_size)
+        {
+            pages = realloc(pages, (npages + 1) * sizeof(Page));
+            page = &pages[npages++];
+            page->w = page->h = 0;
+            x = y = shelf_h = 0;
+        }
+
+        images[i].page = npages - 1;
+        images[i].x = x + padding;
+        images[i].y = y + padding;
+
+        x += w;
+        if (h > shelf_h)
+            shelf_h = h;
+        if (x > page->w)
+            page->w = x;
+        if (y + shelf_h > page->h)
+            page->h = y + shelf_h;
+    }
+
+    for (i = 0; i < npages; ++i)
+    {
+        pages[i].w = _pow2(pages[i].w);
+        pages[i].h = _pow2(pages[i].h);
+    }
+}
+
+/* 2x2 box filter, clamping at odd edges */
+static unsigned char *_downsample(const unsigned char *src, int w, int h)
+{
+    int nw = w > 1 ? w / 2 : 1, nh = h > 1 ? h / 2 : 1, x, y, c;
+    int x0, x1, y0, y1;
+    unsigned char *dst;
+
+    dst = malloc(4 * (size_t) nw * nh);
+    for (y = 0; y < nh; ++y)
+        for (x = 0; x < nw; ++x)
+        {
+            x0 = 2 * x < w ? 2 * x : w - 1;
+            x1 = 2 * x + 1 < w ? 2 * x + 1 : w - 1;
+            y0 = 2 * y < h ? 2 * y : h - 1;
+            y1 = 2 * y + 1 < h ? 2 * y + 1 : h - 1;
+            for (c = 0; c < 4; ++c)
+                dst[4 * (y * nw + x) + c] =
+                    (src[4 * (y0 * w + x0) + c] + src[4 * (y0 * w + x1) + c]
+                     + src[4 * (y1 * w + x0) + c]
+                     + src[4 * (y1 * w + x1) + c] + 2) / 4;
+        }
+    return dst;
+}
+
+static void _write_page(int p, const char *prefix)
+{
+    Page *page = &pages[p];
+    CgtxHeader header;
+    unsigned char *pixels, *level, *next;
+    char *path;
+    FILE *file;
+    int i, row, w, h;
+    unsigned int nlevels, l;
+
+    /* composite, bottom row first */
+    pixels = calloc(4 * (size_t) page->w * page->h, 1);
+    for (i = 0; i < nimages; ++i)
+        if (images[i].page == p)
+            for (row = 0; row < images[i].h; ++row)
+                memcpy(pixels + 4 * ((size_t) (page->h - 1 - images[i].y - row)
+                                     * page->w + images[i].x),
+                       images[i].data + 4 * (size_t) row * images[i].w,
+                       4 * (size_t) images[i].w);
+
+    nlevels = 1;
+    if (mipmaps)
+        for (w = page->w, h = page->h; w > 1 || h > 1; w /= 2, h /= 2)
+            ++nlevels;
+
+    path = malloc(strlen(prefix) + 32);
+    sprintf(path, "%s-%d.cgtx", prefix, p);
+    if (!(file = fopen(path, "wb")))
+    {
+        fprintf(stderr, "cgame_atlas: couldn't write '%s'\n", path);
+        exit(1);
+    }
+
+    /* header, fields written in host order -- assumes little-endian */
+    memcpy(header.magic, CGTX_MAGIC, 4);
+    header.version = CGTX_VERSION;
+    header.width = page->w;
+    header.height = page->h;
+    header.nlevels = nlevels;
+    fwrite(&header, sizeof(header), 1, file);
+
+    level = pixels;
+    w = page->w;
+    h = page->h;
+    for (l = 0; l < nlevels; ++l)
+    {
+        fwrite(level, cgtx_level_size(page->w, page->h, l), 1, file);
+        if (l + 1 < nlevels)
+        {
+            next = _downsample(level, w, h);
+            if (level != pixels)
+                free(level);
+            level = next;
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+    if (level != pixels)
+        free(level);
+
+    fclose(file);
+    printf("cgame_atlas: wrote '%s' (%dx%d, %u level%s)\n", path,
+           page->w, page->h, nlevels, nlevels == 1 ? "" : "s");
+    free(path);
+    free(pixels);
+}
+
+static void _write_rects(const char *dir_path, const char *prefix)
+{
+    const char *base;
+    char *path;
+    FILE *file;
+    Image *img;
+    int i;
+
+    path = malloc(strlen(prefix) + 8);
+    sprintf(path, "%s.lua", prefix);
+    if (!(file = fopen(path, "w")))
+    {
+        fprintf(stderr, "cgame_atlas: couldn't write '%s'\n", path);
+        exit(1);
+    }
+
+    base = strrchr(prefix, '/');
+    base = base ? base + 1 : prefix;
+
+    fprintf(file, "-- generated by cgame_atlas from '%s'\n", dir_path);
+    fprintf(file, "return {\n");
+    for (i = 0; i < nimages; ++i)
+    {
+        img = &images[i];
+        fprintf(file, "    ['%s'] = { atlas = '%s-%d.cgtx', "
+                "x = %d, y = %d, w = %d, h = %d },\n",
+                img->name, base, img->page, img->x,
+                pages[img->page].h - img->y - img->h, img->w, img->h);
+    }
+    fprintf(file, "}\n");
+
+    fclose(file);
+    printf("cgame_atlas: wrote '%s' (%d images)\n", path, nimages);
+    free(path);
+}
+
+static void _usage()
+{
+    fprintf(stderr, "usage: cgame_atlas [-m] [-s max_size] [-p padding] "
+            "input_dir output_prefix\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir_path = NULL, *prefix = NULL;
+    int i, p;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-m"))
+            mipmaps = true;
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            max_size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            padding = atoi(argv[++i]);
+        else if (!dir_path)
+            dir_path = argv[i];
+        else if (!prefix)
+            prefix = argv[i];
+        else
+            _usage();
+    }
+    if (!dir_path || !prefix || padding < 0)
+        _usage();
+
+    /* pages are rounded up to powers of two, so that can't go over */
+    if (max_size <= 0 || max_size > CGTX_MAX_DIM
+        || (max_size & (max_size - 1)))
+    {
+        fprintf(stderr, "cgame_atlas: max_size must be a power of two no "
+                "more than %d\n", CGTX_MAX_DIM);
+        exit(1);
+    }
+
+    _load_images(dir_path);
+    _pack();
+    for (p = 0; p < npages; ++p)
+        _write_page(p, prefix);
+    _write_rects(dir_path, prefix);
+
+    for (i = 0; i < nimages; ++i)
+    {
+        stbi_image_free(images[i].data);
+        free(images[i].name);
+    }
+    free(images);
+    free(pages);
+    return 0;
+}
+
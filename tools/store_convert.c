@@ -0,0 +1,80 @@
+/*
+ * cgame_store_convert -- convert a store file (level, prefab, ...) between
+ * the text and binary formats
+ *
+ *     cgame_store_convert [-t] input output
+ *
+ * writes binary by default, text with -t -- the input may be in either
+ * format, input and output may be the same file, children are kept in the
+ * same order and the output is read back to check it
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include "saveload.h"
+
+/* saveload.c reports errors through here */
+void errorf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void _usage()
+{
+    fprintf(stderr, "usage: cgame_store_convert [-t] input output\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *input = NULL, *output = NULL;
+    bool binary = true;
+    Store *s, *t;
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-t"))
+            binary = false;
+        else if (!input)
+            input = argv[i];
+        else if (!output)
+            output = argv[i];
+        else
+            _usage();
+    }
+    if (!input || !output)
+        _usage();
+
+    saveload_init();
+    /* read into memory, output may be written over it */
+    s = store_open_file_copy(input);
+    store_set_binary(s, binary);
+
+    /* read stores list children backwards, so turn around to write */
+    store_reverse(s);
+    store_write_file(s, output);
+    store_reverse(s);
+
+    t = store_open_file(output);
+    if (!store_equal(s, t))
+    {
+        fprintf(stderr, "'%s' doesn't read back the same as '%s'\n",
+                output, input);
+        return 1;
+    }
+    store_close(t);
+    store_close(s);
+    saveload_deinit();
+    return 0;
+}